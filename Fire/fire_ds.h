@@ -61,6 +61,11 @@
 #define DS_ARENA_BLOCK_ALIGNMENT  (sizeof(void*)*2)
 #endif
 
+// Virtual arenas commit memory in chunks of this size. Must be a multiple of the OS page size.
+#ifndef DS_ARENA_VIRTUAL_COMMIT_SIZE
+#define DS_ARENA_VIRTUAL_COMMIT_SIZE  (64*1024)
+#endif
+
 typedef enum DS_AllocatorType {
 	DS_AllocatorType_Heap,
 	DS_AllocatorType_Arena,
@@ -91,7 +96,7 @@ typedef struct DS_ArenaBlockHeader {
 } DS_ArenaBlockHeader;
 
 typedef struct DS_ArenaMark {
-	DS_ArenaBlockHeader* block; // If the arena has no blocks allocated yet, then we mark the beginning of the arena by setting this member to NULL.
+	DS_ArenaBlockHeader* block; // If the arena has no blocks allocated yet, then we mark the beginning of the arena by setting this member to NULL. In a virtual arena, this is always `virtual_base`.
 	char* ptr;
 } DS_ArenaMark;
 
@@ -101,7 +106,16 @@ struct DS_Arena {
 	DS_ArenaBlockHeader* first_block; // may be NULL
 	DS_ArenaMark mark;
 	DS_Allocator* allocator;
-	int total_mem_reserved;
+	int64_t total_mem_reserved; // In a virtual arena, this is the number of committed bytes
+
+	// Bytes lost since the last reset to the unused ends of blocks, and to buffers that were abandoned when DS_AllocatorFn
+	// moved them to grow them, e.g. the old buffers of a growing DS_DynArray. Not updated by DS_ArenaSetMark.
+	int64_t wasted_bytes;
+
+	// Only used by virtual arenas, see DS_ArenaInitVirtual
+	char* virtual_base; // NULL if this is a regular arena
+	char* virtual_commit_end;
+	char* virtual_reserve_end;
 };
 
 // --- Internal helpers -------------------------------------
@@ -272,15 +286,35 @@ Remove the first node of a singly linked list, e.g.
 DS_API uint32_t DS_MurmurHash3(const void* key, int len, uint32_t seed);
 DS_API uint64_t DS_MurmurHash64A(const void* key, int len, uint64_t seed);
 
+// The map is a swiss table: next to the elements there's an array of control bytes, one per slot, which are probed
+// 16 at a time (using SSE2 when available). A control byte holds 7 bits of the hash of a full slot, so most
+// non-matching slots are skipped without touching the elements. 4- and 8-byte keys are hashed with a cheap integer
+// mixer instead of MurmurHash3.
+//
+// Maps initialized with DS_MapFlag_IncrementalRehash don't move all elements at once when growing. Instead, the old
+// table is kept around and a few of its slots are moved over on every insert and remove. This avoids the spike of
+// rehashing a big map during a single insert.
+typedef enum DS_MapFlags {
+	DS_MapFlag_IncrementalRehash = 1 << 0,
+} DS_MapFlags;
+
+#define DS_MapInternalFields_ \
+	int32_t deleted_count; /* number of tombstones in `data` */ \
+	uint32_t flags; /* DS_MapFlags */ \
+	void* old_data; /* the table that is being rehashed from; NULL if not rehashing */ \
+	int32_t old_capacity; \
+	int32_t rehash_next; /* the next slot in `old_data` to move over */
+
 // If using a struct as the key type in a DS_Map, it must not contain any compiler-generated padding, as that could cause
 // unpredictable behaviour when memcmp is used on them.
 #define DS_NoteAboutKeyTypePadding
 
 #define DS_Map(K, V) \
-	struct { DS_Allocator* allocator; struct{ uint32_t hash; K key; V value; }* data; int32_t count; int32_t capacity; }
+	struct { DS_Allocator* allocator; struct{ uint32_t hash; K key; V value; }* data; int32_t count; int32_t capacity; DS_MapInternalFields_ }
 typedef DS_Map(char, char) DS_MapRaw;
 
 #define DS_MapInit(MAP, ALLOCATOR)            DS_MapInitRaw((DS_MapRaw*)(MAP), (ALLOCATOR))
+#define DS_MapInitEx(MAP, ALLOCATOR, FLAGS)   DS_MapInitExRaw((DS_MapRaw*)(MAP), (ALLOCATOR), (FLAGS))
 
 #define DS_MapInitClone(MAP, SRC, ALLOCATOR)  DS_MapInitCloneRaw((DS_MapRaw*)(MAP), (DS_MapRaw*)(SRC), (ALLOCATOR), DS_MapElemSize(SRC))
 
@@ -355,10 +389,11 @@ typedef DS_Map(char, char) DS_MapRaw;
 //
 
 #define DS_Set(K) \
-	struct { DS_Allocator* allocator; struct{ uint32_t hash; K key; } *data; int32_t count; int32_t capacity; }
+	struct { DS_Allocator* allocator; struct{ uint32_t hash; K key; } *data; int32_t count; int32_t capacity; DS_MapInternalFields_ }
 typedef DS_Set(char) DS_SetRaw;
 
 #define DS_SetInit(SET, ALLOCATOR)        DS_MapInitRaw((DS_MapRaw*)(SET), (ALLOCATOR))
+#define DS_SetInitEx(SET, ALLOCATOR, FLAGS) DS_MapInitExRaw((DS_MapRaw*)(SET), (ALLOCATOR), (FLAGS))
 
 // * Returns true if the key was found.
 // * KEY must be an l-value, otherwise this macro won't compile.
@@ -409,17 +444,28 @@ static inline bool DS_MapFindRaw(DS_MapRaw* map, const void* key, DS_OUT void* o
 // * Returns the address of the value if the key was found, otherwise NULL.
 static inline void* DS_MapFindPtrRaw(DS_MapRaw* map, const void* key, int K_size, int V_size, int elem_size, int key_offset, int val_offset);
 
+// Iterates the slots of the table first, and then the slots of the old table if the map is being rehashed.
 static inline bool DS_MapIter(DS_MapRaw* map, int* i, void** out_key, void** out_value, int key_offset, int val_offset, int elem_size) {
 	char* elem_base;
 	for (;;) {
-		if (*i >= map->capacity) return false;
+		if (*i >= map->capacity + map->old_capacity) return false;
+
+		char* data = (char*)map->data;
+		int capacity = map->capacity;
+		int slot = *i;
+		if (slot >= capacity) {
+			data = (char*)map->old_data;
+			slot -= capacity;
+			capacity = map->old_capacity;
+		}
 
-		elem_base = (char*)map->data + (*i) * elem_size;
-		if (*(uint32_t*)elem_base == 0) {
+		const uint8_t* ctrl = (const uint8_t*)data + capacity * elem_size;
+		if (ctrl[slot] & 0x80) { // empty or deleted
 			*i = *i + 1;
 			continue;
 		}
 
+		elem_base = data + slot * elem_size;
 		break;
 	}
 	*out_key = elem_base + key_offset;
@@ -433,6 +479,21 @@ static inline bool DS_MapIter(DS_MapRaw* map, int* i, void** out_key, void** out
 DS_API void DS_ArenaInit(DS_Arena* arena, int block_size, DS_Allocator* allocator);
 DS_API void DS_ArenaDeinit(DS_Arena* arena);
 
+// A virtual arena reserves `reserve_size` bytes of address space up front and commits pages of it as they're needed.
+// All allocations end up in one contiguous region, pushing never calls into another allocator and resetting is O(1).
+// Reserving address space doesn't use any memory, so `reserve_size` can be generous, e.g. DS_GIB(1).
+// Not available if DS_NO_VIRTUAL_MEMORY is defined.
+DS_API void DS_ArenaInitVirtual(DS_Arena* arena, uint64_t reserve_size);
+
+// Returns the committed pages past the current mark of a virtual arena back to the OS, e.g. after resetting an arena
+// that was used for something unusually big. Does nothing for regular arenas.
+DS_API void DS_ArenaDecommit(DS_Arena* arena);
+
+// If `ptr` is the most recent allocation made from the arena and `old_size` is its size, resizes it to `new_size`
+// without moving it and returns true. Otherwise, returns false. In a regular arena, the allocation must also fit in
+// the current block.
+DS_API bool DS_ArenaResizeInPlace(DS_Arena* arena, void* ptr, int old_size, int new_size);
+
 DS_API char* DS_ArenaPush(DS_Arena* arena, int size);
 DS_API char* DS_ArenaPushZero(DS_Arena* arena, int size);
 DS_API char* DS_ArenaPushEx(DS_Arena* arena, int size, int alignment);
@@ -441,6 +502,10 @@ DS_API DS_ArenaMark DS_ArenaGetMark(DS_Arena* arena);
 DS_API void DS_ArenaSetMark(DS_Arena* arena, DS_ArenaMark mark);
 DS_API void DS_ArenaReset(DS_Arena* arena);
 
+// Returns the number of bytes from the beginning of the arena up to its mark, including block headers and the unused
+// ends of the blocks before the current one.
+DS_API int64_t DS_ArenaGetUsed(DS_Arena* arena);
+
 // -- Dual-arena scope -----------------------------------------------
 
 // The convention when passing a DS_Scope* into a function is that allocations that are returned to the caller
@@ -462,22 +527,113 @@ static inline void DS_ScopeEnd(DS_Scope* scope) {
 	}
 }
 
+// -- Scratch arenas -----------------------------------------------
+//
+// Every thread has a small pool of virtual arenas for temporary allocations, so that temporary memory doesn't need to
+// be passed around and any function can run on any thread:
+//
+//   DS_Scope scratch = DS_ScratchBegin(NULL, 0);
+//   DS_DynArray(int) temp = {scratch.arena};
+//   ...
+//   DS_ScratchEnd(&scratch);
+//
+// Scratch scopes nest like a stack. If a function returns allocations in an arena given by the caller, and that arena
+// might be a scratch arena itself, it should pass it in `conflicts` so that it gets a different scratch arena; otherwise
+// ending the scope would free the caller's allocations. The `inner` arena of the returned scope is another scratch
+// arena when there is one free, so the scope can be passed to functions that take a DS_Scope*.
+//
+// The scratch state is static like the rest of this file, so each translation unit has its own pool per thread.
+// Not available if DS_NO_VIRTUAL_MEMORY is defined.
+
+#ifndef DS_SCRATCH_ARENA_COUNT
+#define DS_SCRATCH_ARENA_COUNT 2
+#endif
+
+#ifndef DS_SCRATCH_ARENA_RESERVE_SIZE
+#define DS_SCRATCH_ARENA_RESERVE_SIZE DS_GIB(4)
+#endif
+
+// Maximum number of threads whose scratch usage is tracked. Threads past this still get scratch arenas.
+#ifndef DS_SCRATCH_MAX_THREADS
+#define DS_SCRATCH_MAX_THREADS 64
+#endif
+
+#if defined(__cplusplus)
+#define DS_THREAD_LOCAL thread_local
+#elif defined(_MSC_VER)
+#define DS_THREAD_LOCAL __declspec(thread)
+#else
+#define DS_THREAD_LOCAL _Thread_local
+#endif
+
+typedef struct DS_ScratchThreadStats {
+	int64_t used;      // bytes currently in use across the scratch arenas of the thread
+	int64_t peak_used; // highest value `used` has had at the end of a scratch scope
+	int64_t committed; // bytes of memory committed by the scratch arenas of the thread
+} DS_ScratchThreadStats;
+
+DS_API DS_Scope DS_ScratchBegin(DS_Arena* const* conflicts, int conflicts_count);
+DS_API void DS_ScratchEnd(DS_Scope* scratch);
+
+// Releases the scratch arenas of the calling thread. Threads that live until the program exits don't need to call this.
+DS_API void DS_ScratchThreadDeinit(void);
+
+// Threads are numbered in the order in which they first began a scratch scope, starting from 0.
+// The stats of another thread are updated without synchronization, so they may be slightly out of date.
+DS_API int DS_ScratchThreadsCount(void);
+DS_API DS_ScratchThreadStats DS_ScratchGetThreadStats(int thread_index);
+
 // -- Memory allocation --------------------------------
 
 #ifndef DS_NO_MALLOC
 static char* DS_AllocatorFn_Default(DS_AllocatorBase_Default* allocator, char* old_ptr, int old_size, int new_size, int new_alignment) {
 	char* result;
 	if (allocator->type == DS_AllocatorType_Arena) {
-		result = DS_ArenaPushEx((DS_Arena*)allocator, new_size, new_alignment);
-		memcpy(result, old_ptr, old_size);
+		if (old_ptr && new_size > old_size && ((uintptr_t)old_ptr & (new_alignment - 1)) == 0 &&
+			DS_ArenaResizeInPlace((DS_Arena*)allocator, old_ptr, old_size, new_size))
+		{
+			result = old_ptr; // the old allocation was the most recent one and had room to grow
+		}
+		else {
+			result = DS_ArenaPushEx((DS_Arena*)allocator, new_size, new_alignment);
+			memcpy(result, old_ptr, old_size);
+			if (old_ptr) ((DS_Arena*)allocator)->wasted_bytes += old_size;
+		}
 	}
 	else {
+#ifdef _WIN32
 		result = (char*)_aligned_realloc(old_ptr, new_size, new_alignment);
+#else
+		// There is no aligned realloc outside of Windows. malloc is aligned to at least 16 bytes on the platforms we care about.
+		if (new_size == 0) {
+			free(old_ptr);
+			result = NULL;
+		}
+		else if (new_alignment <= 16) {
+			result = (char*)realloc(old_ptr, new_size);
+		}
+		else {
+			void* new_ptr = NULL;
+			if (posix_memalign(&new_ptr, new_alignment, new_size) != 0) return NULL; // `old_ptr` stays valid, like with realloc
+			result = (char*)new_ptr;
+			if (old_ptr) {
+				memcpy(result, old_ptr, old_size < new_size ? old_size : new_size);
+				free(old_ptr);
+			}
+		}
+#endif
 	}
 	return result;
 }
 #endif
 
+// DS_ALLOCATOR_HOOK is called after every DS_AllocatorFn call with its arguments and result, e.g. for profiling.
+// DS_ArenaPush and friends don't go through DS_AllocatorFn, so the hook doesn't see them.
+// It must not allocate through DS_AllocatorFn itself.
+#ifndef DS_ALLOCATOR_HOOK
+#define DS_ALLOCATOR_HOOK(ALLOCATOR, OLD_PTR, OLD_SIZE, NEW_PTR, NEW_SIZE)
+#endif
+
 // DS_AllocatorFn is a combination of malloc, free and realloc.
 // - To make a new allocation (i.e. malloc/realloc), pass a size other than 0 into `new_size`,
 //   and pass an alignment, e.g. DS_DEFAULT_ALIGNMENT into `new_alignment`.
@@ -485,6 +641,7 @@ static char* DS_AllocatorFn_Default(DS_AllocatorBase_Default* allocator, char* o
 static inline char* DS_AllocatorFn(DS_Allocator* allocator, const void* old_ptr, int old_size, int new_size, int new_alignment) {
 	char* result = DS_AllocatorFn_Impl((DS_AllocatorBase*)allocator, (char*)old_ptr, old_size, new_size, new_alignment);
 	DS_ASSERT(((uintptr_t)result & (new_alignment - 1)) == 0); // check that the alignment is correct
+	DS_ALLOCATOR_HOOK(allocator, old_ptr, old_size, result, new_size);
 	return result;
 }
 
@@ -945,6 +1102,7 @@ static inline void* DS_BucketArrayPushRaw(DS_BucketArrayRaw* array, uint32_t ele
 
 DS_API void DS_ArrCloneRaw(DS_Arena* arena, DS_DynArrayRaw* array, int elem_size) {
 	array->data = DS_CloneSize(arena, array->data, array->count * elem_size);
+	array->capacity = array->count; // the clone only has room for `count` elements, which growing in place relies on
 }
 
 DS_API void DS_ArrReserveRaw(DS_DynArrayRaw* array, int capacity, int elem_size) {
@@ -958,7 +1116,8 @@ DS_API void DS_ArrReserveRaw(DS_DynArrayRaw* array, int capacity, int elem_size)
 	}
 
 	if (new_capacity != array->capacity) {
-		array->data = DS_AllocatorFn(array->allocator, array->data, array->count * elem_size, new_capacity * elem_size, DS_DEFAULT_ALIGNMENT);
+		// Pass the size of the whole allocation, so that an arena can grow it in place, or count all of it as wasted if it moves
+		array->data = DS_AllocatorFn(array->allocator, array->data, array->capacity * elem_size, new_capacity * elem_size, DS_DEFAULT_ALIGNMENT);
 		array->capacity = new_capacity;
 	}
 
@@ -1075,20 +1234,224 @@ DS_API void DS_ArrPopRaw(DS_DynArrayRaw* array, DS_OUT void* out_elem, int elem_
 	DS_ProfExit();
 }
 
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DS_MAP_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+static inline int DS_CountTrailingZeros32(uint32_t x) { unsigned long result; _BitScanForward(&result, x); return (int)result; }
+#else
+static inline int DS_CountTrailingZeros32(uint32_t x) { return __builtin_ctz(x); }
+#endif
+
+#define DS_MAP_GROUP_WIDTH 16
+#define DS_MAP_MIN_CAPACITY 16
+#define DS_MAP_REHASH_STEP 32 // number of old slots moved over per insert/remove during an incremental rehash
+
+// Control bytes. A full slot stores the low 7 bits of its hash, so the high bit tells if a slot is empty or deleted.
+#define DS_MAP_CTRL_EMPTY   0x80
+#define DS_MAP_CTRL_DELETED 0xFE
+
+// The control bytes are stored right after the elements in the same allocation. The first DS_MAP_GROUP_WIDTH - 1
+// control bytes are mirrored after the end, so that a group can be loaded starting from any slot.
+#define DS_MapTableCtrl(DATA, CAPACITY, ELEM_SIZE) ((uint8_t*)(DATA) + (CAPACITY) * (ELEM_SIZE))
+#define DS_MapTableSize(CAPACITY, ELEM_SIZE) ((CAPACITY) * (ELEM_SIZE) + (CAPACITY) + DS_MAP_GROUP_WIDTH)
+
+// Returns a bitmask of the slots in the group whose control byte equals `value`
+static inline uint32_t DS_MapGroupMatch(const uint8_t* group, uint8_t value) {
+#ifdef DS_MAP_USE_SSE2
+	__m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)value)));
+#else
+	uint32_t mask = 0;
+	for (int i = 0; i < DS_MAP_GROUP_WIDTH; i++) mask |= (uint32_t)(group[i] == value) << i;
+	return mask;
+#endif
+}
+
+// Returns a bitmask of the slots in the group that are empty or deleted
+static inline uint32_t DS_MapGroupMatchAvailable(const uint8_t* group) {
+#ifdef DS_MAP_USE_SSE2
+	return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+#else
+	uint32_t mask = 0;
+	for (int i = 0; i < DS_MAP_GROUP_WIDTH; i++) mask |= (uint32_t)(group[i] >> 7) << i;
+	return mask;
+#endif
+}
+
+static inline uint32_t DS_MapHashKey(const void* key, int K_size) {
+	uint32_t hash;
+	if (K_size == 8) {
+		// Small integer keys are common, i.e. UI keys and pointers, so use the MurmurHash3 finalizer on them directly.
+		uint64_t x;
+		memcpy(&x, key, 8);
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdLLU;
+		x ^= x >> 33;
+		x *= 0xc4ceb9fe1a85ec53LLU;
+		x ^= x >> 33;
+		hash = (uint32_t)x;
+	}
+	else if (K_size == 4) {
+		uint32_t x;
+		memcpy(&x, key, 4);
+		x ^= x >> 16;
+		x *= 0x85ebca6b;
+		x ^= x >> 13;
+		x *= 0xc2b2ae35;
+		x ^= x >> 16;
+		hash = x;
+	}
+	else {
+		hash = DS_MurmurHash3(key, K_size, 989898);
+	}
+	return hash == 0 ? 1 : hash; // 0 is reserved
+}
+
+static inline void DS_MapSetCtrl(uint8_t* ctrl, int capacity, uint32_t slot, uint8_t value) {
+	ctrl[slot] = value;
+	if (slot < DS_MAP_GROUP_WIDTH - 1) ctrl[capacity + slot] = value;
+}
+
+static char* DS_MapAllocTable(DS_Allocator* allocator, int capacity, int elem_size) {
+	char* data = DS_AllocatorFn(allocator, NULL, 0, DS_MapTableSize(capacity, elem_size), DS_DEFAULT_ALIGNMENT);
+	memset(DS_MapTableCtrl(data, capacity, elem_size), DS_MAP_CTRL_EMPTY, capacity + DS_MAP_GROUP_WIDTH);
+	return data;
+}
+
+static void DS_MapFreeTable(DS_Allocator* allocator, void* data, int capacity, int elem_size) {
+	DS_DebugFillGarbage(data, DS_MapTableSize(capacity, elem_size));
+	DS_AllocatorFn(allocator, data, 0, 0, DS_DEFAULT_ALIGNMENT);
+}
+
+// Returns the slot of `key` in the table, or -1 if it doesn't exist.
+static inline int DS_MapTableFind(char* data, int capacity, const void* key, uint32_t hash, int K_size, int elem_size, int key_offset) {
+	if (capacity == 0) return -1;
+	const uint8_t* ctrl = DS_MapTableCtrl(data, capacity, elem_size);
+	uint32_t mask = (uint32_t)capacity - 1;
+	uint32_t pos = (hash >> 7) & mask;
+	uint8_t h2 = (uint8_t)(hash & 0x7F);
+
+	for (uint32_t step = DS_MAP_GROUP_WIDTH;; step += DS_MAP_GROUP_WIDTH) {
+		const uint8_t* group = ctrl + pos;
+		for (uint32_t match = DS_MapGroupMatch(group, h2); match; match &= match - 1) {
+			uint32_t slot = (pos + DS_CountTrailingZeros32(match)) & mask;
+			char* elem = data + slot * elem_size;
+			if (*(uint32_t*)elem == hash && memcmp(elem + key_offset, key, K_size) == 0) return (int)slot;
+		}
+		if (DS_MapGroupMatch(group, DS_MAP_CTRL_EMPTY)) return -1;
+		pos = (pos + step) & mask; // triangular probing visits every group when the capacity is a power of two
+	}
+}
+
+// Claims a slot for a key that isn't in the table yet and returns the element. Only the hash of the element is written.
+static char* DS_MapTableInsert(DS_MapRaw* map, uint32_t hash, int elem_size) {
+	uint8_t* ctrl = DS_MapTableCtrl(map->data, map->capacity, elem_size);
+	uint32_t mask = (uint32_t)map->capacity - 1;
+	uint32_t pos = (hash >> 7) & mask;
+
+	for (uint32_t step = DS_MAP_GROUP_WIDTH;; step += DS_MAP_GROUP_WIDTH) {
+		uint32_t available = DS_MapGroupMatchAvailable(ctrl + pos);
+		if (available) {
+			uint32_t slot = (pos + DS_CountTrailingZeros32(available)) & mask;
+			if (ctrl[slot] == DS_MAP_CTRL_DELETED) map->deleted_count--;
+			DS_MapSetCtrl(ctrl, map->capacity, slot, (uint8_t)(hash & 0x7F));
+
+			char* elem = (char*)map->data + slot * elem_size;
+			*(uint32_t*)elem = hash;
+			return elem;
+		}
+		pos = (pos + step) & mask;
+	}
+}
+
+// Moves up to `slots_count` slots of the old table over to the current table.
+static void DS_MapRehashStep(DS_MapRaw* map, int slots_count, int elem_size) {
+	DS_ProfEnter();
+	char* old_data = (char*)map->old_data;
+	uint8_t* old_ctrl = DS_MapTableCtrl(old_data, map->old_capacity, elem_size);
+
+	int end = map->rehash_next + slots_count;
+	if (end > map->old_capacity) end = map->old_capacity;
+
+	for (int i = map->rehash_next; i < end; i++) {
+		if (old_ctrl[i] & 0x80) continue;
+		char* old_elem = old_data + i * elem_size;
+		char* new_elem = DS_MapTableInsert(map, *(uint32_t*)old_elem, elem_size);
+		memcpy(new_elem, old_elem, elem_size);
+		DS_MapSetCtrl(old_ctrl, map->old_capacity, i, DS_MAP_CTRL_DELETED); // lookups into the old table skip it from now on
+	}
+	map->rehash_next = end;
+
+	if (end == map->old_capacity) {
+		DS_MapFreeTable(map->allocator, map->old_data, map->old_capacity, elem_size);
+		map->old_data = NULL;
+		map->old_capacity = 0;
+		map->rehash_next = 0;
+	}
+	DS_ProfExit();
+}
+
+static void DS_MapGrow(DS_MapRaw* map, int elem_size) {
+	DS_ProfEnter();
+	if (map->old_data) {
+		// Finish the previous rehash first. The elements of the old table are included in `count`, so they fit.
+		DS_MapRehashStep(map, map->old_capacity, elem_size);
+	}
+
+	// If the table is mostly filled with tombstones, rehash into a table of the same size to clear them
+	int new_capacity = map->capacity == 0 ? DS_MAP_MIN_CAPACITY :
+		2 * (map->count + 1) > map->capacity ? map->capacity * 2 : map->capacity;
+
+	if (map->capacity > 0) {
+		map->old_data = map->data;
+		map->old_capacity = map->capacity;
+		map->rehash_next = 0;
+	}
+
+	void* new_data = DS_MapAllocTable(map->allocator, new_capacity, elem_size);
+	memcpy(&map->data, &new_data, sizeof(void*));
+	map->capacity = new_capacity;
+	map->deleted_count = 0;
+
+	if (map->old_data && !(map->flags & DS_MapFlag_IncrementalRehash)) {
+		DS_MapRehashStep(map, map->old_capacity, elem_size);
+	}
+	DS_ProfExit();
+}
+
 static inline void DS_MapInitRaw(DS_MapRaw* map, DS_Allocator* allocator) {
 	DS_MapRaw result = {allocator};
 	*map = result;
 }
 
+static inline void DS_MapInitExRaw(DS_MapRaw* map, DS_Allocator* allocator, uint32_t flags) {
+	DS_MapRaw result = {allocator};
+	result.flags = flags;
+	*map = result;
+}
+
 static inline void DS_MapClearRaw(DS_MapRaw* map, int elem_size) {
-	memset(map->data, 0, map->capacity * elem_size);
+	if (map->old_data) {
+		DS_MapFreeTable(map->allocator, map->old_data, map->old_capacity, elem_size);
+		map->old_data = NULL;
+		map->old_capacity = 0;
+		map->rehash_next = 0;
+	}
+	if (map->capacity > 0) {
+		memset(DS_MapTableCtrl(map->data, map->capacity, elem_size), DS_MAP_CTRL_EMPTY, map->capacity + DS_MAP_GROUP_WIDTH);
+	}
 	map->count = 0;
+	map->deleted_count = 0;
 }
 
 static inline void DS_MapDeinitRaw(DS_MapRaw* map, int elem_size) {
 	DS_ProfEnter();
-	DS_DebugFillGarbage(map->data, map->capacity * elem_size);
-	DS_AllocatorFn(map->allocator, map->data, 0, 0, DS_DEFAULT_ALIGNMENT);
+	if (map->old_data) DS_MapFreeTable(map->allocator, map->old_data, map->old_capacity, elem_size);
+	if (map->data) DS_MapFreeTable(map->allocator, map->data, map->capacity, elem_size);
 	DS_MapRaw empty = {0};
 	*map = empty;
 	DS_ProfExit();
@@ -1192,30 +1555,19 @@ DS_API uint32_t DS_MurmurHash3(const void* key, int len, uint32_t seed) {
 }
 
 static inline void* DS_MapFindPtrRaw(DS_MapRaw* map, const void* key, int K_size, int V_size, int elem_size, int key_offset, int val_offset) {
-	if (map->capacity == 0) return NULL;
+	if (map->count == 0) return NULL;
 	DS_ProfEnter();
 
-	// TODO: it'd be nice to use an integer hash function for small keys... just not sure how to implement that in an ergonomic way.
-	// Maybe just ask for the hash?
-
-	uint32_t hash = DS_MurmurHash3(key, K_size, 989898);
-	if (hash == 0) hash = 1;
-
-	uint32_t mask = (uint32_t)map->capacity - 1;
-	uint32_t index = hash & mask;
+	uint32_t hash = DS_MapHashKey(key, K_size);
 
 	void* found = NULL;
-	for (;;) {
-		char* elem = (char*)map->data + index * elem_size;
-		uint32_t elem_hash = *(uint32_t*)elem;
-		if (elem_hash == 0) break;
-
-		if (hash == elem_hash && memcmp(key, elem + key_offset, K_size) == 0) {
-			found = elem + val_offset;
-			break;
-		}
-
-		index = (index + 1) & mask;
+	int slot = DS_MapTableFind((char*)map->data, map->capacity, key, hash, K_size, elem_size, key_offset);
+	if (slot >= 0) {
+		found = (char*)map->data + slot * elem_size + val_offset;
+	}
+	else if (map->old_data) {
+		slot = DS_MapTableFind((char*)map->old_data, map->old_capacity, key, hash, K_size, elem_size, key_offset);
+		if (slot >= 0) found = (char*)map->old_data + slot * elem_size + val_offset;
 	}
 
 	DS_ProfExit();
@@ -1233,8 +1585,7 @@ static inline bool DS_MapFindRaw(DS_MapRaw* map, const void* key, DS_OUT void* o
 }
 
 static inline bool DS_MapGetOrAddRaw(DS_MapRaw* map, const void* key, DS_OUT void** out_val_ptr, int K_size, int V_size, int elem_size, int key_offset, int val_offset) {
-	uint32_t hash = DS_MurmurHash3((char*)key, K_size, 989898);
-	if (hash == 0) hash = 1;
+	uint32_t hash = DS_MapHashKey(key, K_size);
 	bool result = DS_MapGetOrAddRawEx(map, key, out_val_ptr, K_size, V_size, elem_size, key_offset, val_offset, hash);
 	return result;
 }
@@ -1243,125 +1594,63 @@ static bool DS_MapGetOrAddRawEx(DS_MapRaw* map, const void* key, DS_OUT void** o
 	DS_ProfEnter();
 	DS_ASSERT(map->allocator != NULL); // Have you called DS_MapInit?
 
-	if (100 * (map->count + 1) > 70 * map->capacity) {
-		// Grow the map
-
-		char* old_data = (char*)map->data;
-		int old_capacity = map->capacity;
-
-		map->capacity = old_capacity == 0 ? 8 : old_capacity * 2;
-		map->count = 0;
-
-		void* new_data = DS_AllocatorFn(map->allocator, NULL, 0, map->capacity * elem_size, DS_DEFAULT_ALIGNMENT);
-
-		memcpy(&map->data, &new_data, sizeof(void*));
-		memset(map->data, 0, map->capacity * elem_size); // set hash values to 0
-
-		for (int i = 0; i < old_capacity; i++) {
-			char* elem = old_data + elem_size * i;
-			uint32_t elem_hash = *(uint32_t*)elem;
-			void* elem_key = elem + key_offset;
-			void* elem_val = elem + val_offset;
-
-			if (elem_hash != 0) {
-				void* new_val_ptr;
-				DS_MapGetOrAddRawEx(map, elem_key, &new_val_ptr, K_size, V_size, elem_size, key_offset, val_offset, elem_hash);
-				memcpy(new_val_ptr, elem_val, V_size);
-			}
-		}
-
-		DS_DebugFillGarbage(old_data, old_capacity * elem_size);
-		DS_AllocatorFn(map->allocator, old_data, 0, 0, DS_DEFAULT_ALIGNMENT); // free the old data
-	}
-
-	uint32_t mask = (uint32_t)map->capacity - 1;
-	uint32_t idx = hash & mask;
+	if (map->old_data) DS_MapRehashStep(map, DS_MAP_REHASH_STEP, elem_size);
 
+	char* elem = NULL;
 	bool added_new = false;
 
-	for (;;) {
-		char* elem_base = (char*)map->data + idx * elem_size;
-
-		uint32_t* elem_hash = (uint32_t*)elem_base;
-		char* elem_key = elem_base + key_offset;
-		char* elem_val = elem_base + val_offset;
-
-		if (*elem_hash == 0) {
-			// We found an empty slot
-			memcpy(elem_key, key, K_size);
-			*elem_hash = hash;
-
-			if (out_val_ptr) *out_val_ptr = elem_val;
+	int slot = DS_MapTableFind((char*)map->data, map->capacity, key, hash, K_size, elem_size, key_offset);
+	if (slot >= 0) {
+		elem = (char*)map->data + slot * elem_size;
+	}
+	else {
+		int old_slot = map->old_data ? DS_MapTableFind((char*)map->old_data, map->old_capacity, key, hash, K_size, elem_size, key_offset) : -1;
+		if (old_slot >= 0) {
+			// The key exists in the old table, move it over now
+			char* old_elem = (char*)map->old_data + old_slot * elem_size;
+			elem = DS_MapTableInsert(map, hash, elem_size);
+			memcpy(elem, old_elem, elem_size);
+			DS_MapSetCtrl(DS_MapTableCtrl(map->old_data, map->old_capacity, elem_size), map->old_capacity, old_slot, DS_MAP_CTRL_DELETED);
+		}
+		else {
+			if (8 * (map->count + map->deleted_count + 1) > 7 * map->capacity) {
+				DS_MapGrow(map, elem_size);
+			}
+			elem = DS_MapTableInsert(map, hash, elem_size);
+			memcpy(elem + key_offset, key, K_size);
 			map->count++;
 			added_new = true;
-			break;
 		}
-
-		if (hash == *elem_hash && memcmp(key, elem_key, K_size) == 0) {
-			// This key already exists
-			if (out_val_ptr) *out_val_ptr = elem_val;
-			break;
-		}
-
-		idx = (idx + 1) & mask;
 	}
 
+	if (out_val_ptr) *out_val_ptr = elem + val_offset;
 	DS_ProfExit();
 	return added_new;
 }
 
 static inline bool DS_MapRemoveRaw(DS_MapRaw* map, const void* key, int K_size, int V_size, int elem_size, int key_offset, int val_offset) {
-	if (map->capacity == 0) return false;
+	if (map->count == 0) return false;
 	DS_ProfEnter();
 
-	uint32_t hash = DS_MurmurHash3((char*)key, K_size, 989898);
-	if (hash == 0) hash = 1;
-
-	uint32_t mask = (uint32_t)map->capacity - 1;
-	uint32_t index = hash & mask;
-
-	bool ok = true;
-
-	char temp[DS_MAX_ELEM_SIZE];
-	DS_ASSERT(DS_MAX_ELEM_SIZE >= elem_size);
-
-	for (;;) {
-		char* elem_base = (char*)map->data + index * elem_size;
-		uint32_t elem_hash = *(uint32_t*)elem_base;
+	if (map->old_data) DS_MapRehashStep(map, DS_MAP_REHASH_STEP, elem_size);
 
-		if (elem_hash == 0) {
-			// Empty slot, the key does not exist in the map
-			ok = false;
-			break;
-		}
+	uint32_t hash = DS_MapHashKey(key, K_size);
+	bool ok = false;
 
-		if (hash == elem_hash && memcmp(key, elem_base + key_offset, K_size) == 0) {
-			// Remove element
-			memset(elem_base, 0, elem_size);
+	int slot = DS_MapTableFind((char*)map->data, map->capacity, key, hash, K_size, elem_size, key_offset);
+	if (slot >= 0) {
+		DS_MapSetCtrl(DS_MapTableCtrl(map->data, map->capacity, elem_size), map->capacity, slot, DS_MAP_CTRL_DELETED);
+		map->deleted_count++;
+		map->count--;
+		ok = true;
+	}
+	else if (map->old_data) {
+		slot = DS_MapTableFind((char*)map->old_data, map->old_capacity, key, hash, K_size, elem_size, key_offset);
+		if (slot >= 0) {
+			DS_MapSetCtrl(DS_MapTableCtrl(map->old_data, map->old_capacity, elem_size), map->old_capacity, slot, DS_MAP_CTRL_DELETED);
 			map->count--;
-
-			// backwards-shift deletion.
-			// First remove all elements directly after this element from the map, then add them back to the map, starting from the first one to the right.
-			for (;;) {
-				index = (index + 1) & mask;
-
-				char* shifting_elem_base = (char*)map->data + index * elem_size;
-				uint32_t shifting_elem_hash = *(uint32_t*)shifting_elem_base;
-				if (shifting_elem_hash == 0) break;
-
-				memcpy(temp, shifting_elem_base, elem_size);
-				memset(shifting_elem_base, 0, elem_size);
-				map->count--;
-
-				void* new_val_ptr;
-				DS_MapGetOrAddRawEx(map, temp + key_offset, &new_val_ptr, K_size, V_size, elem_size, key_offset, val_offset, shifting_elem_hash);
-				memcpy(new_val_ptr, temp + val_offset, V_size);
-			}
-
-			break;
+			ok = true;
 		}
-
-		index = (index + 1) & mask;
 	}
 
 	DS_ProfExit();
@@ -1371,8 +1660,14 @@ static inline bool DS_MapRemoveRaw(DS_MapRaw* map, const void* key, int K_size,
 static inline void DS_MapInitCloneRaw(DS_MapRaw* map, DS_MapRaw* src, DS_Allocator* allocator, int elem_size) {
 	*map = *src;
 	map->allocator = allocator;
-	*(void**)&map->data = DS_AllocatorFn(allocator, NULL, 0, src->capacity * elem_size, DS_DEFAULT_ALIGNMENT);
-	memcpy(map->data, src->data, src->capacity * elem_size);
+	if (src->data) {
+		*(void**)&map->data = DS_AllocatorFn(allocator, NULL, 0, DS_MapTableSize(src->capacity, elem_size), DS_DEFAULT_ALIGNMENT);
+		memcpy(map->data, src->data, DS_MapTableSize(src->capacity, elem_size));
+	}
+	if (src->old_data) {
+		map->old_data = DS_AllocatorFn(allocator, NULL, 0, DS_MapTableSize(src->old_capacity, elem_size), DS_DEFAULT_ALIGNMENT);
+		memcpy(map->old_data, src->old_data, DS_MapTableSize(src->old_capacity, elem_size));
+	}
 }
 
 static inline bool DS_MapInsertRaw(DS_MapRaw* map, const void* key, DS_OUT void* val,
@@ -1386,6 +1681,183 @@ static inline bool DS_MapInsertRaw(DS_MapRaw* map, const void* key, DS_OUT void*
 	return added;
 }
 
+#ifndef DS_NO_VIRTUAL_MEMORY
+#ifdef _WIN32
+// -- from Windows.h -----------------------------------------
+#ifdef __cplusplus
+extern "C" {
+#endif
+__declspec(dllimport) void* __stdcall VirtualAlloc(void* lpAddress, size_t dwSize, unsigned long flAllocationType, unsigned long flProtect);
+__declspec(dllimport) int __stdcall VirtualFree(void* lpAddress, size_t dwSize, unsigned long dwFreeType);
+#ifdef __cplusplus
+} // extern "C"
+#endif
+// -----------------------------------------------------------
+
+static char* DS_VirtualReserve(uint64_t size) { return (char*)VirtualAlloc(NULL, (size_t)size, 0x00002000 /* MEM_RESERVE */, 0x01 /* PAGE_NOACCESS */); }
+static bool DS_VirtualCommit(char* ptr, uint64_t size) { return VirtualAlloc(ptr, (size_t)size, 0x00001000 /* MEM_COMMIT */, 0x04 /* PAGE_READWRITE */) != NULL; }
+static void DS_VirtualDecommit(char* ptr, uint64_t size) { VirtualFree(ptr, (size_t)size, 0x00004000 /* MEM_DECOMMIT */); }
+static void DS_VirtualRelease(char* ptr, uint64_t size) { VirtualFree(ptr, 0, 0x00008000 /* MEM_RELEASE */); }
+#else
+#include <sys/mman.h>
+
+static char* DS_VirtualReserve(uint64_t size) {
+	void* ptr = mmap(NULL, (size_t)size, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+	return ptr == MAP_FAILED ? NULL : (char*)ptr;
+}
+static bool DS_VirtualCommit(char* ptr, uint64_t size) { return mprotect(ptr, (size_t)size, PROT_READ|PROT_WRITE) == 0; }
+static void DS_VirtualDecommit(char* ptr, uint64_t size) { madvise(ptr, (size_t)size, MADV_DONTNEED); mprotect(ptr, (size_t)size, PROT_NONE); }
+static void DS_VirtualRelease(char* ptr, uint64_t size) { munmap(ptr, (size_t)size); }
+#endif
+
+DS_API void DS_ArenaInitVirtual(DS_Arena* arena, uint64_t reserve_size) {
+	memset(arena, 0, sizeof(*arena));
+	arena->base = DS_AllocatorBase_Init(DS_AllocatorType_Arena);
+
+	reserve_size = DS_AlignUpPow2(reserve_size, (uint64_t)DS_ARENA_VIRTUAL_COMMIT_SIZE);
+	arena->virtual_base = DS_VirtualReserve(reserve_size);
+	DS_ASSERT(arena->virtual_base != NULL); // Failed to reserve address space
+	arena->virtual_commit_end = arena->virtual_base;
+	arena->virtual_reserve_end = arena->virtual_base + reserve_size;
+
+	arena->mark.block = (DS_ArenaBlockHeader*)arena->virtual_base;
+	arena->mark.ptr = arena->virtual_base;
+}
+#endif
+
+// Makes sure that the memory of a virtual arena is committed up to `end`
+static void DS_ArenaVirtualCommit(DS_Arena* arena, char* end) {
+#ifndef DS_NO_VIRTUAL_MEMORY
+	if (end <= arena->virtual_commit_end) return;
+	DS_ASSERT(end <= arena->virtual_reserve_end); // The arena ran out of reserved address space. Reserve more in DS_ArenaInitVirtual.
+
+	char* new_commit_end = (char*)DS_AlignUpPow2((uintptr_t)end, (uintptr_t)DS_ARENA_VIRTUAL_COMMIT_SIZE);
+	if (new_commit_end > arena->virtual_reserve_end) new_commit_end = arena->virtual_reserve_end;
+
+	bool ok = DS_VirtualCommit(arena->virtual_commit_end, new_commit_end - arena->virtual_commit_end);
+	DS_ASSERT(ok); // Out of memory
+	arena->total_mem_reserved += new_commit_end - arena->virtual_commit_end;
+	arena->virtual_commit_end = new_commit_end;
+#endif
+}
+
+DS_API void DS_ArenaDecommit(DS_Arena* arena) {
+#ifndef DS_NO_VIRTUAL_MEMORY
+	if (arena->virtual_base == NULL) return;
+	DS_ProfEnter();
+	char* keep_end = (char*)DS_AlignUpPow2((uintptr_t)arena->mark.ptr, (uintptr_t)DS_ARENA_VIRTUAL_COMMIT_SIZE);
+	if (keep_end < arena->virtual_commit_end) {
+		DS_VirtualDecommit(keep_end, arena->virtual_commit_end - keep_end);
+		arena->total_mem_reserved -= arena->virtual_commit_end - keep_end;
+		arena->virtual_commit_end = keep_end;
+	}
+	DS_ProfExit();
+#endif
+}
+
+DS_API bool DS_ArenaResizeInPlace(DS_Arena* arena, void* ptr, int old_size, int new_size) {
+	if ((char*)ptr + old_size != arena->mark.ptr) return false; // not the most recent allocation
+
+	if (arena->virtual_base) {
+		DS_ArenaVirtualCommit(arena, (char*)ptr + new_size);
+		arena->mark.ptr = (char*)ptr + new_size;
+		return true;
+	}
+
+	// An allocation never spans multiple blocks, so if it ends at the mark, it's in the current block
+	DS_ArenaBlockHeader* block = arena->mark.block;
+	if (block && (char*)ptr + new_size <= (char*)block + block->size_including_header) {
+		arena->mark.ptr = (char*)ptr + new_size;
+		return true;
+	}
+	return false;
+}
+
+#ifndef DS_NO_VIRTUAL_MEMORY
+typedef struct DS_ScratchThread {
+	DS_Arena arenas[DS_SCRATCH_ARENA_COUNT];
+	bool initialized;
+	DS_ScratchThreadStats* stats; // NULL if the thread didn't get a slot in DS_SCRATCH_STATS
+} DS_ScratchThread;
+
+static DS_THREAD_LOCAL DS_ScratchThread DS_SCRATCH_THREAD;
+static DS_ScratchThreadStats DS_SCRATCH_STATS[DS_SCRATCH_MAX_THREADS];
+static volatile int32_t DS_SCRATCH_THREADS_COUNT;
+
+static int32_t DS_AtomicFetchAdd32(volatile int32_t* value, int32_t addend) {
+#ifdef _MSC_VER
+	return (int32_t)_InterlockedExchangeAdd((volatile long*)value, (long)addend);
+#else
+	return __atomic_fetch_add(value, addend, __ATOMIC_SEQ_CST);
+#endif
+}
+
+DS_API DS_Scope DS_ScratchBegin(DS_Arena* const* conflicts, int conflicts_count) {
+	DS_ScratchThread* thread = &DS_SCRATCH_THREAD;
+	if (!thread->initialized) {
+		for (int i = 0; i < DS_SCRATCH_ARENA_COUNT; i++) {
+			DS_ArenaInitVirtual(&thread->arenas[i], DS_SCRATCH_ARENA_RESERVE_SIZE);
+		}
+		int32_t slot = DS_AtomicFetchAdd32(&DS_SCRATCH_THREADS_COUNT, 1);
+		thread->stats = slot < DS_SCRATCH_MAX_THREADS ? &DS_SCRATCH_STATS[slot] : NULL;
+		thread->initialized = true;
+	}
+
+	// Find the first two scratch arenas that aren't in `conflicts`
+	DS_Arena* free_arenas[2] = {NULL, NULL};
+	int free_arenas_count = 0;
+	for (int i = 0; i < DS_SCRATCH_ARENA_COUNT && free_arenas_count < 2; i++) {
+		DS_Arena* arena = &thread->arenas[i];
+		bool conflicting = false;
+		for (int j = 0; j < conflicts_count; j++) {
+			if (conflicts[j] == arena) { conflicting = true; break; }
+		}
+		if (!conflicting) free_arenas[free_arenas_count++] = arena;
+	}
+	DS_ASSERT(free_arenas_count > 0); // All scratch arenas are in `conflicts`. Increase DS_SCRATCH_ARENA_COUNT.
+
+	DS_Scope scope = {free_arenas[0], free_arenas_count == 2 ? free_arenas[1] : free_arenas[0], free_arenas[0]->mark};
+	return scope;
+}
+
+DS_API void DS_ScratchEnd(DS_Scope* scratch) {
+	DS_ScratchThread* thread = &DS_SCRATCH_THREAD;
+	if (thread->stats) {
+		DS_ScratchThreadStats stats = {0};
+		for (int i = 0; i < DS_SCRATCH_ARENA_COUNT; i++) {
+			DS_Arena* arena = &thread->arenas[i];
+			stats.used += arena->mark.ptr - arena->virtual_base;
+			stats.committed += arena->virtual_commit_end - arena->virtual_base;
+		}
+		stats.peak_used = stats.used > thread->stats->peak_used ? stats.used : thread->stats->peak_used;
+		*thread->stats = stats;
+	}
+	DS_ArenaSetMark(scratch->arena, scratch->base);
+}
+
+DS_API void DS_ScratchThreadDeinit(void) {
+	DS_ScratchThread* thread = &DS_SCRATCH_THREAD;
+	if (thread->initialized) {
+		for (int i = 0; i < DS_SCRATCH_ARENA_COUNT; i++) DS_ArenaDeinit(&thread->arenas[i]);
+		if (thread->stats) {
+			thread->stats->used = 0;
+			thread->stats->committed = 0;
+		}
+		memset(thread, 0, sizeof(*thread));
+	}
+}
+
+DS_API int DS_ScratchThreadsCount(void) {
+	int count = DS_SCRATCH_THREADS_COUNT;
+	return count < DS_SCRATCH_MAX_THREADS ? count : DS_SCRATCH_MAX_THREADS;
+}
+
+DS_API DS_ScratchThreadStats DS_ScratchGetThreadStats(int thread_index) {
+	DS_ASSERT(thread_index >= 0 && thread_index < DS_ScratchThreadsCount());
+	return DS_SCRATCH_STATS[thread_index];
+}
+#endif
+
 DS_API void DS_ArenaInit(DS_Arena* arena, int block_size, DS_Allocator* allocator) {
 	memset(arena, 0, sizeof(*arena));
 	arena->base = DS_AllocatorBase_Init(DS_AllocatorType_Arena);
@@ -1394,6 +1866,11 @@ DS_API void DS_ArenaInit(DS_Arena* arena, int block_size, DS_Allocator* allocato
 }
 
 DS_API void DS_ArenaDeinit(DS_Arena* arena) {
+#ifndef DS_NO_VIRTUAL_MEMORY
+	if (arena->virtual_base) {
+		DS_VirtualRelease(arena->virtual_base, arena->virtual_reserve_end - arena->virtual_base);
+	}
+#endif
 	for (DS_ArenaBlockHeader* block = arena->first_block; block;) {
 		DS_ArenaBlockHeader* next = block->next;
 		DS_MemFree(arena->allocator, block);
@@ -1417,6 +1894,16 @@ DS_API char* DS_ArenaPushEx(DS_Arena* arena, int size, int alignment) {
 
 	bool alignment_is_power_of_2 = ((alignment) & ((alignment)-1)) == 0;
 	DS_ASSERT(alignment != 0 && alignment_is_power_of_2);
+
+	if (arena->virtual_base) {
+		// The region is contiguous and page-aligned, so any alignment up to the page size works
+		char* result = (char*)DS_AlignUpPow2((uintptr_t)arena->mark.ptr, (uintptr_t)alignment);
+		DS_ArenaVirtualCommit(arena, result + size);
+		arena->mark.ptr = result + size;
+		DS_ProfExit();
+		return result;
+	}
+
 	DS_ASSERT(alignment <= DS_ARENA_BLOCK_ALIGNMENT);
 
 	DS_ArenaBlockHeader* curr_block = arena->mark.block; // may be NULL
@@ -1426,6 +1913,8 @@ DS_API char* DS_ArenaPushEx(DS_Arena* arena, int size, int alignment) {
 	int remaining_space = curr_block ? curr_block->size_including_header - (int)((uintptr_t)result_address - (uintptr_t)curr_block) : 0;
 
 	if (size > remaining_space) { // We need a new block!
+		if (remaining_space > 0) arena->wasted_bytes += remaining_space;
+
 		int result_offset = DS_AlignUpPow2(sizeof(DS_ArenaBlockHeader), alignment);
 		int new_block_size = result_offset + size;
 		if (arena->block_size > new_block_size) new_block_size = arena->block_size;
@@ -1465,6 +1954,13 @@ DS_API char* DS_ArenaPushEx(DS_Arena* arena, int size, int alignment) {
 
 DS_API void DS_ArenaReset(DS_Arena* arena) {
 	DS_ProfEnter();
+	arena->wasted_bytes = 0;
+	if (arena->virtual_base) {
+		arena->mark.ptr = arena->virtual_base;
+		DS_ProfExit();
+		return;
+	}
+
 	if (arena->first_block) {
 		// Free all blocks after the first block
 		for (DS_ArenaBlockHeader* block = arena->first_block->next; block;) {
@@ -1491,6 +1987,17 @@ DS_API DS_ArenaMark DS_ArenaGetMark(DS_Arena* arena) {
 	return arena->mark;
 }
 
+DS_API int64_t DS_ArenaGetUsed(DS_Arena* arena) {
+	if (arena->virtual_base) return arena->mark.ptr - arena->virtual_base;
+
+	int64_t used = 0;
+	for (DS_ArenaBlockHeader* block = arena->first_block; block && block != arena->mark.block; block = block->next) {
+		used += block->size_including_header;
+	}
+	if (arena->mark.block) used += arena->mark.ptr - (char*)arena->mark.block;
+	return used;
+}
+
 DS_API void DS_ArenaSetMark(DS_Arena* arena, DS_ArenaMark mark) {
 	DS_ProfEnter();
 	if (mark.block == NULL) {
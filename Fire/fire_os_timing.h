@@ -1,6 +1,6 @@
 // fire_os_timing.h - by Eero Mutka (https://eeromutka.github.io/)
 // 
-// High-performance time measurements. Only Windows is supported for time being.
+// High-performance time measurements. Supports Windows and POSIX platforms.
 // 
 // This code is released under the MIT license (https://opensource.org/licenses/MIT).
 //
@@ -26,6 +26,8 @@ OS_TIMING_API double OS_TIMING_GetDuration(uint64_t start, uint64_t end);
 
 #ifdef /**********/ FIRE_OS_TIMING_IMPLEMENTATION /**********/
 
+#ifdef _WIN32
+
 // -- from Windows.h -----------------------------------------
 #ifdef __cplusplus
 extern "C" {
@@ -56,5 +58,23 @@ OS_TIMING_API double OS_TIMING_GetDuration(uint64_t start, uint64_t end) {
 	return (double)elapsed / (double)OS_TIMING_ticks_per_second;
 }
 
+#else // _WIN32
+
+#include <time.h>
+
+OS_TIMING_API void OS_TIMING_Init() {}
+
+OS_TIMING_API uint64_t OS_TIMING_GetTick() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000ull + (uint64_t)t.tv_nsec; // ticks are nanoseconds
+}
+
+OS_TIMING_API double OS_TIMING_GetDuration(uint64_t start, uint64_t end) {
+	return (double)(end - start) / 1000000000.0;
+}
+
+#endif // _WIN32
+
 #endif // FIRE_OS_TIMING_IMPLEMENTATION
 #endif // FIRE_OS_TIMING_INCLUDED
\ No newline at end of file
@@ -17,10 +17,16 @@
 #include <stdarg.h>
 #include <math.h> // isnan, isinf
 
-#ifdef STR_USE_FIRE_DS
-// Requires that fire_ds.h has been included
+#if defined(STR_USE_FIRE_DS) || defined(STR_USE_FIRE_DS_ARENA)
+// Requires that fire_ds.h has been included. The allocator can be any DS_Allocator*, e.g. DS_HEAP or a DS_Arena*.
 #define STR_MemAlloc(ALLOCATOR, SIZE) (void*)DS_MemAlloc((DS_Allocator*)ALLOCATOR, SIZE)
 #define STR_MemFree(ALLOCATOR, PTR) DS_MemFree((DS_Allocator*)ALLOCATOR, (void*)(PTR))
+// DS_AllocatorFn grows the most recent arena allocation in place when it can, and otherwise counts the old buffer as wasted
+#define STR_MemRealloc(ALLOCATOR, PTR, OLD_SIZE, NEW_SIZE) (void*)DS_AllocatorFn((DS_Allocator*)ALLOCATOR, PTR, OLD_SIZE, NEW_SIZE, DS_DEFAULT_ALIGNMENT)
+#ifndef DS_USE_CUSTOM_ALLOCATOR
+#define STR_MemResizeInPlace(ALLOCATOR, PTR, OLD_SIZE, NEW_SIZE) \
+	(((DS_Allocator*)ALLOCATOR)->base.type == DS_AllocatorType_Arena && DS_ArenaResizeInPlace((DS_Arena*)ALLOCATOR, (void*)(PTR), OLD_SIZE, NEW_SIZE))
+#endif
 #elif defined(STR_USE_CUSTOM_MALLOC)
 // (Provide your own implementation)
 #else
@@ -29,6 +35,13 @@
 #define STR_MemFree(ALLOCATOR, PTR) free((void*)(PTR))
 #endif
 
+// Optional allocator hooks:
+// - STR_MemRealloc(ALLOCATOR, PTR, OLD_SIZE, NEW_SIZE) grows a buffer. Without it, a new buffer is allocated and the old one is copied and freed.
+// - STR_MemResizeInPlace(ALLOCATOR, PTR, OLD_SIZE, NEW_SIZE) returns true if the allocation could be resized without moving it.
+#ifndef STR_MemResizeInPlace
+#define STR_MemResizeInPlace(ALLOCATOR, PTR, OLD_SIZE, NEW_SIZE) false
+#endif
+
 typedef struct STR_View {
 	const char* data;
 	int size;
@@ -114,6 +127,7 @@ STR_API STR_View STR_Form(void* allocator, const char* fmt, ...); // Allocates a
 
 STR_API void STR_BuilderInit(STR_Builder* s, void* allocator); // Alternatively, init by {}-initializer and passing in the allocator field
 STR_API void STR_BuilderDeinit(STR_Builder* s);
+STR_API void STR_BuilderReserve(STR_Builder* s, int size); // Makes room for at least `size` more bytes
 
 STR_API void STR_PrintC(STR_Builder* s, const char* string);
 STR_API void STR_PrintV(STR_Builder* s, STR_View string);
@@ -1096,10 +1110,8 @@ STR_API void STR_PrintVA(STR_Builder* s, const char* fmt, va_list args) {
 				STR_PrintC(s, "%");
 			} break;
 			case 'f': {
-				char buffer[64];
-				int size = STR_FloatToStr_(buffer, va_arg(args, double), 0);
-				STR_View value_str = { buffer, size };
-				STR_PrintV(s, value_str);
+				STR_BuilderReserve(s, 64);
+				s->str.size += STR_FloatToStr_((char*)s->str.data + s->str.size, va_arg(args, double), 0);
 			} break;
 			case 'x': { radix = 16;       goto print_int; }
 			case 'd': { is_signed = true; goto print_int; }
@@ -1122,33 +1134,53 @@ STR_API void STR_PrintVA(STR_Builder* s, const char* fmt, va_list args) {
 					else { value = (uint64_t)va_arg(args, unsigned int); }
 				}
 
-				char buffer[100];
-				int size = STR_IntToStr_(buffer, value, is_signed, radix);
-				STR_View value_str = { buffer, size };
-				STR_PrintV(s, value_str);
+				STR_BuilderReserve(s, 65); // 64 binary digits and a minus sign at most
+				s->str.size += STR_IntToStr_((char*)s->str.data + s->str.size, value, is_signed, radix);
 			} break;
 			}
 			continue;
 		}
 
-		STR_View character_str = { c, 1 };
-		STR_PrintV(s, character_str);
+		// Print the literal characters up to the next specifier in one go
+		const char* run_end = c + 1;
+		for (; *run_end && *run_end != '%'; ) run_end++;
+		STR_View run_str = { c, (int)(run_end - c) };
+		STR_PrintV(s, run_str);
+		c = run_end - 1;
+	}
+}
+
+// Reserves a guess of the final size up front, so that short strings are formatted without regrowing the buffer.
+// Any slack is given back afterwards if the allocator supports resizing in place.
+static void STR_FormBegin_(STR_Builder* builder, void* allocator, const char* fmt) {
+	STR_Builder result = { allocator };
+	*builder = result;
+	STR_BuilderReserve(builder, (int)strlen(fmt) + 32);
+}
+
+static void STR_FormEnd_(STR_Builder* builder) {
+	if (STR_MemResizeInPlace(builder->allocator, builder->str.data, builder->capacity, builder->str.size)) {
+		builder->capacity = builder->str.size;
 	}
 }
 
 STR_API char* STR_FormC(void* allocator, const char* fmt, ...) {
 	va_list args; va_start(args, fmt);
-	STR_Builder builder = { allocator };
+	STR_Builder builder;
+	STR_FormBegin_(&builder, allocator, fmt);
 	STR_PrintVA(&builder, fmt, args);
 	STR_PrintU(&builder, '\0');
+	STR_FormEnd_(&builder);
 	va_end(args);
 	return (char*)builder.str.data;
 }
 
 STR_API STR_View STR_Form(void* allocator, const char* fmt, ...) {
 	va_list args; va_start(args, fmt);
-	STR_Builder builder = { allocator };
+	STR_Builder builder;
+	STR_FormBegin_(&builder, allocator, fmt);
 	STR_PrintVA(&builder, fmt, args);
+	STR_FormEnd_(&builder);
 	va_end(args);
 	return builder.str;
 }
@@ -1162,27 +1194,35 @@ STR_API void STR_BuilderDeinit(STR_Builder* s) {
 	STR_Free(s->allocator, s->str);
 }
 
+STR_API void STR_BuilderReserve(STR_Builder* s, int size) {
+	int new_size = s->str.size + size;
+	if (new_size <= s->capacity) return;
+
+	int capacity = s->capacity == 0 ? 8 : s->capacity;
+	while (new_size > capacity) {
+		capacity *= 2;
+	}
+
+#ifdef STR_MemRealloc
+	s->str.data = (const char*)STR_MemRealloc(s->allocator, s->str.data, s->capacity, capacity);
+#else
+	char* new_memory = (char*)STR_MemAlloc(s->allocator, capacity);
+	if (s->str.size > 0) memcpy(new_memory, s->str.data, s->str.size);
+	STR_MemFree(s->allocator, s->str.data);
+	s->str.data = new_memory;
+#endif
+	s->capacity = capacity;
+}
+
 STR_API void STR_PrintC(STR_Builder* s, const char* string) {
 	STR_View str = { string, (int)strlen(string) };
 	STR_PrintV(s, str);
 }
 
 STR_API void STR_PrintV(STR_Builder* s, STR_View string) {
-	int capacity = s->capacity;
 	int new_size = s->str.size + string.size;
-
-	while (new_size > capacity) {
-		capacity = capacity == 0 ? 8 : capacity * 2;
-	}
-
-	// Resize string if necessary
-	if (capacity != s->capacity) {
-		char* new_memory = (char*)STR_MemAlloc(s->allocator, capacity);
-		memcpy(new_memory, s->str.data, s->str.size);
-		STR_MemFree(s->allocator, s->str.data);
-		
-		s->str.data = new_memory;
-		s->capacity = capacity;
+	if (new_size > s->capacity) {
+		STR_BuilderReserve(s, string.size);
 	}
 
 	memcpy((char*)s->str.data + s->str.size, string.data, string.size);
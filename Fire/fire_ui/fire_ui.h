@@ -115,6 +115,7 @@ typedef struct UI_CachedGlyphKey {
 } UI_CachedGlyphKey;
 
 typedef struct UI_CachedGlyph {
+	int atlas_page;        // index into UI_STATE.atlas_pages
 	UI_Vec2 origin_uv;     // in UV coordinates
 	UI_Vec2 size_pixels;   // in pixel coordinates
 	UI_Vec2 offset_pixels; // in pixel coordinates
@@ -128,7 +129,7 @@ typedef struct UI_Font {
 	float y_offset;
 
 	DS_Map(UI_CachedGlyphKey, UI_CachedGlyph) glyph_map;
-	DS_Map(UI_CachedGlyphKey, UI_CachedGlyph) glyph_map_old;
+	DS_Map(UI_CachedGlyphKey, UI_CachedGlyph) glyph_map_old; // scratch map for rebuilding `glyph_map` when an atlas page is evicted
 
 	stbtt_fontinfo font_info;
 } UI_Font;
@@ -197,6 +198,12 @@ struct UI_Box {
 	UI_Vec2 computed_unexpanded_size;
 	UI_Vec2 computed_expanded_size;
 	UI_Rect computed_rect; // final rectangle including clipping
+
+	// Layout caching. If a box has the same layout hash as its previous frame counterpart, the computed sizes of its
+	// whole subtree are copied from the previous frame instead of being recomputed. See UI_BoxComputeLayoutHash.
+	uint64_t layout_hash; // 0 if the subtree can't be retained, i.e. it has a custom `compute_unexpanded_size`
+	UI_Rect layout_scissor; // the scissor rect passed to UI_BoxComputeRectsStep; UI_INFINITE for no scissor
+	bool layout_retained; // true if all computed values of the subtree were copied from the previous frame and are still untouched
 	
 	// Drawing
 	void (*draw)(UI_Box* box); // UI_DrawBoxDefault by default
@@ -222,6 +229,25 @@ typedef struct UI_DrawVertex {
 } UI_DrawVertex;
 #define UI_DRAW_VERTEX  UI_LangAgnosticLiteral(UI_DrawVertex)
 
+typedef struct UI_TextRunKey {
+	// !!! memcmp is used on this struct, so it must be manually padded for 0-initialized padding.
+	uint64_t text_hash;
+	UI_FontIndex font;
+	int32_t size;
+} UI_TextRunKey;
+
+// A string that has been laid out into glyph quads once, so that measuring and drawing it again doesn't need to look up each glyph.
+// Runs are cached across frames; a run that isn't used during a frame is dropped.
+typedef struct UI_TextRun {
+	float width;
+	int glyphs_count;             // glyphs without a visible quad (i.e. spaces) are left out
+	UI_DrawVertex* vertices;      // 4 per glyph, positioned relative to the text origin. The color is left for the caller.
+	uint8_t* glyph_atlas_pages;   // atlas page of each glyph
+	UI_Rect bounds;               // bounding rect of the quads, relative to the text origin
+	uint32_t atlas_pages_mask;    // bit N is set if any glyph is on atlas page N
+	uint32_t atlas_evictions_count; // value of UI_STATE.atlas_evictions_count when the run was built
+} UI_TextRun;
+
 typedef uint16_t UI_ScissorID;
 
 typedef enum UI_AlignV { UI_AlignV_Upper, UI_AlignV_Middle, UI_AlignV_Lower } UI_AlignV;
@@ -234,6 +260,10 @@ typedef enum UI_AlignH { UI_AlignH_Left, UI_AlignH_Middle, UI_AlignH_Right } UI_
 #define UI_MAX_BACKEND_BUFFERS 16
 #endif
 
+#ifndef UI_MAX_ATLAS_PAGES
+#define UI_MAX_ATLAS_PAGES 4
+#endif
+
 typedef uint64_t UI_TextureID; // UI_TEXTURE_ID_NIL is a reserved value
 // typedef uint64_t UI_BufferID;  // UI_BUFFER_ID_NIL is a reserved value
 
@@ -243,6 +273,7 @@ typedef struct UI_DrawCall {
 	UI_TextureID texture;
 	uint32_t first_index;
 	uint32_t index_count;
+	uint32_t base_vertex; // added to each index before reading from the vertex buffer
 } UI_DrawCall;
 
 typedef struct UI_DrawRectCorners {
@@ -294,13 +325,19 @@ typedef struct UI_Backend {
 	void (*create_index_buffer)(int buffer_id, uint32_t size_in_bytes);
 	void (*destroy_buffer)(int buffer_id);
 
-	// `atlas_id` is a value between 0 and 1
+	// `atlas_id` is a value between 0 and UI_MAX_ATLAS_PAGES - 1. Atlases use the RGBA8 format.
 	UI_TextureID(*create_atlas)(int atlas_id, uint32_t width, uint32_t height);
 	void (*destroy_atlas)(int atlas_id);
 
-	// From these functions, the returned pointer must stay valid until UI_EndFrame or destroy_buffer/destroy_atlas is called.
-	void* (*buffer_map_until_draw)(int buffer_id);
-	void* (*atlas_map_until_draw)(int atlas_id);
+	// Called from UI_EndFrame for the regions of the atlases that were modified during the frame.
+	// `pixels` is a tightly packed RGBA8 image of `width * height` pixels, and is only valid for the duration of the call.
+	void (*atlas_upload)(int atlas_id, uint32_t x, uint32_t y, uint32_t width, uint32_t height, const void* pixels);
+
+	// Called from UI_EndFrame to stream the vertices and indices of the frame into the buffers, which are used as ring buffers.
+	// Unless `discard` is set, the written range hasn't been drawn from since the last upload with `discard` set, so the
+	// upload doesn't need to wait for the GPU (i.e. D3D11_MAP_WRITE_NO_OVERWRITE). When `discard` is set, the rest of the
+	// buffer contents may be thrown away (i.e. D3D11_MAP_WRITE_DISCARD). `data` is only valid for the duration of the call.
+	void (*buffer_upload)(int buffer_id, uint32_t offset, const void* data, uint32_t size, bool discard);
 } UI_Backend;
 
 typedef struct UI_Inputs {
@@ -335,9 +372,26 @@ typedef struct UI_Outputs {
 
 	UI_DrawCall* draw_calls;
 	int draw_calls_count;
+
+	// Statistics of the frame
+	int draw_calls_count_before_merge; // batches with the same texture are merged together when they can be reordered
+	uint32_t vertex_bytes_uploaded;
+	uint32_t index_bytes_uploaded;
+	uint32_t atlas_bytes_uploaded;
 } UI_Outputs;
 
 typedef DS_Map(UI_Key, UI_Box*) UI_BoxFromKeyMap;
+typedef DS_Map(UI_TextRunKey, UI_TextRun*) UI_TextRunMap;
+
+// Glyphs are packed into atlas pages of UI_GLYPH_MAP_SIZE^2 pixels. Pages are created as needed, and once UI_MAX_ATLAS_PAGES
+// pages are full, the page that was least recently drawn from is cleared and reused.
+typedef struct UI_AtlasPage {
+	UI_TextureID texture;
+	stbtt_pack_context pack_context;
+	uint8_t* buffer_grayscale; // stb rect pack works with grayscale, so we convert to RGBA8 only when uploading.
+	int dirty_min_x, dirty_min_y, dirty_max_x, dirty_max_y; // region to upload at the end of the frame; empty if max <= min
+	uint64_t last_used_frame;
+} UI_AtlasPage;
 
 typedef struct UI_State {
 	DS_Allocator* allocator;
@@ -362,10 +416,15 @@ typedef struct UI_State {
 	DS_DynArray(UI_Font) fonts;
 
 	// atlas
-	stbtt_pack_context pack_context;
-	//bool atlas_needs_reupload;
-	UI_TextureID atlases[2]; // 0 is the current atlas, 1 is NULL or the old atlas
-	uint8_t* atlas_buffer_grayscale; // stb rect pack works with grayscale, but we want to convert to RGBA8 on the fly.
+	UI_AtlasPage atlas_pages[UI_MAX_ATLAS_PAGES];
+	int atlas_pages_count;
+	int atlas_current_page; // new glyphs are packed into this page until it runs out of space
+	uint32_t atlas_evictions_count;
+	uint64_t frame_index;
+
+	// Text runs used during this / the previous frame. Allocated from the frame arena of the same frame.
+	UI_TextRunMap text_runs;
+	UI_TextRunMap prev_frame_text_runs;
 
 	// Mouse position in screen space coordinates, snapped to the pixel center. Placing it at the pixel center means we don't
 	// need to worry about dUI_enerate cases where the mouse is exactly at the edge of one or many rectangles when testing for overlap.
@@ -390,12 +449,14 @@ typedef struct UI_State {
 	DS_DynArray(UI_Box*) box_stack;
 
 	// -- Draw state --
-	uint32_t* draw_indices; // NULL by default
-	UI_DrawVertex* draw_vertices; // NULL by default
+	uint32_t* draw_indices; // CPU-side, streamed to the backend in UI_EndFrame
+	UI_DrawVertex* draw_vertices; // CPU-side, streamed to the backend in UI_EndFrame
 	uint32_t draw_next_vertex;
 	uint32_t draw_next_index;
 	UI_TextureID draw_active_texture;
 	DS_DynArray(UI_DrawCall) draw_calls;
+	uint32_t vertex_ring_cursor; // position to stream the next frame's vertices to in the backend vertex buffer
+	uint32_t index_ring_cursor;
 } UI_State;
 
 // The color palette here is the same as in Raylib
@@ -512,6 +573,10 @@ UI_API UI_DrawBoxDefaultArgs* UI_DrawBoxDefaultArgsInit();
 UI_API void UI_BoxComputeExpandedSizes(UI_Box* box);
 UI_API void UI_BoxComputeRects(UI_Box* box, UI_Vec2 box_position);
 
+// Computes `layout_hash` for the box and its subtree. Called by UI_BoxComputeRects, so you only need to call this
+// yourself if you use UI_BoxComputeExpandedSizes or UI_BoxComputeRectsStep directly.
+UI_API uint64_t UI_BoxComputeLayoutHash(UI_Box* box);
+
 UI_API void UI_BoxComputeUnexpandedSizeDefault(UI_Box* box, UI_Axis axis, int pass, bool* request_second_pass);
 UI_API void UI_BoxComputeExpandedSize(UI_Box* box, UI_Axis axis, float size);
 UI_API void UI_BoxComputeRectsStep(UI_Box* box, UI_Axis axis, float position, UI_ScissorRect scissor);
@@ -670,11 +735,30 @@ UI_API void UI_DrawPolylineEx(const UI_Vec2* points, const UI_Color* colors, int
 UI_API UI_State UI_STATE;
 // -------------------------
 
+#ifdef _MSC_VER
 #define UI_TODO() __debugbreak()
+#else
+#define UI_TODO() __builtin_trap()
+#endif
 
 #define UI_MAX_VERTEX_COUNT 65536*2
 #define UI_MAX_INDEX_COUNT  UI_MAX_VERTEX_COUNT*2
 
+// The backend buffers have room for a few frames, so that most frames can be streamed in without discarding the buffer.
+#define UI_VERTEX_RING_COUNT (UI_MAX_VERTEX_COUNT*4)
+#define UI_INDEX_RING_COUNT  (UI_MAX_INDEX_COUNT*4)
+
+// How many batches back UI_MergeDrawCalls looks for a batch with the same texture. 0 disables merging.
+#ifndef UI_DRAW_CALL_MERGE_LOOKBACK
+#define UI_DRAW_CALL_MERGE_LOOKBACK 16
+#endif
+
+// Address space reserved for each of the two frame arenas. They're virtual arenas, so that a frame's allocations are
+// contiguous and growing them never allocates. Define as 0 to allocate the frame arenas from the UI allocator instead.
+#ifndef UI_FRAME_ARENA_RESERVE_SIZE
+#define UI_FRAME_ARENA_RESERVE_SIZE DS_GIB(1)
+#endif
+
 #define UI_GLYPH_PADDING 1
 #define UI_GLYPH_MAP_SIZE 1024
 
@@ -2105,13 +2189,10 @@ UI_API void UI_BeginFrame(const UI_Inputs* inputs, UI_Vec2 window_size, UI_FontV
 
 	UI_STATE.draw_next_vertex = 0;
 	UI_STATE.draw_next_index = 0;
-	UI_STATE.draw_vertices = (UI_DrawVertex*)UI_STATE.backend.buffer_map_until_draw(0);
-	UI_STATE.draw_indices = (uint32_t*)UI_STATE.backend.buffer_map_until_draw(1);
-	UI_STATE.draw_active_texture = UI_STATE.atlases[0];
+	UI_STATE.draw_active_texture = UI_STATE.atlas_pages[0].texture;
 	UI_ASSERT(UI_STATE.draw_active_texture != UI_TEXTURE_ID_NIL);
-	UI_ASSERT(UI_STATE.draw_vertices != NULL);
-	UI_ASSERT(UI_STATE.draw_indices != NULL);
 
+	UI_STATE.frame_index++;
 	UI_STATE.inputs = *inputs;
 	memset(&UI_STATE.outputs, 0, sizeof(UI_STATE.outputs));
 	UI_STATE.window_size = window_size;
@@ -2128,6 +2209,9 @@ UI_API void UI_BeginFrame(const UI_Inputs* inputs, UI_Vec2 window_size, UI_FontV
 
 	UI_STATE.prev_frame_box_from_key = UI_STATE.box_from_key;
 	DS_MapInit(&UI_STATE.box_from_key, &UI_STATE.frame_arena);
+
+	UI_STATE.prev_frame_text_runs = UI_STATE.text_runs;
+	DS_MapInit(&UI_STATE.text_runs, &UI_STATE.frame_arena);
 	
 	UI_STATE.mouse_clicking_down_box = UI_STATE.mouse_clicking_down_box_new;
 	UI_STATE.mouse_clicking_down_box_new = UI_INVALID_KEY;
@@ -2165,10 +2249,134 @@ UI_API void UI_Deinit(void) {
 
 	UI_STATE.backend.destroy_buffer(0);
 	UI_STATE.backend.destroy_buffer(1);
-	UI_STATE.backend.destroy_atlas(0);
+	DS_MemFree(UI_STATE.allocator, UI_STATE.draw_vertices);
+	DS_MemFree(UI_STATE.allocator, UI_STATE.draw_indices);
+
+	for (int i = 0; i < UI_STATE.atlas_pages_count; i++) {
+		UI_AtlasPage* page = &UI_STATE.atlas_pages[i];
+		UI_STATE.backend.destroy_atlas(i);
+		stbtt_PackEnd(&page->pack_context);
+		DS_MemFree(UI_STATE.allocator, page->buffer_grayscale);
+	}
+
+	UI_ProfExit();
+}
+
+static void UI_AtlasPageMarkDirty(UI_AtlasPage* page, int x0, int y0, int x1, int y1) {
+	if (page->dirty_max_x <= page->dirty_min_x) {
+		page->dirty_min_x = x0; page->dirty_min_y = y0;
+		page->dirty_max_x = x1; page->dirty_max_y = y1;
+	}
+	else {
+		page->dirty_min_x = UI_Min(page->dirty_min_x, x0); page->dirty_min_y = UI_Min(page->dirty_min_y, y0);
+		page->dirty_max_x = UI_Max(page->dirty_max_x, x1); page->dirty_max_y = UI_Max(page->dirty_max_y, y1);
+	}
+}
+
+// Creates the page if it doesn't exist yet, otherwise clears it for reuse.
+static void UI_AtlasPageInit(int page_index) {
+	UI_AtlasPage* page = &UI_STATE.atlas_pages[page_index];
+	if (page->texture == UI_TEXTURE_ID_NIL) {
+		page->texture = UI_STATE.backend.create_atlas(page_index, UI_GLYPH_MAP_SIZE, UI_GLYPH_MAP_SIZE);
+		UI_ASSERT(page->texture != UI_TEXTURE_ID_NIL);
+		page->buffer_grayscale = (uint8_t*)DS_MemAlloc(UI_STATE.allocator, sizeof(uint8_t) * UI_GLYPH_MAP_SIZE * UI_GLYPH_MAP_SIZE);
+	}
+	else {
+		stbtt_PackEnd(&page->pack_context);
+	}
+
+	// This also clears the grayscale buffer. The texture isn't cleared, but every rect that is packed gets uploaded in full.
+	stbtt_PackBegin(&page->pack_context, page->buffer_grayscale, UI_GLYPH_MAP_SIZE, UI_GLYPH_MAP_SIZE, 0, UI_GLYPH_PADDING, NULL);
+
+	// Every page has a white pixel in the corner, so that untextured shapes can be drawn with any page bound. See UI_WHITE_PIXEL_UV
+	stbrp_rect rect = {0};
+	rect.w = 1;
+	rect.h = 1;
+	stbtt_PackFontRangesPackRects(&page->pack_context, &rect, 1);
+	UI_ASSERT(rect.was_packed);
+	UI_ASSERT(rect.x == 0 && rect.y == 0);
+	page->buffer_grayscale[0] = 255;
+	UI_AtlasPageMarkDirty(page, 0, 0, 1, 1);
+
+	page->last_used_frame = UI_STATE.frame_index;
+}
+
+static void UI_AtlasPageEvict(int page_index) {
+	UI_ProfEnter();
+
+	// Rebuild the glyph maps without the glyphs of this page
+	for (int i = 0; i < UI_STATE.fonts.count; i++) {
+		UI_Font* font = &UI_STATE.fonts.data[i];
+		if (font->data == NULL) continue;
 
-	DS_MemFree(UI_STATE.allocator, UI_STATE.atlas_buffer_grayscale);
+		DS_MapClear(&font->glyph_map_old);
+		DS_ForMapEach(UI_CachedGlyphKey, UI_CachedGlyph, &font->glyph_map, it) {
+			DS_MapInsert(&font->glyph_map_old, *it.key, *it.value);
+		}
+		DS_MapClear(&font->glyph_map);
+
+		DS_ForMapEach(UI_CachedGlyphKey, UI_CachedGlyph, &font->glyph_map_old, it) {
+			if (it.value->atlas_page != page_index) {
+				DS_MapInsert(&font->glyph_map, *it.key, *it.value);
+			}
+		}
+		DS_MapClear(&font->glyph_map_old);
+	}
+
+	UI_AtlasPageInit(page_index);
+	UI_STATE.atlas_evictions_count++; // invalidates the text runs
+	UI_ProfExit();
+}
+
+// Packs `rect` into the current page, or failing that, into a new or evicted page. Returns the page index.
+static int UI_AtlasPack(stbrp_rect* rect) {
+	UI_AtlasPage* page = &UI_STATE.atlas_pages[UI_STATE.atlas_current_page];
+	stbtt_PackFontRangesPackRects(&page->pack_context, rect, 1);
+	if (rect->was_packed) return UI_STATE.atlas_current_page;
 
+	int page_index;
+	if (UI_STATE.atlas_pages_count < UI_MAX_ATLAS_PAGES) {
+		page_index = UI_STATE.atlas_pages_count++;
+		UI_AtlasPageInit(page_index);
+	}
+	else {
+		// Evict the least recently used page. If every page has been drawn from during this frame, then some glyphs drawn
+		// earlier in the frame will look wrong for one frame. That's better than running out of space.
+		page_index = 0;
+		for (int i = 1; i < UI_STATE.atlas_pages_count; i++) {
+			if (UI_STATE.atlas_pages[i].last_used_frame < UI_STATE.atlas_pages[page_index].last_used_frame) page_index = i;
+		}
+		UI_AtlasPageEvict(page_index);
+	}
+
+	UI_STATE.atlas_current_page = page_index;
+	page = &UI_STATE.atlas_pages[page_index];
+	stbtt_PackFontRangesPackRects(&page->pack_context, rect, 1);
+	UI_ASSERT(rect->was_packed); // a single glyph is larger than UI_GLYPH_MAP_SIZE
+	return page_index;
+}
+
+static void UI_AtlasUploadDirtyRegions(void) {
+	UI_ProfEnter();
+	for (int i = 0; i < UI_STATE.atlas_pages_count; i++) {
+		UI_AtlasPage* page = &UI_STATE.atlas_pages[i];
+		if (page->dirty_max_x <= page->dirty_min_x) continue;
+
+		int w = page->dirty_max_x - page->dirty_min_x;
+		int h = page->dirty_max_y - page->dirty_min_y;
+		uint32_t* pixels = (uint32_t*)DS_ArenaPush(&UI_STATE.frame_arena, w * h * sizeof(uint32_t));
+		for (int y = 0; y < h; y++) {
+			const uint8_t* src_row = page->buffer_grayscale + (page->dirty_min_y + y) * UI_GLYPH_MAP_SIZE + page->dirty_min_x;
+			uint32_t* dst_row = pixels + y * w;
+			for (int x = 0; x < w; x++) {
+				dst_row[x] = ((uint32_t)src_row[x] << 24) | 0x00FFFFFF;
+			}
+		}
+
+		UI_STATE.backend.atlas_upload(i, page->dirty_min_x, page->dirty_min_y, w, h, pixels);
+		UI_STATE.outputs.atlas_bytes_uploaded += w * h * sizeof(uint32_t);
+		page->dirty_min_x = page->dirty_min_y = page->dirty_max_x = page->dirty_max_y = 0;
+	}
 	UI_ProfExit();
 }
 
@@ -2179,46 +2387,116 @@ UI_API void UI_Init(DS_Allocator* allocator, const UI_Backend* backend) {
 	UI_STATE.allocator = allocator;
 	UI_STATE.backend = *backend;
 	DS_ArenaInit(&UI_STATE.persistent_arena, DS_KIB(1), allocator);
-	DS_ArenaInit(&UI_STATE.prev_frame_arena, DS_KIB(4), allocator);
-	DS_ArenaInit(&UI_STATE.frame_arena, DS_KIB(4), allocator);
+	if (UI_FRAME_ARENA_RESERVE_SIZE > 0) {
+		DS_ArenaInitVirtual(&UI_STATE.prev_frame_arena, UI_FRAME_ARENA_RESERVE_SIZE);
+		DS_ArenaInitVirtual(&UI_STATE.frame_arena, UI_FRAME_ARENA_RESERVE_SIZE);
+	}
+	else {
+		DS_ArenaInit(&UI_STATE.prev_frame_arena, DS_KIB(4), allocator);
+		DS_ArenaInit(&UI_STATE.frame_arena, DS_KIB(4), allocator);
+	}
 	DS_ArrInit(&UI_STATE.fonts, allocator);
+	DS_MapInit(&UI_STATE.text_runs, &UI_STATE.frame_arena);
 	
-	stbtt_PackBegin(&UI_STATE.pack_context, NULL, UI_GLYPH_MAP_SIZE, UI_GLYPH_MAP_SIZE, 0, UI_GLYPH_PADDING, NULL);
+	UI_AtlasPageInit(0);
+	UI_STATE.atlas_pages_count = 1;
 
-	// init atlas
-	{
-		UI_TextureID atlas = backend->create_atlas(0, UI_GLYPH_MAP_SIZE, UI_GLYPH_MAP_SIZE);
-		UI_ASSERT(atlas != UI_TEXTURE_ID_NIL);
-		UI_STATE.atlases[0] = atlas;
+	backend->create_vertex_buffer(0, sizeof(UI_DrawVertex) * UI_VERTEX_RING_COUNT);
+	backend->create_index_buffer(1, sizeof(uint32_t) * UI_INDEX_RING_COUNT);
+	UI_STATE.draw_vertices = (UI_DrawVertex*)DS_MemAlloc(allocator, sizeof(UI_DrawVertex) * UI_MAX_VERTEX_COUNT);
+	UI_STATE.draw_indices = (uint32_t*)DS_MemAlloc(allocator, sizeof(uint32_t) * UI_MAX_INDEX_COUNT);
 
-		// pack a white rectangle into the atlas. See UI_WHITE_PIXEL_UV
+	DS_ArrInit(&UI_STATE.box_stack, &UI_STATE.persistent_arena);
+	DS_ArrPush(&UI_STATE.box_stack, NULL);
 
-		stbrp_rect rect = {0};
-		rect.w = 1;
-		rect.h = 1;
-		stbtt_PackFontRangesPackRects(&UI_STATE.pack_context, &rect, 1);
-		UI_ASSERT(rect.was_packed);
-		UI_ASSERT(rect.x == 0 && rect.y == 0);
+	UI_ProfExit();
+}
 
-		uint32_t* data = (uint32_t*)backend->atlas_map_until_draw(0);
-		data[0] = 0xFFFFFFFF;
-	}
+static bool UI_BoxLayoutIsRetained(UI_Box* box) {
+	return box->layout_hash != 0 && box->prev_frame != NULL && box->prev_frame->layout_hash == box->layout_hash;
+}
 
-	backend->create_vertex_buffer(0, sizeof(UI_DrawVertex) * UI_MAX_VERTEX_COUNT);
-	backend->create_index_buffer(1, sizeof(uint32_t) * UI_MAX_INDEX_COUNT);
+// Copies the whole computed layout of the subtree from the previous frame in a single walk. Later layout steps that
+// find the same inputs as in the previous frame can then return right away.
+static void UI_BoxRetainLayout(UI_Box* box) {
+	UI_Box* prev = box->prev_frame;
+	box->computed_position = prev->computed_position;
+	box->computed_unexpanded_size = prev->computed_unexpanded_size;
+	box->computed_expanded_size = prev->computed_expanded_size;
+	box->computed_rect = prev->computed_rect;
+	box->layout_scissor = prev->layout_scissor;
+	box->layout_retained = true;
+	for (UI_Box* child = box->first_child[0]; child; child = child->next[1]) {
+		UI_ASSERT(child->prev_frame != NULL); // The layout hash includes the keys of the children
+		UI_BoxRetainLayout(child);
+	}
+}
 
-	UI_STATE.atlas_buffer_grayscale = (uint8_t*)DS_MemAlloc(UI_STATE.allocator, sizeof(uint8_t) * UI_GLYPH_MAP_SIZE * UI_GLYPH_MAP_SIZE);
-	memset(UI_STATE.atlas_buffer_grayscale, 0, UI_GLYPH_MAP_SIZE * UI_GLYPH_MAP_SIZE);
-	UI_STATE.pack_context.pixels = UI_STATE.atlas_buffer_grayscale;
+static void UI_BoxRetainExpandedSize(UI_Box* box, UI_Axis axis) {
+	box->computed_expanded_size._[axis] = box->prev_frame->computed_expanded_size._[axis];
+	for (UI_Box* child = box->first_child[0]; child; child = child->next[1]) {
+		UI_BoxRetainExpandedSize(child, axis);
+	}
+}
 
-	DS_ArrInit(&UI_STATE.box_stack, &UI_STATE.persistent_arena);
-	DS_ArrPush(&UI_STATE.box_stack, NULL);
+static void UI_BoxRetainRect(UI_Box* box, UI_Axis axis) {
+	box->computed_position._[axis] = box->prev_frame->computed_position._[axis];
+	box->computed_rect.min._[axis] = box->prev_frame->computed_rect.min._[axis];
+	box->computed_rect.max._[axis] = box->prev_frame->computed_rect.max._[axis];
+	box->layout_scissor.min._[axis] = box->prev_frame->layout_scissor.min._[axis];
+	box->layout_scissor.max._[axis] = box->prev_frame->layout_scissor.max._[axis];
+	for (UI_Box* child = box->first_child[0]; child; child = child->next[1]) {
+		UI_BoxRetainRect(child, axis);
+	}
+}
 
+UI_API uint64_t UI_BoxComputeLayoutHash(UI_Box* box) {
+	UI_ProfEnter();
+	
+	// Everything that UI_BoxComputeUnexpandedSizeDefault, UI_BoxComputeExpandedSize and UI_BoxComputeRectsStep read from the box
+	struct {
+		UI_Key key;
+		uint64_t text_hash;
+		UI_BoxFlags flags;
+		UI_FontView font;
+		UI_Size size[2];
+		UI_Vec2 offset;
+		UI_Vec2 inner_padding;
+	} fields;
+	memset(&fields, 0, sizeof(fields)); // zero the padding
+	fields.key = box->key;
+	fields.text_hash = box->flags & UI_BoxFlag_HasText ? DS_MurmurHash64A(box->text.data, (int)box->text.size, 0) : 0;
+	fields.flags = box->flags;
+	fields.font = box->font;
+	fields.size[0] = box->size[0];
+	fields.size[1] = box->size[1];
+	fields.offset = box->offset;
+	fields.inner_padding = box->inner_padding;
+	
+	uint64_t hash = DS_MurmurHash64A(&fields, sizeof(fields), 0);
+	
+	// A custom compute_unexpanded_size may depend on anything, so its subtree can't be retained.
+	bool retainable = box->compute_unexpanded_size == UI_BoxComputeUnexpandedSizeDefault;
+	for (UI_Box* child = box->first_child[0]; child; child = child->next[1]) {
+		uint64_t child_hash = UI_BoxComputeLayoutHash(child);
+		if (child_hash == 0) retainable = false;
+		hash = UI_HashKey(hash, child_hash);
+	}
+	
+	box->layout_hash = retainable ? hash | 1 : 0;
 	UI_ProfExit();
+	return box->layout_hash;
 }
 
 UI_API void UI_BoxComputeExpandedSize(UI_Box* box, UI_Axis axis, float size) {
 	UI_ProfEnter();
+	if (UI_BoxLayoutIsRetained(box) && box->prev_frame->computed_expanded_size._[axis] == size) {
+		if (!box->layout_retained) UI_BoxRetainExpandedSize(box, axis);
+		UI_ProfExit();
+		return;
+	}
+
+	box->layout_retained = false;
 	box->computed_expanded_size._[axis] = size;
 
 	float child_area_size = size;
@@ -2286,6 +2564,24 @@ UI_API void UI_BoxComputeExpandedSize(UI_Box* box, UI_Axis axis, float size) {
 
 UI_API void UI_BoxComputeRectsStep(UI_Box* box, UI_Axis axis, float position, UI_ScissorRect scissor) {
 	UI_ProfEnter();
+	float scissor_min = scissor ? scissor->min._[axis] : -UI_INFINITE;
+	float scissor_max = scissor ? scissor->max._[axis] : UI_INFINITE;
+	
+	if (UI_BoxLayoutIsRetained(box)) {
+		UI_Box* prev = box->prev_frame;
+		if (prev->computed_position._[axis] == position + box->offset._[axis] &&
+			prev->computed_expanded_size._[axis] == box->computed_expanded_size._[axis] &&
+			prev->layout_scissor.min._[axis] == scissor_min && prev->layout_scissor.max._[axis] == scissor_max)
+		{
+			if (!box->layout_retained) UI_BoxRetainRect(box, axis);
+			UI_ProfExit();
+			return;
+		}
+	}
+	
+	box->layout_retained = false;
+	box->layout_scissor.min._[axis] = scissor_min;
+	box->layout_scissor.max._[axis] = scissor_max;
 	box->computed_position._[axis] = position + box->offset._[axis];
 
 	float min = box->computed_position._[axis];
@@ -2326,6 +2622,11 @@ UI_API void UI_BoxComputeRectsStep(UI_Box* box, UI_Axis axis, float position, UI
 
 UI_API void UI_BoxComputeUnexpandedSizeDefault(UI_Box* box, UI_Axis axis, int pass, bool* request_second_pass) {
 	UI_ProfEnter();
+	if (UI_BoxLayoutIsRetained(box)) {
+		if (!box->layout_retained) UI_BoxRetainLayout(box);
+		UI_ProfExit();
+		return;
+	}
 	
 	for (UI_Box* child = box->first_child[0]; child; child = child->next[1]) {
 		child->compute_unexpanded_size(child, axis, pass, request_second_pass);
@@ -2380,6 +2681,7 @@ UI_API void UI_BoxComputeExpandedSizes(UI_Box* box) {
 
 UI_API void UI_BoxComputeRects(UI_Box* box, UI_Vec2 box_position) {
 	UI_ProfEnter();
+	UI_BoxComputeLayoutHash(box);
 	UI_BoxComputeExpandedSizes(box);
 	UI_BoxComputeRectsStep(box, UI_Axis_X, box_position.x, NULL);
 	UI_BoxComputeRectsStep(box, UI_Axis_Y, box_position.y, NULL);
@@ -2407,6 +2709,94 @@ static void UI_FinalizeDrawBatch() {
 	UI_ProfExit();
 }
 
+typedef struct UI_DrawCallGroup {
+	UI_TextureID texture;
+	UI_Rect bounds;
+	int first_call, last_call;
+} UI_DrawCallGroup;
+
+static UI_Rect UI_DrawCallBounds(const UI_DrawCall* draw_call) {
+	UI_Rect bounds = {{UI_INFINITE, UI_INFINITE}, {-UI_INFINITE, -UI_INFINITE}};
+	const uint32_t* indices = &UI_STATE.draw_indices[draw_call->first_index];
+	for (uint32_t i = 0; i < draw_call->index_count; i++) {
+		UI_Vec2 p = UI_STATE.draw_vertices[indices[i]].position;
+		bounds.min.x = UI_Min(bounds.min.x, p.x); bounds.min.y = UI_Min(bounds.min.y, p.y);
+		bounds.max.x = UI_Max(bounds.max.x, p.x); bounds.max.y = UI_Max(bounds.max.y, p.y);
+	}
+	return bounds;
+}
+
+// Merges batches with the same texture together and writes the indices into `out_indices` in the merged order.
+// A batch is only moved back to an earlier batch with the same texture if it doesn't overlap anything drawn in between,
+// so the final image stays the same.
+static void UI_MergeDrawCalls(uint32_t* out_indices) {
+	UI_ProfEnter();
+	int calls_count = UI_STATE.draw_calls.count;
+	UI_DrawCall* calls = UI_STATE.draw_calls.data;
+
+	UI_DrawCallGroup* groups = (UI_DrawCallGroup*)DS_ArenaPush(&UI_STATE.frame_arena, calls_count * sizeof(UI_DrawCallGroup));
+	int* next_call = (int*)DS_ArenaPush(&UI_STATE.frame_arena, calls_count * sizeof(int)); // next call within the same group
+	int groups_count = 0;
+
+	for (int i = 0; i < calls_count; i++) {
+		UI_Rect bounds = UI_DrawCallBounds(&calls[i]);
+		next_call[i] = -1;
+
+		int target = -1;
+		for (int g = groups_count - 1; g >= 0 && g >= groups_count - UI_DRAW_CALL_MERGE_LOOKBACK; g--) {
+			if (groups[g].texture == calls[i].texture) {
+				target = g;
+				break;
+			}
+			UI_Rect g_bounds = groups[g].bounds;
+			bool overlaps = bounds.min.x < g_bounds.max.x && g_bounds.min.x < bounds.max.x && bounds.min.y < g_bounds.max.y && g_bounds.min.y < bounds.max.y;
+			if (overlaps) break;
+		}
+
+		if (target == -1) {
+			UI_DrawCallGroup group = {calls[i].texture, bounds, i, i};
+			groups[groups_count++] = group;
+		}
+		else {
+			UI_DrawCallGroup* group = &groups[target];
+			next_call[group->last_call] = i;
+			group->last_call = i;
+			group->bounds.min.x = UI_Min(group->bounds.min.x, bounds.min.x); group->bounds.min.y = UI_Min(group->bounds.min.y, bounds.min.y);
+			group->bounds.max.x = UI_Max(group->bounds.max.x, bounds.max.x); group->bounds.max.y = UI_Max(group->bounds.max.y, bounds.max.y);
+		}
+	}
+
+	UI_DrawCall* merged_calls = (UI_DrawCall*)DS_ArenaPush(&UI_STATE.frame_arena, groups_count * sizeof(UI_DrawCall));
+	uint32_t out_index = 0;
+	for (int g = 0; g < groups_count; g++) {
+		UI_DrawCall merged = calls[groups[g].first_call];
+		merged.first_index = out_index;
+		for (int i = groups[g].first_call; i != -1; i = next_call[i]) {
+			memcpy(&out_indices[out_index], &UI_STATE.draw_indices[calls[i].first_index], calls[i].index_count * sizeof(uint32_t));
+			out_index += calls[i].index_count;
+		}
+		merged.index_count = out_index - merged.first_index;
+		merged_calls[g] = merged;
+	}
+
+	DS_ArrClear(&UI_STATE.draw_calls);
+	DS_ArrPushN(&UI_STATE.draw_calls, merged_calls, groups_count);
+	UI_ProfExit();
+}
+
+// Streams `count` elements into a backend ring buffer and returns the element offset they were written to
+static uint32_t UI_StreamToRingBuffer(int buffer_id, uint32_t* cursor, uint32_t ring_count, const void* data, uint32_t count, uint32_t elem_size) {
+	bool discard = false;
+	if (*cursor + count > ring_count) {
+		*cursor = 0;
+		discard = true;
+	}
+	uint32_t offset = *cursor;
+	UI_STATE.backend.buffer_upload(buffer_id, offset * elem_size, data, count * elem_size, discard);
+	*cursor += count;
+	return offset;
+}
+
 UI_API void UI_EndFrame(UI_Outputs* outputs) {
 	UI_ProfEnter();
 
@@ -2429,6 +2819,25 @@ UI_API void UI_EndFrame(UI_Outputs* outputs) {
 	}
 
 	UI_FinalizeDrawBatch();
+	UI_AtlasUploadDirtyRegions();
+
+	UI_STATE.outputs.draw_calls_count_before_merge = UI_STATE.draw_calls.count;
+	uint32_t* merged_indices = (uint32_t*)DS_ArenaPush(&UI_STATE.frame_arena, UI_STATE.draw_next_index * sizeof(uint32_t));
+	UI_MergeDrawCalls(merged_indices);
+
+	if (UI_STATE.draw_next_index > 0) {
+		uint32_t base_vertex = UI_StreamToRingBuffer(0, &UI_STATE.vertex_ring_cursor, UI_VERTEX_RING_COUNT,
+			UI_STATE.draw_vertices, UI_STATE.draw_next_vertex, sizeof(UI_DrawVertex));
+		uint32_t first_index = UI_StreamToRingBuffer(1, &UI_STATE.index_ring_cursor, UI_INDEX_RING_COUNT,
+			merged_indices, UI_STATE.draw_next_index, sizeof(uint32_t));
+
+		for (int i = 0; i < UI_STATE.draw_calls.count; i++) {
+			UI_STATE.draw_calls.data[i].base_vertex = base_vertex;
+			UI_STATE.draw_calls.data[i].first_index += first_index;
+		}
+		UI_STATE.outputs.vertex_bytes_uploaded = UI_STATE.draw_next_vertex * sizeof(UI_DrawVertex);
+		UI_STATE.outputs.index_bytes_uploaded = UI_STATE.draw_next_index * sizeof(uint32_t);
+	}
 
 	UI_STATE.outputs.draw_calls = UI_STATE.draw_calls.data;
 	UI_STATE.outputs.draw_calls_count = UI_STATE.draw_calls.count;
@@ -2556,7 +2965,9 @@ UI_API UI_FontIndex UI_FontInit(const void* ttf_data, float y_offset) {
 
 	UI_Font* font = &UI_STATE.fonts.data[idx];
 	memset(font, 0, sizeof(*font));
-	DS_MapInit(&font->glyph_map, UI_STATE.allocator);
+	// New glyphs are cached in the middle of drawing text, so spread out the cost of growing the map
+	DS_MapInitEx(&font->glyph_map, UI_STATE.allocator, DS_MapFlag_IncrementalRehash);
+	DS_MapInit(&font->glyph_map_old, UI_STATE.allocator);
 
 	font->data = (const unsigned char*)ttf_data;
 	font->y_offset = y_offset;
@@ -2572,18 +2983,18 @@ UI_API void UI_FontDeinit(UI_FontIndex font_idx) {
 	UI_Font* font = DS_ArrGetPtr(UI_STATE.fonts, font_idx);
 	UI_ASSERT(font->data);
 	DS_MapDeinit(&font->glyph_map);
+	DS_MapDeinit(&font->glyph_map_old);
 	font->data = NULL;
 }
 
 static UI_CachedGlyph UI_GetCachedGlyph(uint32_t codepoint, UI_FontView font, int* out_atlas_index) {
 	UI_ProfEnter();
-	int atlas_index = 0;
 	UI_CachedGlyphKey key = { codepoint, font.size };
 
 	UI_Font* font_data = DS_ArrGetPtr(UI_STATE.fonts, font.font);
 
-	UI_CachedGlyph* glyph = NULL;
-	if (DS_MapGetOrAddPtr(&font_data->glyph_map, key, &glyph)) {
+	UI_CachedGlyph* glyph = (UI_CachedGlyph*)DS_MapFindPtr(&font_data->glyph_map, key);
+	if (glyph == NULL) {
 		stbrp_rect rect = {0};
 		stbtt_packedchar packed_char;
 		stbtt_pack_range pack_range = {0};
@@ -2593,55 +3004,46 @@ static UI_CachedGlyph UI_GetCachedGlyph(uint32_t codepoint, UI_FontView font, in
 		pack_range.num_chars = 1;
 		pack_range.chardata_for_range = &packed_char;
 
-		// GatherRects fills width & height fields of `rect`
-		if (stbtt_PackFontRangesGatherRects(&UI_STATE.pack_context, &font_data->font_info, &pack_range, 1, &rect) == 0) {
+		// GatherRects fills width & height fields of `rect`. Any page works here, as they share the same settings.
+		stbtt_pack_context* gather_context = &UI_STATE.atlas_pages[UI_STATE.atlas_current_page].pack_context;
+		if (stbtt_PackFontRangesGatherRects(gather_context, &font_data->font_info, &pack_range, 1, &rect) == 0) {
 			UI_TODO(); // glyph is not found in the font
 		}
 		UI_ASSERT(rect.h >= 0);
 
-		stbtt_PackFontRangesPackRects(&UI_STATE.pack_context, &rect, 1);
-		if (!rect.was_packed) {
-			UI_TODO(); // ran out of space in the atlas, we need to start using a new atlas
-		}
-
-		UI_ASSERT(stbtt_PackFontRangesRenderIntoRects(&UI_STATE.pack_context, &font_data->font_info, &pack_range, 1, &rect));
-
-		// The glyph will be now rasterized into UI_.atlas_buffer_grayscale. Let's convert it into RGBA8.
+		// NOTE: packing may evict a page, which rebuilds the glyph maps. So we only add the new glyph after packing.
+		int atlas_page = UI_AtlasPack(&rect);
+		UI_AtlasPage* page = &UI_STATE.atlas_pages[atlas_page];
 
-		uint32_t* atlas_data = (uint32_t*)UI_STATE.backend.atlas_map_until_draw(0);
-		UI_ASSERT(atlas_data);
+		UI_ASSERT(stbtt_PackFontRangesRenderIntoRects(&page->pack_context, &font_data->font_info, &pack_range, 1, &rect));
 
-		for (int y = packed_char.y0; y < packed_char.y1; y++) {
-			uint8_t* src_row = UI_STATE.atlas_buffer_grayscale + y * UI_GLYPH_MAP_SIZE;
-			uint32_t* dst_row = atlas_data + y * UI_GLYPH_MAP_SIZE;
-
-			for (int x = packed_char.x0; x < packed_char.x1; x++) {
-				dst_row[x] = ((uint32_t)src_row[x] << 24) | 0x00FFFFFF;
-				//dst_row[x] = ((uint32_t)src_row[x] << 24) | 0x00FFFFFF;
-				// Aha! Blending modes!
-				//dst_row[x] = 0x01010101;//((uint32_t)src_row[x] << 0) | 0xFFFFFF00;
-			}
-		}
+		// The glyph is now rasterized into the grayscale buffer of the page, and will be uploaded at the end of the frame.
+		UI_AtlasPageMarkDirty(page, rect.x, rect.y, rect.x + rect.w, rect.y + rect.h);
 
 		UI_ASSERT(packed_char.x0 == rect.x);
 		UI_ASSERT(packed_char.y0 == rect.y);
 		UI_ASSERT(packed_char.y1 - packed_char.y0 == rect.h);
 		UI_ASSERT(packed_char.x1 - packed_char.x0 == rect.w);
 
+		UI_CachedGlyph new_glyph;
 		int w = packed_char.x1 - packed_char.x0;
 		int h = packed_char.y1 - packed_char.y0;
-		glyph->origin_uv.x = (float)packed_char.x0 / (float)UI_GLYPH_MAP_SIZE;
-		glyph->origin_uv.y = (float)packed_char.y0 / (float)UI_GLYPH_MAP_SIZE;
-		glyph->size_pixels.x = (float)w;
-		glyph->size_pixels.y = (float)h;
-		glyph->offset_pixels.x = packed_char.xoff;
-		glyph->offset_pixels.y = packed_char.yoff + font.size + font_data->y_offset;
-		glyph->x_advance = (float)(int)(packed_char.xadvance + 0.5f); // round to integer
+		new_glyph.atlas_page = atlas_page;
+		new_glyph.origin_uv.x = (float)packed_char.x0 / (float)UI_GLYPH_MAP_SIZE;
+		new_glyph.origin_uv.y = (float)packed_char.y0 / (float)UI_GLYPH_MAP_SIZE;
+		new_glyph.size_pixels.x = (float)w;
+		new_glyph.size_pixels.y = (float)h;
+		new_glyph.offset_pixels.x = packed_char.xoff;
+		new_glyph.offset_pixels.y = packed_char.yoff + font.size + font_data->y_offset;
+		new_glyph.x_advance = (float)(int)(packed_char.xadvance + 0.5f); // round to integer
 
-		// UI_.atlas_needs_reupload = true;
+		DS_MapGetOrAddPtr(&font_data->glyph_map, key, &glyph);
+		*glyph = new_glyph;
 	}
 
-	if (out_atlas_index) *out_atlas_index = atlas_index;
+	UI_STATE.atlas_pages[glyph->atlas_page].last_used_frame = UI_STATE.frame_index;
+
+	if (out_atlas_index) *out_atlas_index = glyph->atlas_page;
 	UI_ProfExit();
 	return *glyph;
 }
@@ -2656,14 +3058,102 @@ UI_API float UI_GlyphWidth(uint32_t codepoint, UI_FontView font) {
 	//return val.advance;
 }
 
-UI_API float UI_TextWidth(STR_View text, UI_FontView font) {
+static UI_TextRun* UI_BuildTextRun(STR_View text, UI_FontView font) {
+	UI_ProfEnter();
+	UI_TextRun* run = DS_New(UI_TextRun, &UI_STATE.frame_arena);
+	run->vertices = (UI_DrawVertex*)DS_ArenaPush(&UI_STATE.frame_arena, 4 * text.size * sizeof(UI_DrawVertex)); // at most one glyph per byte
+	run->glyph_atlas_pages = (uint8_t*)DS_ArenaPush(&UI_STATE.frame_arena, text.size);
+
+	// Looking up a glyph may evict an atlas page, which would invalidate the glyphs looked up before it. If that happens, start over.
+	// A string that needs more glyphs than fit in all of the pages will look wrong, but we must give up at some point.
+	for (int attempt = 0; attempt < 2; attempt++) {
+		uint32_t atlas_evictions_count = UI_STATE.atlas_evictions_count;
+		run->glyphs_count = 0;
+		run->atlas_pages_mask = 0;
+		run->bounds = UI_RECT{{0, 0}, {0, 0}};
+
+		float x = 0.f;
+		for STR_Each(text, r, i) {
+			int atlas_page = 0;
+			UI_CachedGlyph glyph = UI_GetCachedGlyph(r, font, &atlas_page);
+
+			if (glyph.size_pixels.x > 0.f && glyph.size_pixels.y > 0.f) {
+				UI_Rect rect;
+				rect.min.x = x + glyph.offset_pixels.x;
+				rect.min.y = glyph.offset_pixels.y;
+				rect.max.x = rect.min.x + glyph.size_pixels.x;
+				rect.max.y = rect.min.y + glyph.size_pixels.y;
+
+				UI_Rect uv_rect;
+				uv_rect.min = glyph.origin_uv;
+				uv_rect.max.x = uv_rect.min.x + glyph.size_pixels.x / (float)UI_GLYPH_MAP_SIZE;
+				uv_rect.max.y = uv_rect.min.y + glyph.size_pixels.y / (float)UI_GLYPH_MAP_SIZE;
+
+				UI_DrawVertex* v = &run->vertices[4 * run->glyphs_count];
+				v[0] = UI_DRAW_VERTEX{ {rect.min.x, rect.min.y}, uv_rect.min,                    UI_WHITE };
+				v[1] = UI_DRAW_VERTEX{ {rect.max.x, rect.min.y}, {uv_rect.max.x, uv_rect.min.y}, UI_WHITE };
+				v[2] = UI_DRAW_VERTEX{ {rect.max.x, rect.max.y}, uv_rect.max,                    UI_WHITE };
+				v[3] = UI_DRAW_VERTEX{ {rect.min.x, rect.max.y}, {uv_rect.min.x, uv_rect.max.y}, UI_WHITE };
+
+				if (run->glyphs_count == 0) run->bounds = rect;
+				else {
+					run->bounds.min.x = UI_Min(run->bounds.min.x, rect.min.x);
+					run->bounds.min.y = UI_Min(run->bounds.min.y, rect.min.y);
+					run->bounds.max.x = UI_Max(run->bounds.max.x, rect.max.x);
+					run->bounds.max.y = UI_Max(run->bounds.max.y, rect.max.y);
+				}
+
+				run->glyph_atlas_pages[run->glyphs_count] = (uint8_t)atlas_page;
+				run->atlas_pages_mask |= 1u << atlas_page;
+				run->glyphs_count++;
+			}
+			x += glyph.x_advance;
+		}
+		run->width = x;
+		run->atlas_evictions_count = UI_STATE.atlas_evictions_count;
+		if (atlas_evictions_count == UI_STATE.atlas_evictions_count) break;
+	}
+
+	UI_ProfExit();
+	return run;
+}
+
+// The returned run is valid until the end of the frame.
+static UI_TextRun* UI_GetTextRun(STR_View text, UI_FontView font) {
 	UI_ProfEnter();
-	float w = 0.f;
-	for STR_Each(text, r, i) {
-		w += UI_GlyphWidth(r, font);
+	UI_TextRunKey key = { DS_MurmurHash64A(text.data, text.size, 0), font.font, font.size };
+
+	UI_TextRun** run_ptr;
+	if (DS_MapGetOrAddPtr(&UI_STATE.text_runs, key, &run_ptr)) {
+		UI_TextRun* prev_run = NULL;
+		DS_MapFind(&UI_STATE.prev_frame_text_runs, key, &prev_run);
+
+		if (prev_run && prev_run->atlas_evictions_count == UI_STATE.atlas_evictions_count) {
+			// Keep alive for this frame
+			UI_TextRun* run = DS_Clone(UI_TextRun, &UI_STATE.frame_arena, *prev_run);
+			run->vertices = (UI_DrawVertex*)DS_CloneSize(&UI_STATE.frame_arena, prev_run->vertices, 4 * prev_run->glyphs_count * sizeof(UI_DrawVertex));
+			run->glyph_atlas_pages = (uint8_t*)DS_CloneSize(&UI_STATE.frame_arena, prev_run->glyph_atlas_pages, prev_run->glyphs_count);
+			*run_ptr = run;
+		}
+		else {
+			*run_ptr = UI_BuildTextRun(text, font);
+		}
+	}
+	else if ((*run_ptr)->atlas_evictions_count != UI_STATE.atlas_evictions_count) {
+		*run_ptr = UI_BuildTextRun(text, font);
 	}
+
+	UI_TextRun* run = *run_ptr;
+	for (int i = 0; i < UI_STATE.atlas_pages_count; i++) {
+		if (run->atlas_pages_mask & (1u << i)) UI_STATE.atlas_pages[i].last_used_frame = UI_STATE.frame_index;
+	}
+
 	UI_ProfExit();
-	return w;
+	return run;
+}
+
+UI_API float UI_TextWidth(STR_View text, UI_FontView font) {
+	return UI_GetTextRun(text, font)->width;
 }
 
 UI_API inline UI_DrawVertex* UI_AddVertices(int count, uint32_t* out_first_index) {
@@ -3136,7 +3626,8 @@ UI_API void UI_DrawPolylineLoop(const UI_Vec2* points, const UI_Color* colors, i
 
 UI_API UI_Vec2 UI_DrawText(STR_View text, UI_FontView font, UI_Vec2 origin, UI_AlignH align_h, UI_AlignV align_v, UI_Color color, UI_ScissorRect scissor) {
 	UI_ProfEnter();
-	UI_Vec2 s = { UI_TextWidth(text, font), (float)font.size };
+	UI_TextRun* run = UI_GetTextRun(text, font);
+	UI_Vec2 s = { run->width, (float)font.size };
 
 	if (align_h == UI_AlignH_Middle) {
 		origin.x -= s.x * 0.5f;
@@ -3155,24 +3646,50 @@ UI_API UI_Vec2 UI_DrawText(STR_View text, UI_FontView font, UI_Vec2 origin, UI_A
 	origin.x = (float)(int)(origin.x + 0.5f); // round to integer
 	origin.y = (float)(int)(origin.y + 0.5f); // round to integer
 
-	for STR_Each(text, r, i) {
-		int atlas_index = 0;
-		UI_CachedGlyph glyph = UI_GetCachedGlyph(r, font, &atlas_index);
-
-		UI_Rect glyph_rect;
-		glyph_rect.min.x = origin.x + glyph.offset_pixels.x;
-		glyph_rect.min.y = origin.y + glyph.offset_pixels.y;
-		glyph_rect.max.x = glyph_rect.min.x + glyph.size_pixels.x;
-		glyph_rect.max.y = glyph_rect.min.y + glyph.size_pixels.y;
-
-		UI_Rect glyph_uv_rect;
-		glyph_uv_rect.min = glyph.origin_uv;
-		glyph_uv_rect.max = glyph_uv_rect.min;
-		glyph_uv_rect.max.x += glyph.size_pixels.x / (float)UI_GLYPH_MAP_SIZE;
-		glyph_uv_rect.max.y += glyph.size_pixels.y / (float)UI_GLYPH_MAP_SIZE;
+	UI_Rect bounds = { UI_AddV2(run->bounds.min, origin), UI_AddV2(run->bounds.max, origin) };
+	bool fully_visible = true;
+	if (scissor) {
+		if (bounds.max.x <= scissor->min.x || bounds.max.y <= scissor->min.y || bounds.min.x >= scissor->max.x || bounds.min.y >= scissor->max.y) {
+			UI_ProfExit();
+			return s; // fully clipped
+		}
+		fully_visible = bounds.min.x >= scissor->min.x && bounds.min.y >= scissor->min.y && bounds.max.x <= scissor->max.x && bounds.max.y <= scissor->max.y;
+	}
 
-		UI_DrawSprite(glyph_rect, color, glyph_uv_rect, UI_STATE.atlases[atlas_index], scissor);
-		origin.x += glyph.x_advance;
+	if (fully_visible && run->glyphs_count > 0) {
+		// Copy the prebuilt quads in one go
+		uint32_t first_vertex;
+		UI_DrawVertex* vertices = UI_AddVertices(4 * run->glyphs_count, &first_vertex);
+		for (int i = 0; i < 4 * run->glyphs_count; i++) {
+			UI_DrawVertex v = run->vertices[i];
+			v.position.x += origin.x;
+			v.position.y += origin.y;
+			v.color = color;
+			vertices[i] = v;
+		}
+
+		// Add the indices in spans of glyphs that are on the same atlas page
+		for (int first = 0; first < run->glyphs_count;) {
+			int end = first + 1;
+			while (end < run->glyphs_count && run->glyph_atlas_pages[end] == run->glyph_atlas_pages[first]) end++;
+
+			uint32_t* indices = UI_AddIndices(6 * (end - first), UI_STATE.atlas_pages[run->glyph_atlas_pages[first]].texture);
+			for (int i = first; i < end; i++) {
+				uint32_t v = first_vertex + 4 * i;
+				indices[0] = v; indices[1] = v + 1; indices[2] = v + 2;
+				indices[3] = v; indices[4] = v + 2; indices[5] = v + 3;
+				indices += 6;
+			}
+			first = end;
+		}
+	}
+	else {
+		for (int i = 0; i < run->glyphs_count; i++) {
+			const UI_DrawVertex* v = &run->vertices[4 * i];
+			UI_Rect glyph_rect = { UI_AddV2(v[0].position, origin), UI_AddV2(v[2].position, origin) };
+			UI_Rect glyph_uv_rect = { v[0].uv, v[2].uv };
+			UI_DrawSprite(glyph_rect, color, glyph_uv_rect, UI_STATE.atlas_pages[run->glyph_atlas_pages[i]].texture, scissor);
+		}
 	}
 
 	UI_ProfExit();
@@ -0,0 +1,179 @@
+// fire_ui_backend_cpu.h - CPU-only backend for fire_ui
+//
+// Keeps the atlases and buffers in plain memory, so fire_ui can run without a GPU, i.e. for benchmarking and testing on
+// any platform. The draw list of a frame can optionally be rasterized into an RGBA8 image with UI_CPU_Rasterize.
+// If `stb_image_write.h` is included before this file, UI_CPU_WritePNG is available too.
+//
+// Usage:
+//   UI_Backend backend = {0};
+//   UI_CPU_Init(&backend);
+//   UI_Init(DS_HEAP, &backend);
+//   ...
+//   UI_EndFrame(&outputs);
+//   UI_CPU_Rasterize(&outputs, pixels, width, height); // optional
+//   ...
+//   UI_Deinit();
+//   UI_CPU_Deinit();
+//
+
+typedef struct UI_CPU_Atlas {
+	uint32_t* pixels; // RGBA8, NULL if the atlas doesn't exist
+	uint32_t width;
+	uint32_t height;
+} UI_CPU_Atlas;
+
+typedef struct UI_CPU_State {
+	UI_CPU_Atlas atlases[UI_MAX_ATLAS_PAGES];
+	void* buffers[UI_MAX_BACKEND_BUFFERS];
+	uint32_t buffer_sizes[UI_MAX_BACKEND_BUFFERS];
+} UI_CPU_State;
+
+static UI_CPU_State UI_CPU_STATE;
+
+static UI_TextureID UI_CPU_CreateAtlas(int atlas_id, uint32_t width, uint32_t height) {
+	UI_CPU_Atlas* atlas = &UI_CPU_STATE.atlases[atlas_id];
+	atlas->pixels = (uint32_t*)calloc(width * height, sizeof(uint32_t));
+	atlas->width = width;
+	atlas->height = height;
+	return (UI_TextureID)(atlas_id + 1);
+}
+
+static void UI_CPU_DestroyAtlas(int atlas_id) {
+	free(UI_CPU_STATE.atlases[atlas_id].pixels);
+	memset(&UI_CPU_STATE.atlases[atlas_id], 0, sizeof(UI_CPU_Atlas));
+}
+
+static void UI_CPU_AtlasUpload(int atlas_id, uint32_t x, uint32_t y, uint32_t width, uint32_t height, const void* pixels) {
+	UI_CPU_Atlas* atlas = &UI_CPU_STATE.atlases[atlas_id];
+	for (uint32_t row = 0; row < height; row++) {
+		memcpy(atlas->pixels + (y + row) * atlas->width + x, (const uint32_t*)pixels + row * width, width * sizeof(uint32_t));
+	}
+}
+
+static void UI_CPU_CreateBuffer(int buffer_id, uint32_t size_in_bytes) {
+	UI_CPU_STATE.buffers[buffer_id] = malloc(size_in_bytes);
+	UI_CPU_STATE.buffer_sizes[buffer_id] = size_in_bytes;
+}
+
+static void UI_CPU_DestroyBuffer(int buffer_id) {
+	free(UI_CPU_STATE.buffers[buffer_id]);
+	UI_CPU_STATE.buffers[buffer_id] = NULL;
+	UI_CPU_STATE.buffer_sizes[buffer_id] = 0;
+}
+
+static void UI_CPU_BufferUpload(int buffer_id, uint32_t offset, const void* data, uint32_t size, bool discard) {
+	char* buffer = (char*)UI_CPU_STATE.buffers[buffer_id];
+	UI_ASSERT(offset + size <= UI_CPU_STATE.buffer_sizes[buffer_id]);
+
+	// Like D3D11_MAP_WRITE_DISCARD, a discard hands out a buffer with undefined contents. Fill it with garbage so that
+	// drawing from anything uploaded before the discard shows up in the rasterized output.
+	if (discard) memset(buffer, 0xCC, UI_CPU_STATE.buffer_sizes[buffer_id]);
+
+	memcpy(buffer + offset, data, size);
+}
+
+static void UI_CPU_Init(UI_Backend* backend) {
+	memset(&UI_CPU_STATE, 0, sizeof(UI_CPU_STATE));
+	backend->create_vertex_buffer = UI_CPU_CreateBuffer;
+	backend->create_index_buffer = UI_CPU_CreateBuffer;
+	backend->destroy_buffer = UI_CPU_DestroyBuffer;
+
+	backend->create_atlas = UI_CPU_CreateAtlas;
+	backend->destroy_atlas = UI_CPU_DestroyAtlas;
+	backend->atlas_upload = UI_CPU_AtlasUpload;
+
+	backend->buffer_upload = UI_CPU_BufferUpload;
+}
+
+static void UI_CPU_Deinit(void) {
+	for (int i = 0; i < UI_MAX_ATLAS_PAGES; i++) {
+		if (UI_CPU_STATE.atlases[i].pixels) UI_CPU_DestroyAtlas(i);
+	}
+	for (int i = 0; i < UI_MAX_BACKEND_BUFFERS; i++) {
+		if (UI_CPU_STATE.buffers[i]) UI_CPU_DestroyBuffer(i);
+	}
+}
+
+static inline float UI_CPU_EdgeFunction(UI_Vec2 a, UI_Vec2 b, float px, float py) {
+	return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+}
+
+static void UI_CPU_RasterizeTriangle(const UI_DrawVertex* v0, const UI_DrawVertex* v1, const UI_DrawVertex* v2, const UI_CPU_Atlas* atlas,
+	uint32_t* pixels, int width, int height)
+{
+	float area = UI_CPU_EdgeFunction(v0->position, v1->position, v2->position.x, v2->position.y);
+	if (area == 0.f) return;
+	float inv_area = 1.f / area;
+
+	int min_x = (int)UI_Max(UI_Min(UI_Min(v0->position.x, v1->position.x), v2->position.x), 0.f);
+	int min_y = (int)UI_Max(UI_Min(UI_Min(v0->position.y, v1->position.y), v2->position.y), 0.f);
+	int max_x = (int)UI_Min(UI_Max(UI_Max(v0->position.x, v1->position.x), v2->position.x) + 1.f, (float)width);
+	int max_y = (int)UI_Min(UI_Max(UI_Max(v0->position.y, v1->position.y), v2->position.y) + 1.f, (float)height);
+
+	for (int y = min_y; y < max_y; y++) {
+		for (int x = min_x; x < max_x; x++) {
+			// Sample at the pixel center, and accept either winding order
+			float px = (float)x + 0.5f, py = (float)y + 0.5f;
+			float w0 = UI_CPU_EdgeFunction(v1->position, v2->position, px, py) * inv_area;
+			float w1 = UI_CPU_EdgeFunction(v2->position, v0->position, px, py) * inv_area;
+			float w2 = UI_CPU_EdgeFunction(v0->position, v1->position, px, py) * inv_area;
+			if (w0 < 0.f || w1 < 0.f || w2 < 0.f) continue;
+
+			float u = w0 * v0->uv.x + w1 * v1->uv.x + w2 * v2->uv.x;
+			float v = w0 * v0->uv.y + w1 * v1->uv.y + w2 * v2->uv.y;
+			int tx = (int)(u * (float)atlas->width) & (atlas->width - 1); // wrap, like the DX11 sampler. The atlas size is a power of two.
+			int ty = (int)(v * (float)atlas->height) & (atlas->height - 1);
+			const uint8_t* texel = (const uint8_t*)&atlas->pixels[ty * atlas->width + tx];
+
+			float src[4];
+			src[0] = (w0 * v0->color.r + w1 * v1->color.r + w2 * v2->color.r) * (float)texel[0] * (1.f / 255.f);
+			src[1] = (w0 * v0->color.g + w1 * v1->color.g + w2 * v2->color.g) * (float)texel[1] * (1.f / 255.f);
+			src[2] = (w0 * v0->color.b + w1 * v1->color.b + w2 * v2->color.b) * (float)texel[2] * (1.f / 255.f);
+			src[3] = (w0 * v0->color.a + w1 * v1->color.a + w2 * v2->color.a) * (float)texel[3] * (1.f / 255.f);
+
+			// Same blend state as in the DX11 backend: color = src*src_alpha + dst*(1 - src_alpha), alpha = src_alpha
+			float alpha = src[3] * (1.f / 255.f);
+			uint8_t* dst = (uint8_t*)&pixels[y * width + x];
+			dst[0] = (uint8_t)(src[0] * alpha + (float)dst[0] * (1.f - alpha) + 0.5f);
+			dst[1] = (uint8_t)(src[1] * alpha + (float)dst[1] * (1.f - alpha) + 0.5f);
+			dst[2] = (uint8_t)(src[2] * alpha + (float)dst[2] * (1.f - alpha) + 0.5f);
+			dst[3] = (uint8_t)(src[3] + 0.5f);
+		}
+	}
+}
+
+// Draws the draw calls of a frame on top of `pixels`, which is an RGBA8 image of `width * height` pixels.
+// Must be called after UI_EndFrame and before the next UI_BeginFrame.
+static void UI_CPU_Rasterize(const UI_Outputs* outputs, uint32_t* pixels, int width, int height) {
+	for (int i = 0; i < outputs->draw_calls_count; i++) {
+		const UI_DrawCall* draw_call = &outputs->draw_calls[i];
+		const UI_DrawVertex* vertices = (const UI_DrawVertex*)UI_CPU_STATE.buffers[draw_call->vertex_buffer_id] + draw_call->base_vertex;
+		const uint32_t* indices = (const uint32_t*)UI_CPU_STATE.buffers[draw_call->index_buffer_id];
+		const UI_CPU_Atlas* atlas = &UI_CPU_STATE.atlases[draw_call->texture - 1];
+		assert(atlas->pixels != NULL);
+
+		for (uint32_t j = 0; j < draw_call->index_count; j += 3) {
+			const uint32_t* tri = &indices[draw_call->first_index + j];
+			UI_CPU_RasterizeTriangle(&vertices[tri[0]], &vertices[tri[1]], &vertices[tri[2]], atlas, pixels, width, height);
+		}
+	}
+}
+
+#ifdef INCLUDE_STB_IMAGE_WRITE_H
+// Rasterizes the draw calls of a frame on top of a solid background color and writes the result into a PNG file.
+// Returns true on success.
+static bool UI_CPU_WritePNG(const char* filepath, const UI_Outputs* outputs, int width, int height, UI_Color background) {
+	uint32_t* pixels = (uint32_t*)malloc(width * height * sizeof(uint32_t));
+	for (int i = 0; i < width * height; i++) memcpy(&pixels[i], &background, sizeof(uint32_t));
+
+	UI_CPU_Rasterize(outputs, pixels, width, height);
+
+	// The blend state writes the source alpha into the destination, which a swapchain ignores but an image doesn't.
+	for (int i = 0; i < width * height; i++) pixels[i] |= 0xFF000000;
+
+	bool ok = stbi_write_png(filepath, width, height, 4, pixels, width * sizeof(uint32_t)) != 0;
+
+	free(pixels);
+	return ok;
+}
+#endif
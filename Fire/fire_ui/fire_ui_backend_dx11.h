@@ -42,31 +42,15 @@ typedef struct UI_DX11_State {
 	ID3D11Buffer* constant_buffer;
 	ID3D11BlendState* blend_state;
 
-	ID3D11Texture2D* atlases[2];
-	ID3D11Texture2D* atlases_staging[2];
-	ID3D11ShaderResourceView* atlases_srv[2];
-	D3D11_MAPPED_SUBRESOURCE atlases_mapped[2];
+	ID3D11Texture2D* atlases[UI_MAX_ATLAS_PAGES];
+	ID3D11ShaderResourceView* atlases_srv[UI_MAX_ATLAS_PAGES];
 
 	ID3D11Buffer* buffers[UI_MAX_BACKEND_BUFFERS];
-	D3D11_MAPPED_SUBRESOURCE buffers_mapped[UI_MAX_BACKEND_BUFFERS];
 } UI_DX11_State;
 
 static UI_DX11_State UI_DX11_STATE;
 
 static UI_TextureID UI_DX11_CreateAtlas(int atlas_id, uint32_t width, uint32_t height) {
-	D3D11_TEXTURE2D_DESC staging_desc = {0};
-	staging_desc.Width = width;
-	staging_desc.Height = height;
-	staging_desc.MipLevels = 1;
-	staging_desc.ArraySize = 1;
-	staging_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	staging_desc.SampleDesc.Count = 1;
-	staging_desc.Usage = D3D11_USAGE_STAGING;
-	staging_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-
-	ID3D11Texture2D* staging;
-	UI_DX11_STATE.device->CreateTexture2D(&staging_desc, NULL, &staging);
-
 	D3D11_TEXTURE2D_DESC tex_desc = {0};
 	tex_desc.Width = width;
 	tex_desc.Height = height;
@@ -84,7 +68,6 @@ static UI_TextureID UI_DX11_CreateAtlas(int atlas_id, uint32_t width, uint32_t h
 	UI_DX11_STATE.device->CreateShaderResourceView(texture, NULL, &texture_srv);
 
 	UI_DX11_STATE.atlases[atlas_id] = texture;
-	UI_DX11_STATE.atlases_staging[atlas_id] = staging;
 	UI_DX11_STATE.atlases_srv[atlas_id] = texture_srv;
 
 	return (UI_TextureID)texture_srv;
@@ -93,31 +76,22 @@ static UI_TextureID UI_DX11_CreateAtlas(int atlas_id, uint32_t width, uint32_t h
 static void UI_DX11_DestroyAtlas(int atlas_id) {
 	UI_DX11_STATE.atlases[atlas_id]->Release();
 	UI_DX11_STATE.atlases[atlas_id] = NULL;
-	UI_DX11_STATE.atlases_staging[atlas_id]->Release();
-	UI_DX11_STATE.atlases_staging[atlas_id] = NULL;
 	UI_DX11_STATE.atlases_srv[atlas_id]->Release();
 	UI_DX11_STATE.atlases_srv[atlas_id] = NULL;
 }
 
-static void* UI_DX11_AtlasMapUntilDraw(int atlas_id) {
-	D3D11_MAPPED_SUBRESOURCE* mapped = &UI_DX11_STATE.atlases_mapped[atlas_id];
-	if (mapped->pData == NULL) {
-		ID3D11Texture2D* staging = UI_DX11_STATE.atlases_staging[atlas_id];
-		UI_DX11_STATE.dc->Map(staging, 0, D3D11_MAP_WRITE, 0, mapped);
-		assert(mapped->pData != NULL);
-	}
-	return mapped->pData;
+static void UI_DX11_AtlasUpload(int atlas_id, uint32_t x, uint32_t y, uint32_t width, uint32_t height, const void* pixels) {
+	D3D11_BOX box = {x, y, 0, x + width, y + height, 1};
+	UI_DX11_STATE.dc->UpdateSubresource(UI_DX11_STATE.atlases[atlas_id], 0, &box, pixels, width * 4, 0);
 }
 
-static void* UI_DX11_BufferMapUntilDraw(int buffer_id) {
-	D3D11_MAPPED_SUBRESOURCE* mapped = &UI_DX11_STATE.buffers_mapped[buffer_id];
-	if (mapped->pData == NULL) {
-		ID3D11Buffer* buffer = UI_DX11_STATE.buffers[buffer_id];
-		UI_DX11_STATE.dc->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, mapped);
-		assert(mapped->pData != NULL);
-	}
-
-	return mapped->pData;
+static void UI_DX11_BufferUpload(int buffer_id, uint32_t offset, const void* data, uint32_t size, bool discard) {
+	ID3D11Buffer* buffer = UI_DX11_STATE.buffers[buffer_id];
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	UI_DX11_STATE.dc->Map(buffer, 0, discard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mapped);
+	assert(mapped.pData != NULL);
+	memcpy((char*)mapped.pData + offset, data, size);
+	UI_DX11_STATE.dc->Unmap(buffer, 0);
 }
 
 static void UI_DX11_CreateBuffer(int buffer_id, uint32_t size_in_bytes, D3D11_BIND_FLAG bind_flags) {
@@ -221,8 +195,8 @@ static void UI_DX11_Init(UI_Backend* backend, ID3D11Device* device, ID3D11Device
 	backend->create_atlas = UI_DX11_CreateAtlas;
 	backend->destroy_atlas = UI_DX11_DestroyAtlas;
 
-	backend->buffer_map_until_draw = UI_DX11_BufferMapUntilDraw;
-	backend->atlas_map_until_draw = UI_DX11_AtlasMapUntilDraw;
+	backend->atlas_upload = UI_DX11_AtlasUpload;
+	backend->buffer_upload = UI_DX11_BufferUpload;
 
 	UI_DX11_STATE = state;
 }
@@ -239,28 +213,6 @@ static void UI_DX11_Deinit(void) {
 }
 
 static void UI_DX11_Draw(UI_Outputs* outputs, ID3D11RenderTargetView* framebuffer_rtv) {
-	
-	for (int i = 0; i < 2; i++) {
-		if (UI_DX11_STATE.atlases_mapped[i].pData) {
-			ID3D11Texture2D* staging = UI_DX11_STATE.atlases_staging[i];
-			ID3D11Texture2D* dest = UI_DX11_STATE.atlases[i];
-			UI_DX11_STATE.dc->Unmap(staging, 0);
-
-			UI_DX11_STATE.dc->CopyResource(dest, staging);
-
-			memset(&UI_DX11_STATE.atlases_mapped[i], 0, sizeof(UI_DX11_STATE.atlases_mapped[i]));
-		}
-	}
-
-	for (int i = 0; i < UI_MAX_BACKEND_BUFFERS; i++) {
-		if (UI_DX11_STATE.buffers_mapped[i].pData) {
-			ID3D11Buffer* buffer = UI_DX11_STATE.buffers[i];
-			UI_DX11_STATE.dc->Unmap(buffer, 0);
-
-			memset(&UI_DX11_STATE.buffers_mapped[i], 0, sizeof(UI_DX11_STATE.buffers_mapped[i]));
-		}
-	}
-	
 	UINT stride = 2 * sizeof(float) + 2 * sizeof(float) + 4; // pos, uv, color
 	UINT offset = 0;
 	D3D11_VIEWPORT viewport = { 0.0f, 0.0f, UI_STATE.window_size.x, UI_STATE.window_size.y, 0.0f, 1.0f };
@@ -310,7 +262,7 @@ static void UI_DX11_Draw(UI_Outputs* outputs, ID3D11RenderTargetView* framebuffe
 		ID3D11ShaderResourceView* texture_srv = (ID3D11ShaderResourceView*)draw_call->texture;
 		assert(texture_srv != NULL);
 		UI_DX11_STATE.dc->PSSetShaderResources(0, 1, &texture_srv);
-		UI_DX11_STATE.dc->DrawIndexed(draw_call->index_count, draw_call->first_index, 0);
+		UI_DX11_STATE.dc->DrawIndexed(draw_call->index_count, draw_call->first_index, draw_call->base_vertex);
 	}
 
 }
@@ -206,7 +206,7 @@ UI_API void UI_AddFmt(UI_Key key, const char* fmt, ...) {
 					UI_AddValText(val_key, UI_SizeFlex(1.f), UI_SizeFit(), val);
 				} else {
 					UI_Text val = va_arg(args, UI_Text);
-					__debugbreak(); // TODO: read-only text
+					UI_TODO(); // read-only text
 					//UI_EditTextModify modify;
 					//UI_AddValText(val_key, UI_SizeFlex(1.f), UI_SizeFit(), &val);
 				}
@@ -293,8 +293,11 @@ UI_API void UI_AddFmt(UI_Key key, const char* fmt, ...) {
 			}
 		}
 		else {
-			STR_View character_str = { c, 1 };
-			STR_PrintV(&current_string, character_str);
+			const char* run_end = c + 1;
+			for (; *run_end && *run_end != '%'; ) run_end++;
+			STR_View run_str = { c, (int)(run_end - c) };
+			STR_PrintV(&current_string, run_str);
+			c = run_end - 1;
 		}
 	}
 
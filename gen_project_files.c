@@ -17,7 +17,25 @@ int main() {
 	BUILD_AddVisualStudioNatvisFile(&plant_growth, "../fire/fire.natvis");
 	BUILD_AddVisualStudioNatvisFile(&plant_growth, "../fire/fire.natstepfilter");
 	
-	BUILD_Project* projects[] = {&plant_growth};
+	BUILD_Project ui_benchmark;
+	BUILD_InitProject(&ui_benchmark, "ui_benchmark", &opts);
+	BUILD_AddIncludeDir(&ui_benchmark, "..");
+	BUILD_AddSourceFile(&ui_benchmark, "../src/ui_benchmark.cpp");
+	BUILD_AddVisualStudioNatvisFile(&ui_benchmark, "../fire/fire.natvis");
+	
+	BUILD_Project texture_compressor;
+	BUILD_InitProject(&texture_compressor, "texture_compressor", &opts);
+	BUILD_AddIncludeDir(&texture_compressor, "..");
+	BUILD_AddSourceFile(&texture_compressor, "../src/texture_compressor.cpp");
+	BUILD_AddVisualStudioNatvisFile(&texture_compressor, "../fire/fire.natvis");
+	
+	BUILD_Project fire_ds_tests;
+	BUILD_InitProject(&fire_ds_tests, "fire_ds_tests", &opts);
+	BUILD_AddIncludeDir(&fire_ds_tests, "..");
+	BUILD_AddSourceFile(&fire_ds_tests, "../src/fire_ds_tests.cpp");
+	BUILD_AddVisualStudioNatvisFile(&fire_ds_tests, "../fire/fire.natvis");
+	
+	BUILD_Project* projects[] = {&plant_growth, &ui_benchmark, &texture_compressor, &fire_ds_tests};
 	BUILD_CreateDirectory("build");
 	
 	if (!BUILD_CreateVisualStudioSolution("build", ".", "plant_growth.sln", projects, ArrCount(projects), BUILD_GetConsole())) {
@@ -1,19 +1,104 @@
 
+enum CurveInterpolation {
+	CurveInterpolation_Linear,
+	CurveInterpolation_CatmullRom, // passes through every control point
+	CurveInterpolation_Bezier, // the control points form a single bezier curve that passes through the first and the last point
+	CurveInterpolation_COUNT,
+};
+
+static const char* CurveInterpolationNames[] = {"Linear", "Catmull-Rom", "Bezier"};
+
+#define CURVE_CATMULL_ROM_SUBDIVISIONS 16
+#define CURVE_BEZIER_SUBDIVISIONS 64
+
 struct Curve {
-	// For now, just support linear interpolation. In the future I want this to support bezier curves and catmull-rom splines
+	CurveInterpolation interpolation;
+
 	// The points are points between (0, 0) and (1, 1) and must be sorted along the X axis from left to right.
 	DS_DynArray(HMM_Vec2) points;
+
+	// Piecewise linear approximation of the curve, sorted along the X axis. CurveEvalAtX only looks at this,
+	// so CurveBake must be called whenever `points` or `interpolation` is changed.
+	DS_DynArray(HMM_Vec2) baked_points;
 };
 
-static float CurveEvalAtX(const Curve* curve, float x) {
-	for (int i = 1; i < curve->points.count; i++) {
-		HMM_Vec2 p = curve->points[i];
-		if (x <= curve->points[i].X) {
-			HMM_Vec2 prev_p = curve->points[i - 1];
-			float t = (x - prev_p.X) / (p.X - prev_p.X);
-			float y = prev_p.Y + t * (p.Y - prev_p.Y);
-			return y;
+// `dst` must be initialized
+static void CurveCopy(Curve* dst, const Curve* src) {
+	dst->interpolation = src->interpolation;
+	DS_ArrClear(&dst->points);
+	DS_ArrPushN(&dst->points, src->points.data, src->points.count);
+	DS_ArrClear(&dst->baked_points);
+	DS_ArrPushN(&dst->baked_points, src->baked_points.data, src->baked_points.count);
+}
+
+static void CurveBake(Curve* curve) {
+	DS_ArrClear(&curve->baked_points);
+
+	int n = curve->points.count;
+	const HMM_Vec2* p = curve->points.data;
+
+	if (curve->interpolation == CurveInterpolation_Linear || n <= 2) {
+		DS_ArrPushN(&curve->baked_points, p, n);
+	}
+	else if (curve->interpolation == CurveInterpolation_CatmullRom) {
+		// Cubic hermite segments along X, with the tangents taken from the neighbouring points. Interpolating along X
+		// rather than along the curve parameter keeps the result a function of X.
+		DS_ArrPush(&curve->baked_points, p[0]);
+		for (int i = 0; i < n - 1; i++) {
+			HMM_Vec2 a = p[i], b = p[i + 1];
+			float dx = b.X - a.X;
+			if (dx <= 0.f) {
+				DS_ArrPush(&curve->baked_points, b);
+				continue;
+			}
+
+			HMM_Vec2 a_prev = p[HMM_MAX(i - 1, 0)], b_next = p[HMM_MIN(i + 2, n - 1)];
+			float a_tangent = a_prev.X < b.X ? (b.Y - a_prev.Y) / (b.X - a_prev.X) : 0.f;
+			float b_tangent = a.X < b_next.X ? (b_next.Y - a.Y) / (b_next.X - a.X) : 0.f;
+
+			for (int j = 1; j <= CURVE_CATMULL_ROM_SUBDIVISIONS; j++) {
+				float t = (float)j / (float)CURVE_CATMULL_ROM_SUBDIVISIONS;
+				float t2 = t*t, t3 = t2*t;
+				float y = (2.f*t3 - 3.f*t2 + 1.f)*a.Y + (t3 - 2.f*t2 + t)*dx*a_tangent + (-2.f*t3 + 3.f*t2)*b.Y + (t3 - t2)*dx*b_tangent;
+				DS_ArrPush(&curve->baked_points, HMM_V2(a.X + t*dx, HMM_Clamp(0.f, y, 1.f)));
+			}
+		}
+	}
+	else if (curve->interpolation == CurveInterpolation_Bezier) {
+		// Since the control points are sorted along X, so is the bezier curve.
+		DS_Scope scratch = DS_ScratchBegin(NULL, 0);
+		HMM_Vec2* temp = (HMM_Vec2*)DS_ArenaPush(scratch.arena, n*sizeof(HMM_Vec2));
+		for (int j = 0; j <= CURVE_BEZIER_SUBDIVISIONS; j++) {
+			float t = (float)j / (float)CURVE_BEZIER_SUBDIVISIONS;
+			memcpy(temp, p, n*sizeof(HMM_Vec2));
+			for (int level = n - 1; level > 0; level--) { // De Casteljau
+				for (int k = 0; k < level; k++) temp[k] = HMM_LerpV2(temp[k], t, temp[k + 1]);
+			}
+			DS_ArrPush(&curve->baked_points, temp[0]);
 		}
+		DS_ScratchEnd(&scratch);
 	}
-	return DS_ArrPeek(curve->points).Y;
+}
+
+static float CurveEvalAtX(const Curve* curve, float x) {
+	const HMM_Vec2* points = curve->baked_points.data;
+	int count = curve->baked_points.count;
+	assert(count > 0); // Did you forget to call CurveBake?
+
+	if (!(x <= points[count - 1].X)) return points[count - 1].Y; // also catches NaN
+
+	// Find the first point that is at or past `x`
+	int lo = 1, hi = count - 1;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (x <= points[mid].X) hi = mid;
+		else lo = mid + 1;
+	}
+
+	if (lo >= count) return points[count - 1].Y;
+	HMM_Vec2 p = points[lo];
+	HMM_Vec2 prev_p = points[lo - 1];
+	float t = (x - prev_p.X) / (p.X - prev_p.X);
+	float y = prev_p.Y + t * (p.Y - prev_p.Y);
+	return y;
 }
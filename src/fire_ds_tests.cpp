@@ -0,0 +1,83 @@
+// Checks for the bookkeeping of fire_ds arenas that the memory telemetry relies on. Exits with a nonzero code and prints
+// the failing check if anything is off.
+//
+// Usage: fire_ds_tests
+//
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "../Fire/fire_ds.h"
+
+static int g_failed_checks;
+
+#define CHECK(x) if (!(x)) { printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #x); g_failed_checks++; }
+
+// A DynArray that has to move out of an arena abandons its whole old allocation, not just the part that was in use
+static void TestDynArrayMoveCountsWaste(void) {
+	DS_Arena arena;
+	DS_ArenaInit(&arena, 4096, DS_HEAP);
+
+	DS_DynArray(int) array = {(DS_Allocator*)&arena};
+	for (int i = 0; i < 3; i++) DS_ArrPush(&array, i);
+	CHECK(array.capacity == 8);
+
+	// Keep the array from growing in place
+	DS_ArenaPush(&arena, 16);
+	int64_t wasted_before = arena.wasted_bytes;
+
+	DS_ArrReserve(&array, 9);
+	CHECK(array.capacity == 16);
+	CHECK(arena.wasted_bytes - wasted_before == 8 * (int64_t)sizeof(int));
+	for (int i = 0; i < 3; i++) CHECK(array.data[i] == i);
+
+	DS_ArenaDeinit(&arena);
+}
+
+// The most recent allocation grows in place, so nothing is wasted
+static void TestDynArrayGrowsInPlace(void) {
+	DS_Arena arena;
+	DS_ArenaInit(&arena, 4096, DS_HEAP);
+
+	DS_DynArray(int) array = {(DS_Allocator*)&arena};
+	DS_ArrPush(&array, 0);
+	int* first_data = array.data;
+	for (int i = 1; i < 100; i++) DS_ArrPush(&array, i);
+	CHECK(array.data == first_data);
+	CHECK(arena.wasted_bytes == 0);
+
+	DS_ArenaDeinit(&arena);
+}
+
+// A clone only has room for its elements, so growing it must not overwrite what was allocated after it
+static void TestDynArrayCloneGrowth(void) {
+	DS_Arena arena;
+	DS_ArenaInit(&arena, 4096, DS_HEAP);
+
+	DS_DynArray(int) array = {(DS_Allocator*)&arena};
+	for (int i = 0; i < 3; i++) DS_ArrPush(&array, i);
+	DS_ArrClone(&arena, &array);
+
+	int* after = (int*)DS_ArenaPush(&arena, 4 * sizeof(int));
+	for (int i = 0; i < 4; i++) after[i] = 100 + i;
+
+	for (int i = 3; i < 8; i++) DS_ArrPush(&array, i);
+	for (int i = 0; i < 4; i++) CHECK(after[i] == 100 + i);
+	for (int i = 0; i < 8; i++) CHECK(array.data[i] == i);
+
+	DS_ArenaDeinit(&arena);
+}
+
+int main() {
+	TestDynArrayMoveCountsWaste();
+	TestDynArrayGrowsInPlace();
+	TestDynArrayCloneGrowth();
+
+	if (g_failed_checks > 0) {
+		printf("%d checks failed\n", g_failed_checks);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
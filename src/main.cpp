@@ -18,6 +18,8 @@
 #include <dxgi1_3.h>
 #include <d3dcompiler.h>
 
+#define ALLOC_PROFILER_IMPLEMENTATION
+#include "utils/alloc_profiler.h" // only hooks DS_AllocatorFn if ALLOC_PROFILER_ENABLED is defined
 #include "../Fire/fire_ds.h"
 
 #define STR_USE_FIRE_DS_ARENA
@@ -29,6 +31,12 @@
 #define FIRE_OS_CLIPBOARD_IMPLEMENTATION
 #include "../Fire/fire_os_clipboard.h"
 
+#define FIRE_OS_SYNC_IMPLEMENTATION
+#include "../Fire/fire_os_sync.h"
+
+#define FIRE_OS_TIMING_IMPLEMENTATION
+#include "../Fire/fire_os_timing.h"
+
 #define STB_RECT_PACK_IMPLEMENTATION
 #define STB_TRUETYPE_IMPLEMENTATION
 #include "../Fire/fire_ui/stb_rect_pack.h"
@@ -46,6 +54,14 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "third_party/stb_image.h"
 
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "third_party/stb_image_write.h"
+
+#include "third_party/ddspp.h"
+
+#include "third_party/md.h"
+#include "third_party/md.c"
+
 #include "third_party/HandmadeMath.h"
 #include "utils/space_math.h"
 #include "utils/basic_3d_renderer/basic_3d_renderer.h"
@@ -53,6 +69,10 @@
 #include "utils/key_input/key_input.h"
 #include "utils/key_input/key_input_fire_os.h"
 #include "utils/fire_ui_backend_key_input.h"
+#include "utils/thread_pool.h"
+#include "utils/memory_telemetry.h"
+#include "utils/asset_loader.h"
+#include "utils/input_replay.h"
 
 #define CAMERA_VIEW_SPACE_IS_POSITIVE_Y_DOWN
 #include "utils/camera.h"
@@ -60,6 +80,7 @@
 #include "curves.h"
 #include "ui_extras.h"
 #include "plant_growth.h"
+#include "plant_presets.h"
 
 struct SimpleGPUMeshVertex {
 	HMM_Vec3 position;
@@ -84,6 +105,71 @@ struct SimpleGPUMesh {
 	B3R_Mesh gpu_mesh;
 };
 
+typedef DS_DynArray(SimpleGPUMeshVertex) MeshVertexList;
+typedef DS_DynArray(uint32_t) MeshIndexList;
+
+struct PlantMeshSnapshot {
+	// The vertices and indices grow side by side, so each list has an arena of its own. That way both lists are always
+	// the most recent allocation of their arena and can grow without being copied.
+	DS_Arena arena; // for `vertices`
+	DS_Arena index_arena;
+	MeshVertexList vertices;
+	MeshIndexList indices;
+};
+
+struct SimulationSettings {
+	PlantParameters params; // `apical_control_curve` is ignored, the curve is passed separately
+	bool simulating;
+	int forest_size; // number of plants per side
+	float forest_spacing;
+	float time_budget_ms; // per frame
+	int max_iterations_per_frame;
+
+	// A sweep forks the forest at its current age into variants with `ac_overall_factor` spread evenly between min and max
+	int sweep_variants_count;
+	float sweep_overall_factor_min;
+	float sweep_overall_factor_max;
+};
+
+struct SimulationStats {
+	int age; // growth iterations since reset
+	int iterations_last_frame;
+	float step_time_ms; // time spent growing and building the mesh on the last frame
+	float growth_time_ms; // the growing part of `step_time_ms`
+	float mesh_time_ms;   // the mesh building part of `step_time_ms`
+	int64_t scratch_peak_used; // highest scratch arena usage of a single thread while growing
+	int scratch_threads_count;
+};
+
+// The simulation runs on its own thread so that the editor's frame rate doesn't depend on the size of the forest.
+// Once per frame, the UI thread hands the latest settings over and the simulation thread runs as many growth iterations as
+// fit into the time budget. It then builds the plant mesh into whichever snapshot the UI thread isn't reading and publishes it.
+// The UI thread only ever holds `mutex` to copy data in and out, never while the simulation is doing work.
+//
+// In lockstep mode, the time budget is ignored and the UI thread waits for each step to finish before it picks up the mesh.
+// The plants then only depend on the inputs, which is what replays need.
+struct SimulationThread {
+	OS_SYNC_Thread thread;
+	OS_SYNC_Mutex mutex;
+	OS_SYNC_ConditionVar wake;
+	OS_SYNC_ConditionVar step_done; // signaled when `completed_frame_index` changes
+	bool lockstep; // set before the thread starts
+	
+	// -- Shared state, protected by `mutex` --
+	bool quit;
+	bool reset_requested;
+	bool sweep_requested;
+	uint64_t frame_index;
+	uint64_t completed_frame_index; // the last frame index that the simulation thread has finished a step for
+	SimulationSettings settings;
+	Curve apical_control_curve;
+	SimulationStats stats;
+
+	PlantMeshSnapshot snapshots[2];
+	int published_snapshot; // the latest snapshot that the UI thread hasn't picked up yet, or -1
+	int ui_snapshot;        // the snapshot that the UI thread is reading, or -1
+};
+
 //// Globals ///////////////////////////////////////////////
 
 static UI_Vec2 g_window_size = {1000, 800};
@@ -103,19 +189,42 @@ static INPUT_Frame g_inputs;
 static DS_Arena g_persist_arena;
 static DS_Arena g_temp_arena;
 
+static ThreadPool g_thread_pool;
+
 static Camera g_camera;
 
 static Curve g_apical_control_curve;
 
-static PlantParameters g_plant_params = {};
 static DS_Arena g_plant_arena;
-static Plant g_plant;
+static Forest g_forest; // owned by the simulation thread
+static SimulationSettings g_sim_settings = {{}, true, 1, 0.5f, 8.f, 16, 5, 0.005f, 0.02f};
+static SimulationThread g_sim_thread;
+
+static AssetLoader g_asset_loader;
+static bool g_assets_ready; // the simulation thread runs once all assets have been loaded
+static DS_DynArray(AssetLoader_Asset*) g_mesh_assets; // the imported meshes live in the arenas of these assets
 
 static bool g_has_plant_mesh;
 static B3R_Mesh g_plant_gpu_mesh;
 
 static B3R_WireMesh g_grid_mesh;
 
+// Memory telemetry groups, by the thread that samples them
+enum MemGroup {
+	MemGroup_Main,
+	MemGroup_Simulation,
+};
+
+static void SampleForestPlantsMemory(void* object, MemTelemetry_Usage* out_usage) {
+	Forest* forest = (Forest*)object;
+	for (int i = 0; i < forest->plants.count; i++) {
+		MemTelemetry_Usage usage = MemTelemetry_ArenaUsage(forest->plants[i]->arena);
+		out_usage->used += usage.used;
+		out_usage->reserved += usage.reserved;
+		out_usage->wasted += usage.wasted;
+	}
+}
+
 static ImportedMesh g_imported_mesh_unit_cube;
 static ImportedMesh g_imported_mesh_bud;
 static ImportedMesh g_imported_mesh_leaf;
@@ -159,25 +268,45 @@ static STR_View ReadEntireFile(DS_Arena* arena, const char* file) {
 //	}
 //}
 
+// Returns the elements of an accessor as floats, `components` floats per element. If the accessor is tightly packed float
+// data, the result points directly into the glTF buffer. Otherwise, e.g. for interleaved, normalized or quantized
+// (KHR_mesh_quantization) accessors, the elements are converted into an array allocated from `arena`.
+// Returns NULL if the accessor can't be read.
+static const float* ImportAccessorFloats(DS_Arena* arena, const cgltf_accessor* accessor, int components) {
+	if (cgltf_num_components(accessor->type) != (cgltf_size)components) return NULL;
+
+	bool is_tightly_packed_float = accessor->component_type == cgltf_component_type_r_32f && !accessor->is_sparse &&
+		accessor->buffer_view != NULL && accessor->stride == components * sizeof(float);
+	if (is_tightly_packed_float) {
+		const uint8_t* data = cgltf_buffer_view_data(accessor->buffer_view);
+		return data ? (const float*)(data + accessor->offset) : NULL;
+	}
+
+	cgltf_size floats_count = accessor->count * components;
+	float* result = (float*)DS_ArenaPushEx(arena, (int)(floats_count * sizeof(float)), 16);
+	bool ok = cgltf_accessor_unpack_floats(accessor, result, floats_count) == floats_count;
+	return ok ? result : NULL;
+}
+
 static bool ImportMeshAddMorph(DS_Arena* arena, ImportedMesh* result, cgltf_attribute* attributes, int attributes_count) {
-	HMM_Vec3* positions_data = NULL;
-	HMM_Vec3* normals_data = NULL;
-	HMM_Vec2* texcoords_data = NULL;
+	DS_Scope scratch = DS_ScratchBegin(&arena, 1);
+
+	const float* positions_data = NULL;
+	const float* normals_data = NULL;
+	const float* texcoords_data = NULL;
 
 	uint32_t num_vertices = (uint32_t)attributes[0].data->count;
 
 	for (int i = 0; i < attributes_count; i++) {
 		cgltf_attribute* attribute = &attributes[i];
-		void* attribute_data = (char*)attribute->data->buffer_view->buffer->data + attribute->data->buffer_view->offset;
-
 		assert(attribute->data->count == num_vertices);
 
 		if (attribute->type == cgltf_attribute_type_position) {
-			positions_data = (HMM_Vec3*)attribute_data;
+			positions_data = ImportAccessorFloats(scratch.arena, attribute->data, 3);
 		} else if (attribute->type == cgltf_attribute_type_normal) {
-			normals_data = (HMM_Vec3*)attribute_data;
-		} else if (attribute->type == cgltf_attribute_type_texcoord) {
-			texcoords_data = (HMM_Vec2*)attribute_data;
+			normals_data = ImportAccessorFloats(scratch.arena, attribute->data, 3);
+		} else if (attribute->type == cgltf_attribute_type_texcoord && attribute->index == 0) {
+			texcoords_data = ImportAccessorFloats(scratch.arena, attribute->data, 2);
 		}
 	}
 
@@ -185,26 +314,30 @@ static bool ImportMeshAddMorph(DS_Arena* arena, ImportedMesh* result, cgltf_attr
 	if (ok) {
 		ImportedMeshMorphTarget morph{};
 		DS_ArrInit(&morph.vertices, arena);
-		DS_ArrReserve(&morph.vertices, num_vertices);
+		DS_ArrResizeUndef(&morph.vertices, (int)num_vertices);
 
+		// Convert all vertices in one pass straight into the preallocated array.
+		// In GLTF, Y is up, but we want Z up.
+		SimpleGPUMeshVertex* vertices = morph.vertices.data;
 		for (uint32_t i = 0; i < num_vertices; i++) {
-			HMM_Vec3 position = positions_data[i];
-			HMM_Vec3 normal = normals_data[i];
-			HMM_Vec2 uv = texcoords_data ? texcoords_data[i] : HMM_Vec2{0, 0};
-		
-			// In GLTF, Y is up, but we want Z up.
-			position = {position.X, -position.Z, position.Y};
-			normal = {-normal.X, normal.Z, -normal.Y};
-
-			DS_ArrPush(&morph.vertices, {position, normal, uv, 255, 255, 255, 255});
+			const float* position = &positions_data[i * 3];
+			const float* normal = &normals_data[i * 3];
+			vertices[i].position = {position[0], -position[2], position[1]};
+			vertices[i].normal = {-normal[0], normal[2], -normal[1]};
+			vertices[i].uv = texcoords_data ? HMM_Vec2{texcoords_data[i * 2], texcoords_data[i * 2 + 1]} : HMM_Vec2{0, 0};
+			vertices[i].color_rgba = 0xFFFFFFFF;
 		}
-	
+
 		DS_ArrPush(&result->vertices_morphs, morph);
 	}
+
+	DS_ScratchEnd(&scratch);
 	return ok;
 }
 
-static ImportedMesh ImportMesh(DS_Arena* arena, const char* filepath) {
+// `source` is the contents of the glTF file. For a .glb file, the binary chunk is read from `source` directly, so it must
+// stay alive while importing. `filepath` is only used to locate external buffers.
+static ImportedMesh ImportMeshFromMemory(DS_Arena* arena, const char* filepath, STR_View source) {
 	ImportedMesh result{};
 	DS_ArrInit(&result.vertices_morphs, arena);
 	DS_ArrInit(&result.indices, arena);
@@ -213,7 +346,7 @@ static ImportedMesh ImportMesh(DS_Arena* arena, const char* filepath) {
 	cgltf_data* data = NULL;
 
 	bool ok = true;
-	ok = cgltf_parse_file(&options, filepath, &data) == cgltf_result_success;
+	ok = cgltf_parse(&options, source.data, (cgltf_size)source.size, &data) == cgltf_result_success;
 	ok = ok && cgltf_load_buffers(&options, data, filepath) == cgltf_result_success;
 	ok = ok && cgltf_validate(data) == cgltf_result_success;
 	ok = ok && data->meshes_count == 1 && data->meshes[0].primitives_count == 1;
@@ -222,21 +355,13 @@ static ImportedMesh ImportMesh(DS_Arena* arena, const char* filepath) {
 		cgltf_mesh* mesh = &data->meshes[0];
 		cgltf_primitive* primitive = &mesh->primitives[0];
 
+		// Handles 8, 16 and 32 bit indices with any stride. Tightly packed 32 bit indices are copied with a single memcpy.
 		cgltf_accessor* indices = primitive->indices;
-		DS_ArrResizeUndef(&result.indices, (int)indices->count);
-
-		void* primitive_indices = (char*)indices->buffer_view->buffer->data + indices->buffer_view->offset;
-		if (indices->component_type == cgltf_component_type_r_16u) {
-			for (cgltf_size i = 0; i < indices->count; i++) {
-				result.indices[i] = ((uint16_t*)primitive_indices)[i];
-			}
-		}
-		else if (indices->component_type == cgltf_component_type_r_32u) {
-			for (cgltf_size i = 0; i < indices->count; i++) {
-				result.indices[i] = ((uint32_t*)primitive_indices)[i];
-			}
+		ok = indices != NULL;
+		if (ok) {
+			DS_ArrResizeUndef(&result.indices, (int)indices->count);
+			ok = cgltf_accessor_unpack_indices(indices, (cgltf_uint*)result.indices.data, indices->count) == indices->count;
 		}
-		else assert(0);
 
 		ok = ok && ImportMeshAddMorph(arena, &result, primitive->attributes, (int)primitive->attributes_count);
 			
@@ -251,52 +376,348 @@ static ImportedMesh ImportMesh(DS_Arena* arena, const char* filepath) {
 	return result;
 }
 
+static ImportedMesh ImportMesh(DS_Arena* arena, const char* filepath) {
+	DS_Scope scratch = DS_ScratchBegin(&arena, 1);
+	ImportedMesh result = ImportMeshFromMemory(arena, filepath, ReadEntireFile(scratch.arena, filepath));
+	DS_ScratchEnd(&scratch);
+	return result;
+}
+
+// -- Baked mesh cache --
+// Importing a glTF file means parsing JSON and converting every vertex of every morph target, so the result is baked into
+// a `.meshcache` file next to the source file. The cache is keyed by a hash of the source file, so it's rebuilt whenever
+// the source changes. A valid cache file is mapped into memory and the ImportedMesh arrays point straight into the mapping.
+
+#define MESH_CACHE_MAGIC 0x48534D50 // "PMSH"
+#define MESH_CACHE_VERSION 2 // bump this whenever the import conversion or the vertex format changes
+
+struct MeshCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t source_hash;
+	uint32_t vertex_size; // sizeof(SimpleGPUMeshVertex)
+	uint32_t morphs_count;
+	uint32_t vertices_count; // per morph target
+	uint32_t indices_count;
+	// Followed by `vertices_count` vertices for each morph target, then `indices_count` indices
+};
+
+// Returns NULL if the file doesn't exist or is empty. The view is never unmapped, it stays valid until the program exits.
+static void* MapFileReadOnly(const char* filepath, uint64_t* out_size) {
+	HANDLE file = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return NULL;
+
+	LARGE_INTEGER size = {};
+	GetFileSizeEx(file, &size);
+
+	void* data = NULL;
+	HANDLE mapping = size.QuadPart > 0 ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+	if (mapping) {
+		data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping); // the view keeps the mapping alive
+	}
+	CloseHandle(file);
+
+	*out_size = (uint64_t)size.QuadPart;
+	return data;
+}
+
+static bool LoadMeshCache(DS_Arena* arena, const char* cache_path, uint64_t source_hash, ImportedMesh* out_mesh) {
+	uint64_t size;
+	char* data = (char*)MapFileReadOnly(cache_path, &size);
+	if (data == NULL) return false;
+
+	MeshCacheHeader header;
+	bool ok = size >= sizeof(header);
+	if (ok) {
+		memcpy(&header, data, sizeof(header));
+		ok = header.magic == MESH_CACHE_MAGIC && header.version == MESH_CACHE_VERSION &&
+			header.source_hash == source_hash && header.vertex_size == sizeof(SimpleGPUMeshVertex) && header.morphs_count > 0;
+	}
+	if (ok) {
+		uint64_t expected_size = sizeof(header) + (uint64_t)header.morphs_count * header.vertices_count * sizeof(SimpleGPUMeshVertex) +
+			(uint64_t)header.indices_count * sizeof(uint32_t);
+		ok = size == expected_size;
+	}
+	if (!ok) {
+		UnmapViewOfFile(data);
+		return false;
+	}
+
+	// The arrays borrow the mapped memory. It's read-only, so the arrays must never be pushed to or modified.
+	ImportedMesh result{};
+	DS_ArrInit(&result.vertices_morphs, arena);
+	DS_ArrReserve(&result.vertices_morphs, (int)header.morphs_count);
+
+	SimpleGPUMeshVertex* vertices = (SimpleGPUMeshVertex*)(data + sizeof(header));
+	for (uint32_t i = 0; i < header.morphs_count; i++) {
+		ImportedMeshMorphTarget morph{};
+		morph.vertices.allocator = arena;
+		morph.vertices.data = vertices + (uint64_t)i * header.vertices_count;
+		morph.vertices.count = (int)header.vertices_count;
+		morph.vertices.capacity = (int)header.vertices_count;
+		DS_ArrPush(&result.vertices_morphs, morph);
+	}
+
+	result.indices.allocator = arena;
+	result.indices.data = (uint32_t*)(vertices + (uint64_t)header.morphs_count * header.vertices_count);
+	result.indices.count = (int)header.indices_count;
+	result.indices.capacity = (int)header.indices_count;
+
+	*out_mesh = result;
+	return true;
+}
+
+static void WriteMeshCache(const char* cache_path, uint64_t source_hash, const ImportedMesh* mesh) {
+	FILE* f = fopen(cache_path, "wb");
+	if (f == NULL) return; // no cache then, e.g. the resources directory is read-only
+
+	MeshCacheHeader header = {};
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.vertex_size = sizeof(SimpleGPUMeshVertex);
+	header.morphs_count = (uint32_t)mesh->vertices_morphs.count;
+	header.vertices_count = (uint32_t)mesh->vertices_morphs[0].vertices.count;
+	header.indices_count = (uint32_t)mesh->indices.count;
+
+	// The header is written with a zero source hash first and patched at the end, so that a partially written file never
+	// passes as a valid cache.
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	for (int i = 0; i < mesh->vertices_morphs.count; i++) {
+		const ImportedMeshMorphTarget* morph = &mesh->vertices_morphs.data[i];
+		assert(morph->vertices.count == (int)header.vertices_count);
+		ok = ok && fwrite(morph->vertices.data, sizeof(SimpleGPUMeshVertex), morph->vertices.count, f) == (size_t)morph->vertices.count;
+	}
+	ok = ok && fwrite(mesh->indices.data, sizeof(uint32_t), mesh->indices.count, f) == (size_t)mesh->indices.count;
+
+	if (ok) {
+		header.source_hash = source_hash;
+		fseek(f, 0, SEEK_SET);
+		fwrite(&header, sizeof(header), 1, f);
+	}
+	fclose(f);
+}
+
+// Like ImportMeshFromMemory, but loads the mesh from its baked cache file when the cache is up to date, and rebuilds the
+// cache otherwise.
+static ImportedMesh ImportMeshCached(DS_Arena* arena, const char* filepath, STR_View source) {
+	DS_Scope scratch = DS_ScratchBegin(&arena, 1);
+
+	uint64_t source_hash = DS_MurmurHash64A(source.data, (int)source.size, MESH_CACHE_VERSION);
+	char* cache_path = STR_ToC(scratch.arena, STR_Form(scratch.arena, "%s.meshcache", filepath));
+
+	ImportedMesh result;
+	if (!LoadMeshCache(arena, cache_path, source_hash, &result)) {
+		result = ImportMeshFromMemory(arena, filepath, source);
+		WriteMeshCache(cache_path, source_hash, &result);
+	}
+
+	DS_ScratchEnd(&scratch);
+	return result;
+}
+
 static void MeshInitFromFile(B3R_Mesh* result, const char* filepath) {
 	ImportedMesh mesh = ImportMesh(&g_temp_arena, filepath);
 	ImportedMeshMorphTarget main_morph = DS_ArrGet(mesh.vertices_morphs, 0);
 	B3R_MeshInit(result, B3R_VertexLayout_PosNorUVCol, main_morph.vertices.data, main_morph.vertices.count, mesh.indices.data, mesh.indices.count);
 }
 
-typedef DS_DynArray(SimpleGPUMeshVertex) MeshVertexList;
-typedef DS_DynArray(uint32_t) MeshIndexList;
-
 static void MeshBuilderAddQuad(MeshIndexList* list, uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
 	DS_ArrPush(list, a); DS_ArrPush(list, b); DS_ArrPush(list, c);
 	DS_ArrPush(list, a); DS_ArrPush(list, c); DS_ArrPush(list, d);
 }
 
-static void MeshBuilderAddImportedMesh(MeshVertexList* vertices, MeshIndexList* indices, ImportedMesh* imported_mesh,
-	const HMM_Vec3* position, const HMM_Mat3* rot_scale, float morph_amount, uint32_t color)
-{
-	ImportedMeshMorphTarget base_morph = DS_ArrGet(imported_mesh->vertices_morphs, 0);
-	
-	uint32_t first_vertex = (uint32_t)vertices->count;
-	for (int i = 0; i < base_morph.vertices.count; i++) {
-		SimpleGPUMeshVertex vert = base_morph.vertices[i];
-		
-		if (morph_amount > 0.f) {
-			assert(imported_mesh->vertices_morphs.count > 1);
-			ImportedMeshMorphTarget second_morph = DS_ArrGet(imported_mesh->vertices_morphs, 1);
-			SimpleGPUMeshVertex second_vert = second_morph.vertices[i];
-		
-			vert.position += morph_amount * second_vert.position;
-			vert.normal += morph_amount * second_vert.normal;
+// -- Leaf mesh kernel --
+// Leaves make up most of the plant mesh. Every leaf is the same imported mesh, blended towards its second morph target by
+// `leaf_growth` and then transformed onto its bud. Instead of doing that one vertex at a time while walking the plant, the
+// leaves of a plant are collected into a list and built in one batch. The leaf mesh is kept in SoA form, padded to a
+// multiple of 4 vertices, so that the blend and the transform run on 4 vertices at a time.
+//
+// With LEAF_MORPH_STAGES > 0, leaf growth is quantized into that many stages and the blended mesh of each stage is
+// precomputed, so building a growing leaf is a table lookup and a transform. Set it to 0 to blend every leaf exactly.
+
+#define LEAF_MORPH_STAGES 16
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LEAF_KERNEL_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+struct LeafVerticesSoA {
+	float* position[3]; // X, Y and Z, each `vertices_count_padded` floats aligned to 16 bytes
+	float* normal[3];
+};
+
+struct LeafMesh {
+	int vertices_count;
+	int vertices_count_padded; // rounded up to a multiple of 4. The padding vertices are zero and never written out.
+	LeafVerticesSoA base;
+	LeafVerticesSoA morph; // added on top of `base`, scaled by the leaf growth
+	LeafVerticesSoA* stages; // LEAF_MORPH_STAGES blended copies of the mesh, stage i is grown by (i + 1) / LEAF_MORPH_STAGES
+	HMM_Vec2* uvs;
+	const uint32_t* indices;
+	int indices_count;
+};
+
+struct LeafInstance {
+	HMM_Mat3 rot_scale;
+	HMM_Vec3 position;
+	float growth;
+	uint32_t color;
+};
+
+typedef DS_DynArray(LeafInstance) LeafInstanceList;
+
+static LeafMesh g_leaf_mesh; // built from g_imported_mesh_leaf
+
+static void LeafVerticesAlloc(DS_Arena* arena, LeafVerticesSoA* vertices, int vertices_count_padded) {
+	int size = vertices_count_padded * (int)sizeof(float);
+	for (int c = 0; c < 3; c++) {
+		vertices->position[c] = (float*)DS_ArenaPushEx(arena, size, 16);
+		vertices->normal[c] = (float*)DS_ArenaPushEx(arena, size, 16);
+		memset(vertices->position[c], 0, size);
+		memset(vertices->normal[c], 0, size);
+	}
+}
+
+// out[i] = a[i] + t * b[i], where `count` is a multiple of 4
+static void LeafBlendStream(float* out, const float* a, const float* b, float t, int count) {
+#ifdef LEAF_KERNEL_USE_SSE
+	__m128 t4 = _mm_set1_ps(t);
+	for (int i = 0; i < count; i += 4) {
+		_mm_store_ps(out + i, _mm_add_ps(_mm_load_ps(a + i), _mm_mul_ps(t4, _mm_load_ps(b + i))));
+	}
+#else
+	for (int i = 0; i < count; i++) out[i] = a[i] + t * b[i];
+#endif
+}
+
+static void LeafVerticesBlend(const LeafMesh* mesh, float growth, LeafVerticesSoA* out) {
+	for (int c = 0; c < 3; c++) {
+		LeafBlendStream(out->position[c], mesh->base.position[c], mesh->morph.position[c], growth, mesh->vertices_count_padded);
+		LeafBlendStream(out->normal[c], mesh->base.normal[c], mesh->morph.normal[c], growth, mesh->vertices_count_padded);
+	}
+}
+
+// `imported_mesh` must have at least two morph targets and must outlive the leaf mesh, as its indices are referenced.
+static void LeafMeshInit(LeafMesh* mesh, DS_Arena* arena, const ImportedMesh* imported_mesh) {
+	assert(imported_mesh->vertices_morphs.count > 1);
+	const ImportedMeshMorphTarget* base_morph = &imported_mesh->vertices_morphs.data[0];
+	const ImportedMeshMorphTarget* second_morph = &imported_mesh->vertices_morphs.data[1];
+
+	memset(mesh, 0, sizeof(*mesh));
+	mesh->vertices_count = base_morph->vertices.count;
+	mesh->vertices_count_padded = (mesh->vertices_count + 3) & ~3;
+	mesh->indices = imported_mesh->indices.data;
+	mesh->indices_count = imported_mesh->indices.count;
+
+	LeafVerticesAlloc(arena, &mesh->base, mesh->vertices_count_padded);
+	LeafVerticesAlloc(arena, &mesh->morph, mesh->vertices_count_padded);
+	mesh->uvs = (HMM_Vec2*)DS_ArenaPush(arena, mesh->vertices_count * (int)sizeof(HMM_Vec2));
+
+	for (int i = 0; i < mesh->vertices_count; i++) {
+		const SimpleGPUMeshVertex* base_vert = &base_morph->vertices.data[i];
+		const SimpleGPUMeshVertex* second_vert = &second_morph->vertices.data[i];
+		for (int c = 0; c < 3; c++) {
+			mesh->base.position[c][i] = base_vert->position.Elements[c];
+			mesh->base.normal[c][i] = base_vert->normal.Elements[c];
+			mesh->morph.position[c][i] = second_vert->position.Elements[c];
+			mesh->morph.normal[c][i] = second_vert->normal.Elements[c];
 		}
+		mesh->uvs[i] = base_vert->uv;
+	}
 
-		vert.position = *position + HMM_MulM3V3(*rot_scale, vert.position);
-		vert.normal = HMM_MulM3V3(*rot_scale, vert.normal);
+#if LEAF_MORPH_STAGES > 0
+	mesh->stages = (LeafVerticesSoA*)DS_ArenaPush(arena, LEAF_MORPH_STAGES * (int)sizeof(LeafVerticesSoA));
+	for (int i = 0; i < LEAF_MORPH_STAGES; i++) {
+		LeafVerticesAlloc(arena, &mesh->stages[i], mesh->vertices_count_padded);
+		LeafVerticesBlend(mesh, (float)(i + 1) / (float)LEAF_MORPH_STAGES, &mesh->stages[i]);
+	}
+#endif
+}
+
+// Transforms the vertices of `src` onto `leaf` and writes them into `out`, which has room for `mesh->vertices_count` vertices
+static void LeafVerticesTransform(const LeafMesh* mesh, const LeafVerticesSoA* src, const LeafInstance* leaf, SimpleGPUMeshVertex* out) {
+	const HMM_Mat3* m = &leaf->rot_scale;
+#ifdef LEAF_KERNEL_USE_SSE
+	__m128 m_cols[3][3];
+	for (int col = 0; col < 3; col++) {
+		for (int row = 0; row < 3; row++) m_cols[col][row] = _mm_set1_ps(m->Columns[col].Elements[row]);
+	}
+	__m128 offset[3] = {_mm_set1_ps(leaf->position.X), _mm_set1_ps(leaf->position.Y), _mm_set1_ps(leaf->position.Z)};
+
+	alignas(16) float lanes[6][4]; // transformed position XYZ and normal XYZ of 4 vertices
+	for (int i = 0; i < mesh->vertices_count_padded; i += 4) {
+		__m128 px = _mm_load_ps(src->position[0] + i), py = _mm_load_ps(src->position[1] + i), pz = _mm_load_ps(src->position[2] + i);
+		__m128 nx = _mm_load_ps(src->normal[0] + i), ny = _mm_load_ps(src->normal[1] + i), nz = _mm_load_ps(src->normal[2] + i);
+		for (int row = 0; row < 3; row++) {
+			__m128 p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m_cols[0][row], px), _mm_mul_ps(m_cols[1][row], py)), _mm_mul_ps(m_cols[2][row], pz));
+			__m128 n = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m_cols[0][row], nx), _mm_mul_ps(m_cols[1][row], ny)), _mm_mul_ps(m_cols[2][row], nz));
+			_mm_store_ps(lanes[row], _mm_add_ps(offset[row], p));
+			_mm_store_ps(lanes[3 + row], n);
+		}
 
-		vert.color_rgba = color;
-		DS_ArrPush(vertices, vert);
+		int lanes_count = mesh->vertices_count - i < 4 ? mesh->vertices_count - i : 4;
+		for (int lane = 0; lane < lanes_count; lane++) {
+			SimpleGPUMeshVertex* vert = &out[i + lane];
+			vert->position = {lanes[0][lane], lanes[1][lane], lanes[2][lane]};
+			vert->normal = {lanes[3][lane], lanes[4][lane], lanes[5][lane]};
+			vert->uv = mesh->uvs[i + lane];
+			vert->color_rgba = leaf->color;
+		}
+	}
+#else
+	for (int i = 0; i < mesh->vertices_count; i++) {
+		HMM_Vec3 position = {src->position[0][i], src->position[1][i], src->position[2][i]};
+		HMM_Vec3 normal = {src->normal[0][i], src->normal[1][i], src->normal[2][i]};
+		out[i].position = leaf->position + HMM_MulM3V3(*m, position);
+		out[i].normal = HMM_MulM3V3(*m, normal);
+		out[i].uv = mesh->uvs[i];
+		out[i].color_rgba = leaf->color;
 	}
+#endif
+}
 
-	for (int i = 0; i < imported_mesh->indices.count; i++) {
-		uint32_t src_idx = imported_mesh->indices[i];
-		DS_ArrPush(indices, src_idx + first_vertex);
+static void MeshBuilderAddLeaves(MeshVertexList* vertices, MeshIndexList* indices, const LeafMesh* mesh, const LeafInstance* leaves, int leaves_count) {
+	if (leaves_count == 0) return;
+
+	int first_vertex = vertices->count;
+	int first_index = indices->count;
+	DS_ArrResizeUndef(vertices, first_vertex + leaves_count * mesh->vertices_count);
+	DS_ArrResizeUndef(indices, first_index + leaves_count * mesh->indices_count);
+
+#if LEAF_MORPH_STAGES == 0
+	DS_Scope scratch = DS_ScratchBegin(NULL, 0);
+	LeafVerticesSoA blended;
+	LeafVerticesAlloc(scratch.arena, &blended, mesh->vertices_count_padded);
+#endif
+
+	for (int i = 0; i < leaves_count; i++) {
+		const LeafInstance* leaf = &leaves[i];
+#if LEAF_MORPH_STAGES > 0
+		int stage = (int)(leaf->growth * (float)LEAF_MORPH_STAGES + 0.5f) - 1; // round to the nearest stage
+		stage = stage < 0 ? 0 : stage >= LEAF_MORPH_STAGES ? LEAF_MORPH_STAGES - 1 : stage;
+		const LeafVerticesSoA* src = &mesh->stages[stage];
+#else
+		LeafVerticesBlend(mesh, leaf->growth, &blended);
+		const LeafVerticesSoA* src = &blended;
+#endif
+		uint32_t leaf_first_vertex = (uint32_t)(first_vertex + i * mesh->vertices_count);
+		LeafVerticesTransform(mesh, src, leaf, &vertices->data[leaf_first_vertex]);
+
+		uint32_t* leaf_indices = &indices->data[first_index + i * mesh->indices_count];
+		for (int j = 0; j < mesh->indices_count; j++) {
+			leaf_indices[j] = mesh->indices[j] + leaf_first_vertex;
+		}
 	}
+
+#if LEAF_MORPH_STAGES == 0
+	DS_ScratchEnd(&scratch);
+#endif
 }
 
-static void RegeneratePlantMeshStep(Plant* plant, MeshVertexList* vertices, MeshIndexList* indices, Bud* bud) {
+// Leaves are only collected into `leaves`, to be built afterwards by MeshBuilderAddLeaves
+static void RegeneratePlantMeshStep(Plant* plant, MeshVertexList* vertices, MeshIndexList* indices, LeafInstanceList* leaves, Bud* bud) {
 	if (bud->leaf_growth > 0.f) {
 		// TODO: the leaf generation could be optimized by caching COMPLETE leaves! We could have one mesh which is "complete leaves" mesh, and another which is
 		// "in-progress" stuff + the branches. In fact, we could even cache completed branches! The mesh generation would become a lot faster. We should have them as completely separate renderable meshes as well just so we don't need to do index buffer copy stuff.
@@ -312,8 +733,12 @@ static void RegeneratePlantMeshStep(Plant* plant, MeshVertexList* vertices, Mesh
 		HMM_Vec3 color = HMM_LerpV3({40, 100, 30}, lightness, {150, 255, 90});
 		uint32_t color_u32 = (uint32_t)color.R | (uint32_t)color.G << 8 | (uint32_t)color.B << 16 | 255 << 24;
 
-		HMM_Mat3 rot_scale = HMM_QToM3(bud->base_rotation, 0.125f);
-		MeshBuilderAddImportedMesh(vertices, indices, &g_imported_mesh_leaf, &bud->base_point, &rot_scale, bud->leaf_growth, color_u32);
+		LeafInstance leaf;
+		leaf.rot_scale = HMM_QToM3(bud->base_rotation, 0.125f);
+		leaf.position = bud->base_point;
+		leaf.growth = bud->leaf_growth;
+		leaf.color = color_u32;
+		DS_ArrPush(leaves, leaf);
 	}
 
 	if (bud->segments.count > 0) {
@@ -327,7 +752,7 @@ static void RegeneratePlantMeshStep(Plant* plant, MeshVertexList* vertices, Mesh
 			} else {
 				segment = &bud->segments[j];
 				if (segment->end_lateral) {
-					RegeneratePlantMeshStep(plant, vertices, indices, segment->end_lateral);
+					RegeneratePlantMeshStep(plant, vertices, indices, leaves, segment->end_lateral);
 				}
 				base_point = segment->end_point;
 			}
@@ -367,19 +792,564 @@ static void RegeneratePlantMeshStep(Plant* plant, MeshVertexList* vertices, Mesh
 	}
 }
 
-static void RegeneratePlantMesh() {
-	MeshVertexList vertices = {&g_temp_arena};
-	MeshIndexList indices = {&g_temp_arena};
-	RegeneratePlantMeshStep(&g_plant, &vertices, &indices, &g_plant.root);
+static void RegeneratePlantMeshAddForest(PlantMeshSnapshot* snapshot, Forest* forest, HMM_Vec3 offset) {
+	DS_Scope scratch = DS_ScratchBegin(NULL, 0);
+	LeafInstanceList leaves = {scratch.arena};
+
+	int first_vertex = snapshot->vertices.count;
+	for (int i = 0; i < forest->plants.count; i++) {
+		Plant* plant = forest->plants[i];
+		leaves.count = 0;
+		RegeneratePlantMeshStep(plant, &snapshot->vertices, &snapshot->indices, &leaves, &plant->root);
+		MeshBuilderAddLeaves(&snapshot->vertices, &snapshot->indices, &g_leaf_mesh, leaves.data, leaves.count);
+	}
+	for (int i = first_vertex; i < snapshot->vertices.count; i++) {
+		snapshot->vertices[i].position += offset;
+	}
+
+	DS_ScratchEnd(&scratch);
+}
+
+// When sweeping, the variants are laid out side by side along the X axis instead of showing the forest
+static void RegeneratePlantMesh(PlantMeshSnapshot* snapshot, ForestSweep* sweep, const SimulationSettings* settings) {
+	DS_ArenaReset(&snapshot->arena);
+	DS_ArenaReset(&snapshot->index_arena);
+	snapshot->vertices = {&snapshot->arena};
+	snapshot->indices = {&snapshot->index_arena};
+	
+	if (sweep) {
+		float stride = (float)settings->forest_size * settings->forest_spacing + 0.5f;
+		for (int i = 0; i < sweep->variants.count; i++) {
+			float x = ((float)i - 0.5f*(float)(sweep->variants.count - 1)) * stride;
+			RegeneratePlantMeshAddForest(snapshot, &sweep->variants[i]->forest, {x, 0.f, 0.f});
+		}
+	} else {
+		RegeneratePlantMeshAddForest(snapshot, &g_forest, {});
+	}
+}
 
+static void UploadPlantMesh(const PlantMeshSnapshot* snapshot) {
 	if (g_has_plant_mesh) {
 		B3R_MeshDeinit(&g_plant_gpu_mesh);
 	}
-	B3R_MeshInit(&g_plant_gpu_mesh, B3R_VertexLayout_PosNorUVCol, vertices.data, vertices.count, indices.data, indices.count);
+	B3R_MeshInit(&g_plant_gpu_mesh, B3R_VertexLayout_PosNorUVCol, snapshot->vertices.data, snapshot->vertices.count, snapshot->indices.data, snapshot->indices.count);
 	g_has_plant_mesh = true;
 }
 
+static void ResetForest(const SimulationSettings* settings) {
+	ForestDeinit(&g_forest);
+	DS_ArenaReset(&g_plant_arena);
+	ForestInit(&g_forest, &g_plant_arena);
+
+	// Plants are laid out in a grid centered at the origin
+	int forest_size = HMM_MIN(HMM_MAX(settings->forest_size, 1), 32);
+	float grid_offset = -0.5f * (float)(forest_size - 1) * settings->forest_spacing;
+	for (int y = 0; y < forest_size; y++) {
+		for (int x = 0; x < forest_size; x++) {
+			ForestAddPlant(&g_forest, {grid_offset + (float)x*settings->forest_spacing, grid_offset + (float)y*settings->forest_spacing, 0.f});
+		}
+	}
+}
+
+static void SimulationThreadFn(void* user_data) {
+	SimulationThread* sim = (SimulationThread*)user_data;
+	
+	Curve apical_control_curve;
+	UI_CurveInit(&apical_control_curve, DS_HEAP);
+
+	// The sweep variants keep the curve that was active when the sweep was started
+	Curve sweep_apical_control_curve;
+	UI_CurveInit(&sweep_apical_control_curve, DS_HEAP);
+	ForestSweep sweep;
+	bool sweeping = false;
+
+	uint64_t last_frame_index = 0;
+	bool has_forest = false;
+	
+	OS_SYNC_MutexLock(&sim->mutex);
+	for (;;) {
+		while (!sim->quit && sim->frame_index == last_frame_index) {
+			OS_SYNC_ConditionVarWait(&sim->wake, &sim->mutex);
+		}
+		if (sim->quit) break;
+
+		last_frame_index = sim->frame_index;
+		SimulationSettings settings = sim->settings;
+		CurveCopy(&apical_control_curve, &sim->apical_control_curve);
+		bool reset = sim->reset_requested || !has_forest;
+		bool start_sweep = sim->sweep_requested;
+		sim->reset_requested = false;
+		sim->sweep_requested = false;
+		OS_SYNC_MutexUnlock(&sim->mutex);
+
+		settings.params.apical_control_curve = &apical_control_curve;
+		
+		uint64_t start_tick = OS_TIMING_GetTick();
+		bool modified = false;
+		if (sweeping && (reset || start_sweep)) {
+			ForestSweepDeinit(&sweep);
+			sweeping = false;
+			modified = true;
+		}
+		if (reset) {
+			ResetForest(&settings);
+			has_forest = true;
+			modified = true;
+		}
+		if (start_sweep) {
+			CurveCopy(&sweep_apical_control_curve, &apical_control_curve);
+			
+			PlantParameters variant_params[16];
+			int variants_count = HMM_MIN(HMM_MAX(settings.sweep_variants_count, 1), (int)DS_ArrayCount(variant_params));
+			for (int i = 0; i < variants_count; i++) {
+				float t = variants_count > 1 ? (float)i / (float)(variants_count - 1) : 0.5f;
+				variant_params[i] = settings.params;
+				variant_params[i].apical_control_curve = &sweep_apical_control_curve;
+				variant_params[i].ac_overall_factor = HMM_Lerp(settings.sweep_overall_factor_min, t, settings.sweep_overall_factor_max);
+			}
+			
+			ForestSweepInit(&sweep, &g_forest, variant_params, variants_count);
+			sweeping = true;
+			modified = true;
+		}
+
+		// Run at least one iteration per frame, and then keep going while there's time left
+		int iterations = 0;
+		if (settings.simulating) {
+			while (iterations < settings.max_iterations_per_frame) {
+				bool grew = sweeping ?
+					ForestSweepDoGrowthIteration(&sweep, &g_thread_pool) :
+					ForestDoGrowthIteration(&g_forest, &g_thread_pool, &settings.params);
+				if (!grew) break;
+				modified = true;
+				iterations++;
+				
+				float elapsed_ms = 1000.f * (float)OS_TIMING_GetDuration(start_tick, OS_TIMING_GetTick());
+				if (!sim->lockstep && elapsed_ms >= settings.time_budget_ms) break;
+			}
+		}
+		uint64_t growth_end_tick = OS_TIMING_GetTick();
+
+		int target_snapshot = -1;
+		if (modified) {
+			OS_SYNC_MutexLock(&sim->mutex);
+			for (int i = 0; i < DS_ArrayCount(sim->snapshots); i++) {
+				if (i != sim->ui_snapshot && (target_snapshot == -1 || i != sim->published_snapshot)) target_snapshot = i;
+			}
+			if (target_snapshot == sim->published_snapshot) sim->published_snapshot = -1; // overwrite a snapshot that the UI thread hasn't picked up yet
+			OS_SYNC_MutexUnlock(&sim->mutex);
+
+			RegeneratePlantMesh(&sim->snapshots[target_snapshot], sweeping ? &sweep : NULL, &settings);
+		}
+		
+		uint64_t end_tick = OS_TIMING_GetTick();
+		float step_time_ms = 1000.f * (float)OS_TIMING_GetDuration(start_tick, end_tick);
+
+		MemTelemetry_Sample(MemGroup_Simulation);
+
+		OS_SYNC_MutexLock(&sim->mutex);
+		if (target_snapshot != -1) sim->published_snapshot = target_snapshot;
+		if (reset) sim->stats.age = 0;
+		sim->stats.age += iterations;
+		sim->stats.iterations_last_frame = iterations;
+		sim->stats.step_time_ms = step_time_ms;
+		sim->stats.growth_time_ms = 1000.f * (float)OS_TIMING_GetDuration(start_tick, growth_end_tick);
+		sim->stats.mesh_time_ms = 1000.f * (float)OS_TIMING_GetDuration(growth_end_tick, end_tick);
+		sim->stats.scratch_peak_used = GrowthScratchPeakUsage(&sim->stats.scratch_threads_count);
+		sim->completed_frame_index = last_frame_index;
+		OS_SYNC_ConditionVarSignal(&sim->step_done);
+	}
+	OS_SYNC_MutexUnlock(&sim->mutex);
+
+	if (sweeping) ForestSweepDeinit(&sweep);
+	UI_CurveDeinit(&sweep_apical_control_curve);
+	UI_CurveDeinit(&apical_control_curve);
+}
+
+static void SimulationThreadStart(SimulationThread* sim, bool lockstep) {
+	*sim = {};
+	sim->lockstep = lockstep;
+	OS_SYNC_MutexInit(&sim->mutex);
+	OS_SYNC_ConditionVarInit(&sim->wake);
+	OS_SYNC_ConditionVarInit(&sim->step_done);
+	UI_CurveInit(&sim->apical_control_curve, DS_HEAP);
+	for (int i = 0; i < DS_ArrayCount(sim->snapshots); i++) {
+		DS_ArenaInitVirtual(&sim->snapshots[i].arena, DS_GIB(4));
+		DS_ArenaInitVirtual(&sim->snapshots[i].index_arena, DS_GIB(4));
+	}
+	sim->published_snapshot = -1;
+	sim->ui_snapshot = -1;
+	OS_SYNC_ThreadStart(&sim->thread, SimulationThreadFn, sim, "Simulation");
+}
+
+static void SimulationThreadStop(SimulationThread* sim) {
+	OS_SYNC_MutexLock(&sim->mutex);
+	sim->quit = true;
+	OS_SYNC_ConditionVarSignal(&sim->wake);
+	OS_SYNC_MutexUnlock(&sim->mutex);
+	OS_SYNC_ThreadJoin(&sim->thread);
+
+	for (int i = 0; i < DS_ArrayCount(sim->snapshots); i++) {
+		DS_ArenaDeinit(&sim->snapshots[i].arena);
+		DS_ArenaDeinit(&sim->snapshots[i].index_arena);
+	}
+	UI_CurveDeinit(&sim->apical_control_curve);
+	OS_SYNC_ConditionVarDestroy(&sim->step_done);
+	OS_SYNC_ConditionVarDestroy(&sim->wake);
+	OS_SYNC_MutexDestroy(&sim->mutex);
+}
+
+// -- Presets --
+// Preset files (see plant_presets.h) are loaded from PRESETS_DIRECTORY at startup, and the directory is watched for changes
+// after that. When a file is written, only that file is parsed again. If it's the active preset and its contents really
+// changed, it's applied and the forest is regrown.
+
+#define PRESETS_DIRECTORY "../resources/presets"
+#define PRESETS_DEFAULT_NAME "default"
+
+struct PresetFile {
+	char* path;
+	STR_View name; // file name without the extension
+	uint64_t last_write_time;
+	uint64_t content_hash;
+	bool loaded; // false until the file has been parsed without errors
+	PlantPreset preset;
+};
+
+static DS_DynArray(PresetFile) g_preset_files;
+static int g_active_preset = -1;
+static HANDLE g_presets_change_notification = INVALID_HANDLE_VALUE;
+static bool g_preset_applied; // the forest should be regrown with the new parameters
+
+static void ApplyPreset(int index) {
+	const PresetFile* file = &g_preset_files[index];
+	g_active_preset = index;
+	g_sim_settings.params = file->preset.params;
+	CurveCopy(&g_apical_control_curve, &file->preset.apical_control_curve);
+	g_preset_applied = true;
+}
+
+// Parses the files of the preset directory that were added or written since the last scan. `pool` may be NULL to parse
+// them on the calling thread.
+static void ScanPresets(ThreadPool* pool) {
+	DS_Scope scratch = DS_ScratchBegin(NULL, 0);
+	DS_DynArray(int) changed = {scratch.arena};
+	DS_DynArray(const char*) changed_paths = {scratch.arena};
+
+	WIN32_FIND_DATAA find_data;
+	HANDLE find = FindFirstFileA(PRESETS_DIRECTORY "/*.mdesk", &find_data);
+	if (find != INVALID_HANDLE_VALUE) {
+		do {
+			uint64_t write_time = ((uint64_t)find_data.ftLastWriteTime.dwHighDateTime << 32) | find_data.ftLastWriteTime.dwLowDateTime;
+			STR_View name = STR_BeforeLast(STR_ToV(find_data.cFileName), '.');
+
+			int index = -1;
+			for (int i = 0; i < g_preset_files.count; i++) {
+				if (STR_Match(g_preset_files[i].name, name)) index = i;
+			}
+			if (index == -1) {
+				PresetFile file = {};
+				file.path = STR_FormC(&g_persist_arena, PRESETS_DIRECTORY "/%s", find_data.cFileName);
+				file.name = STR_Clone(&g_persist_arena, name);
+				PlantPresetInit(&file.preset, DS_HEAP);
+				index = g_preset_files.count;
+				DS_ArrPush(&g_preset_files, file);
+			}
+
+			PresetFile* file = &g_preset_files.data[index];
+			if (file->last_write_time != write_time) {
+				file->last_write_time = write_time;
+				DS_ArrPush(&changed, index);
+				DS_ArrPush(&changed_paths, file->path);
+			}
+		} while (FindNextFileA(find, &find_data));
+		FindClose(find);
+	}
+
+	PlantPresetBatch batch;
+	PlantPresetBatchLoad(&batch, changed_paths.data, changed_paths.count, pool);
+	for (int i = 0; i < changed.count; i++) {
+		PresetFile* file = &g_preset_files.data[changed[i]];
+		if (!batch.loaded[i]) continue; // keep the last good version, the errors have been printed
+		if (file->loaded && file->content_hash == batch.content_hashes[i]) continue;
+
+		file->loaded = true;
+		file->content_hash = batch.content_hashes[i];
+		file->preset.params = batch.presets[i].params;
+		CurveCopy(&file->preset.apical_control_curve, &batch.presets[i].apical_control_curve);
+		if (changed[i] == g_active_preset) ApplyPreset(changed[i]);
+	}
+	PlantPresetBatchDeinit(&batch);
+
+	DS_ScratchEnd(&scratch);
+}
+
+static void InitPresets() {
+	DS_ArrInit(&g_preset_files, &g_persist_arena);
+
+	// The simulation thread hasn't started yet, so every preset can be loaded at once using the thread pool
+	ScanPresets(&g_thread_pool);
+	for (int i = 0; i < g_preset_files.count; i++) {
+		if (g_preset_files[i].loaded && STR_Match(g_preset_files[i].name, STR_ToV(PRESETS_DEFAULT_NAME))) ApplyPreset(i);
+	}
+	g_presets_change_notification = FindFirstChangeNotificationA(PRESETS_DIRECTORY, FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE|FILE_NOTIFY_CHANGE_FILE_NAME);
+}
+
+// Called once per frame. Doesn't touch the file system unless the directory has changed.
+static void PollPresets() {
+	if (g_presets_change_notification == INVALID_HANDLE_VALUE) return;
+	if (WaitForSingleObject(g_presets_change_notification, 0) != WAIT_OBJECT_0) return;
+
+	// The simulation thread runs its growth batches on the thread pool, and the UI thread must never wait for those.
+	// Only the saved files are parsed here, so doing it inline is cheap.
+	FindNextChangeNotification(g_presets_change_notification);
+	ScanPresets(NULL);
+}
+
+// Writes the current parameters into the active preset file
+static void SaveActivePreset() {
+	PresetFile* file = &g_preset_files.data[g_active_preset];
+	FILE* f = fopen(file->path, "wb");
+	if (f == NULL) return;
+	PlantPresetWrite(f, &g_sim_settings.params, &g_apical_control_curve);
+	fclose(f);
+
+	// Remember what was written, so that the watcher doesn't apply it again and regrow the forest
+	DS_Scope scratch = DS_ScratchBegin(NULL, 0);
+	STR_View text = PlantPresetReadFile(scratch.arena, file->path);
+	file->content_hash = DS_MurmurHash64A(text.data, text.size, 0);
+	file->preset.params = g_sim_settings.params;
+	CurveCopy(&file->preset.apical_control_curve, &g_apical_control_curve);
+	file->loaded = true;
+	DS_ScratchEnd(&scratch);
+}
+
+static void DeinitPresets() {
+	if (g_presets_change_notification != INVALID_HANDLE_VALUE) FindCloseChangeNotification(g_presets_change_notification);
+	for (int i = 0; i < g_preset_files.count; i++) PlantPresetDeinit(&g_preset_files.data[i].preset);
+}
+
+// -- Replays --
+// Running with `--record <file>` records the input of the session, and `--benchmark <file>` plays a recording back as fast
+// as possible. Both run the simulation in lockstep, so the state on every frame only depends on the inputs. The recording
+// stores a hash of that state for each frame in `<file>.hashes`, and the benchmark checks against those, so a benchmark
+// run that doesn't do the same work as the recorded session is caught. The benchmark writes its per-frame timings into
+// `<file>.csv` and prints a summary at the end.
+//
+// Inputs are ignored until the assets have loaded, since the recording starts from there. The window size isn't recorded,
+// so keep the window at its default size when recording.
+
+enum ReplayMode {
+	ReplayMode_None,
+	ReplayMode_Record,
+	ReplayMode_Benchmark,
+};
+
+// Filled in by UpdateAndRender. The simulation times are only known in lockstep mode.
+struct FrameStats {
+	float ui_build_ms;   // building the UI, computing its layout and generating its draw list
+	float growth_ms;     // on the simulation thread
+	float meshing_ms;    // on the simulation thread
+	float upload_ms;     // uploading the plant mesh to the GPU
+	float draw_ms;       // clearing, submitting the draw calls of the scene and the UI
+	int sim_age;
+};
+
+struct PhaseTiming {
+	double total_ms;
+	double min_ms;
+	double max_ms;
+};
+
+static ReplayMode g_replay_mode;
+static const char* g_replay_path;
+static Replay g_replay;
+static FILE* g_replay_hashes_file; // when recording
+static STR_View g_replay_expected_hashes; // when benchmarking, one uint64_t per frame
+static FILE* g_benchmark_csv;
+static PhaseTiming g_benchmark_phases[5];
+static int g_benchmark_mismatches;
+static int g_benchmark_first_mismatch = -1;
+static uint64_t g_benchmark_start_tick;
+
+static FrameStats g_frame_stats;
+static ReplayMousePos g_mouse_position; // from the OS, or from the replay
+static uint64_t g_plant_mesh_hash; // of the last uploaded plant mesh, only computed when replaying
+
+static const char* g_benchmark_phase_names[] = {"ui", "growth", "meshing", "upload", "draw"};
+
+static void PhaseTimingAdd(PhaseTiming* timing, double ms) {
+	timing->total_ms += ms;
+	timing->min_ms = ms < timing->min_ms ? ms : timing->min_ms;
+	timing->max_ms = ms > timing->max_ms ? ms : timing->max_ms;
+}
+
+static void PhaseTimingPrint(const char* name, const PhaseTiming* timing, int frames) {
+	printf("  %-8s avg %8.3f ms   min %8.3f ms   max %8.3f ms\n", name, timing->total_ms / (double)frames, timing->min_ms, timing->max_ms);
+}
+
+static uint64_t HashPlantMesh(const PlantMeshSnapshot* snapshot) {
+	uint64_t hash = DS_MurmurHash64A(snapshot->vertices.data, snapshot->vertices.count * (int)sizeof(SimpleGPUMeshVertex), 0);
+	return DS_MurmurHash64A(snapshot->indices.data, snapshot->indices.count * (int)sizeof(uint32_t), hash);
+}
+
+static void HashValue(uint64_t* hash, const void* data, int size) {
+	*hash = DS_MurmurHash64A(data, size, *hash);
+}
+
+// Hashes everything that the inputs can change. The structs have padding in them, so the fields are hashed one by one.
+static uint64_t ComputeStateHash() {
+	uint64_t hash = 0;
+	const PlantParameters* params = &g_sim_settings.params;
+	HashValue(&hash, &params->random_seed, sizeof(params->random_seed));
+	HashValue(&hash, &params->max_age, sizeof(params->max_age));
+	HashValue(&hash, &params->vigor_scale, sizeof(params->vigor_scale));
+	HashValue(&hash, &params->ac_base_dist_factor, sizeof(params->ac_base_dist_factor));
+	HashValue(&hash, &params->ac_stem_length_factor, sizeof(params->ac_stem_length_factor));
+	HashValue(&hash, &params->ac_order_factor, sizeof(params->ac_order_factor));
+	HashValue(&hash, &params->ac_overall_factor, sizeof(params->ac_overall_factor));
+
+	const SimulationSettings* settings = &g_sim_settings;
+	HashValue(&hash, &settings->simulating, sizeof(settings->simulating));
+	HashValue(&hash, &settings->forest_size, sizeof(settings->forest_size));
+	HashValue(&hash, &settings->forest_spacing, sizeof(settings->forest_spacing));
+	HashValue(&hash, &settings->max_iterations_per_frame, sizeof(settings->max_iterations_per_frame));
+	HashValue(&hash, &settings->sweep_variants_count, sizeof(settings->sweep_variants_count));
+	HashValue(&hash, &settings->sweep_overall_factor_min, sizeof(settings->sweep_overall_factor_min));
+	HashValue(&hash, &settings->sweep_overall_factor_max, sizeof(settings->sweep_overall_factor_max));
+
+	HashValue(&hash, &g_apical_control_curve.interpolation, sizeof(g_apical_control_curve.interpolation));
+	HashValue(&hash, g_apical_control_curve.points.data, g_apical_control_curve.points.count * (int)sizeof(HMM_Vec2));
+	HashValue(&hash, &g_active_preset, sizeof(g_active_preset));
+	HashValue(&hash, &g_camera.pos, sizeof(g_camera.pos));
+	HashValue(&hash, &g_camera.ori, sizeof(g_camera.ori));
+	HashValue(&hash, &g_frame_stats.sim_age, sizeof(g_frame_stats.sim_age));
+	HashValue(&hash, &g_plant_mesh_hash, sizeof(g_plant_mesh_hash));
+	return hash;
+}
+
+// Parses the command line. Returns false if the arguments are invalid.
+static bool InitReplay(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		if (i + 1 < argc && strcmp(argv[i], "--record") == 0) g_replay_mode = ReplayMode_Record;
+		else if (i + 1 < argc && strcmp(argv[i], "--benchmark") == 0) g_replay_mode = ReplayMode_Benchmark;
+		else {
+			printf("Usage: plant_growth [--record <file> | --benchmark <file>]\n");
+			return false;
+		}
+		g_replay_path = argv[++i];
+	}
+	if (g_replay_mode == ReplayMode_None) return true;
+
+	if (g_replay_mode == ReplayMode_Benchmark) {
+		// ReplayInit would start a new recording if the file didn't exist
+		FILE* f = fopen(g_replay_path, "rb");
+		if (f == NULL) {
+			printf("Failed to open %s\n", g_replay_path);
+			return false;
+		}
+		fclose(f);
+	}
+
+	ReplayInit(&g_replay, g_replay_path, g_replay_mode == ReplayMode_Benchmark);
+	if (g_replay_mode == ReplayMode_Benchmark && g_replay.frames_count == 0) {
+		printf("%s is empty or not a valid replay\n", g_replay_path);
+		ReplayDeinit(&g_replay);
+		return false;
+	}
+
+	char* hashes_path = STR_FormC(&g_persist_arena, "%s.hashes", g_replay_path);
+	if (g_replay_mode == ReplayMode_Record) {
+		g_replay_hashes_file = fopen(hashes_path, "wb");
+	} else {
+		FILE* hashes_file = fopen(hashes_path, "rb");
+		if (hashes_file) {
+			fclose(hashes_file);
+			g_replay_expected_hashes = ReadEntireFile(&g_persist_arena, hashes_path);
+		} else {
+			printf("%s not found, the state won't be checked\n", hashes_path);
+		}
+
+		char* csv_path = STR_FormC(&g_persist_arena, "%s.csv", g_replay_path);
+		g_benchmark_csv = fopen(csv_path, "wb");
+		if (g_benchmark_csv) fprintf(g_benchmark_csv, "frame,ui_ms,growth_ms,meshing_ms,upload_ms,draw_ms,state_ok\n");
+		for (int i = 0; i < DS_ArrayCount(g_benchmark_phases); i++) g_benchmark_phases[i] = {0., 1e9, 0.};
+	}
+	return true;
+}
+
+// Called before UpdateAndRender with the inputs from the OS. Replaces them when benchmarking. Returns false once the
+// replay has ended.
+static bool BeginReplayFrame(INPUT_Frame* inputs, ReplayMousePos* mouse_pos) {
+	if (g_replay_mode == ReplayMode_None) return true;
+
+	if (!g_assets_ready) {
+		inputs->events_count = 0;
+		memset(inputs->key_is_down, 0, sizeof(inputs->key_is_down));
+		memset(inputs->mouse_wheel_input, 0, sizeof(inputs->mouse_wheel_input));
+		memset(inputs->raw_mouse_input, 0, sizeof(inputs->raw_mouse_input));
+		*mouse_pos = {};
+		return true;
+	}
+
+	if (g_replay.frame_index == 0) g_benchmark_start_tick = OS_TIMING_GetTick();
+	ReplayProcessFrame(&g_replay, &g_temp_arena, inputs, mouse_pos);
+	return !g_replay.is_finished;
+}
+
+// Called after UpdateAndRender
+static void EndReplayFrame() {
+	if (g_replay_mode == ReplayMode_None || !g_assets_ready || g_replay.frame_index == 0) return;
+
+	int frame = g_replay.frame_index - 1;
+	uint64_t hash = ComputeStateHash();
+	if (g_replay_mode == ReplayMode_Record) {
+		if (g_replay_hashes_file) fwrite(&hash, sizeof(hash), 1, g_replay_hashes_file);
+		return;
+	}
+
+	bool state_ok = true;
+	if ((frame + 1) * (int64_t)sizeof(uint64_t) <= g_replay_expected_hashes.size) {
+		uint64_t expected_hash;
+		memcpy(&expected_hash, g_replay_expected_hashes.data + frame * sizeof(uint64_t), sizeof(uint64_t));
+		state_ok = hash == expected_hash;
+	}
+	if (!state_ok) {
+		if (g_benchmark_first_mismatch == -1) g_benchmark_first_mismatch = frame;
+		g_benchmark_mismatches++;
+	}
+
+	const FrameStats* s = &g_frame_stats;
+	float phases_ms[] = {s->ui_build_ms, s->growth_ms, s->meshing_ms, s->upload_ms, s->draw_ms};
+	for (int i = 0; i < DS_ArrayCount(phases_ms); i++) PhaseTimingAdd(&g_benchmark_phases[i], phases_ms[i]);
+
+	if (g_benchmark_csv) {
+		fprintf(g_benchmark_csv, "%d,%.4f,%.4f,%.4f,%.4f,%.4f,%d\n", frame, s->ui_build_ms, s->growth_ms, s->meshing_ms, s->upload_ms, s->draw_ms, (int)state_ok);
+	}
+}
+
+static void DeinitReplay() {
+	if (g_replay_mode == ReplayMode_None) return;
+
+	if (g_replay_mode == ReplayMode_Benchmark) {
+		int frames = g_replay.frame_index;
+		printf("Benchmark of %s: %d frames in %.3f s\n", g_replay_path, frames, OS_TIMING_GetDuration(g_benchmark_start_tick, OS_TIMING_GetTick()));
+		for (int i = 0; i < DS_ArrayCount(g_benchmark_phases) && frames > 0; i++) {
+			PhaseTimingPrint(g_benchmark_phase_names[i], &g_benchmark_phases[i], frames);
+		}
+		if (g_replay_expected_hashes.size > 0) {
+			if (g_benchmark_mismatches == 0) printf("  state matches the recording on every frame\n");
+			else printf("  STATE MISMATCH on %d frames, first on frame %d\n", g_benchmark_mismatches, g_benchmark_first_mismatch);
+		}
+		if (g_benchmark_csv) fclose(g_benchmark_csv);
+	}
+	if (g_replay_hashes_file) fclose(g_replay_hashes_file);
+	ReplayDeinit(&g_replay);
+}
+
 static void UpdateAndRender() {
+	uint64_t frame_start_tick = OS_TIMING_GetTick();
+
 	Camera_Update(&g_camera, &g_inputs, 0.002f, 0.001f, 70.f, g_window_size.x / g_window_size.y, 0.01f, 1000.f);
 
 	GizmosViewport vp = {0};
@@ -389,7 +1359,7 @@ static void UpdateAndRender() {
 
 	UI_Inputs ui_inputs{};
 	UI_INPUT_ApplyInputs(&ui_inputs, &g_inputs);
-	OS_WINDOW_GetMousePosition(&g_window, &ui_inputs.mouse_position.x, &ui_inputs.mouse_position.y);
+	ui_inputs.mouse_position = {g_mouse_position.x, g_mouse_position.y};
 
 	UI_BeginFrame(&ui_inputs, g_window_size, {g_base_font, 18}, {g_icons_font, 18});
 
@@ -400,11 +1370,35 @@ static void UpdateAndRender() {
 	static bool wireframe = false;
 	UI_AddFmt(UI_KEY(), "Wireframe: %!b", &wireframe);
 	UI_AddBox(UI_KEY(), 0.f, 5.f, 0); // pad
-	UI_AddFmt(UI_KEY(), "Seed: %!u", &g_plant_params.random_seed);
+	if (g_preset_files.count > 0) {
+		STR_View preset_name = g_active_preset != -1 ? g_preset_files[g_active_preset].name : STR_ToV("(none)");
+		STR_View preset_text = STR_Form(UI_FrameArena(), "Preset: %v", preset_name);
+		if (UI_Clicked(UI_AddButton(UI_KEY(), UI_SizeFit(), UI_SizeFit(), 0, preset_text)->key)) {
+			// Cycle through the presets that have loaded successfully
+			for (int i = 1; i <= g_preset_files.count; i++) {
+				int index = (g_active_preset + i) % g_preset_files.count;
+				if (g_preset_files[index].loaded) {
+					ApplyPreset(index);
+					break;
+				}
+			}
+		}
+		if (g_active_preset != -1 && UI_Clicked(UI_AddButton(UI_KEY(), UI_SizeFit(), UI_SizeFit(), 0, "SAVE PRESET")->key)) {
+			SaveActivePreset();
+		}
+		UI_AddBox(UI_KEY(), 0.f, 5.f, 0); // pad
+	}
+	UI_AddFmt(UI_KEY(), "Seed: %!u", &g_sim_settings.params.random_seed);
+	UI_AddBox(UI_KEY(), 0.f, 5.f, 0); // pad
+	UI_AddFmt(UI_KEY(), "Max age: %!f", &g_sim_settings.params.max_age);
+	UI_AddBox(UI_KEY(), 0.f, 5.f, 0); // pad
+	UI_AddFmt(UI_KEY(), "Vigor scale: %!f", &g_sim_settings.params.vigor_scale);
 	UI_AddBox(UI_KEY(), 0.f, 5.f, 0); // pad
-	UI_AddFmt(UI_KEY(), "Max age: %!f", &g_plant_params.max_age);
+	UI_AddFmt(UI_KEY(), "Forest size: %!d", &g_sim_settings.forest_size);
+	UI_AddFmt(UI_KEY(), "Forest spacing: %!f", &g_sim_settings.forest_spacing);
 	UI_AddBox(UI_KEY(), 0.f, 5.f, 0); // pad
-	UI_AddFmt(UI_KEY(), "Vigor scale: %!f", &g_plant_params.vigor_scale);
+	UI_AddFmt(UI_KEY(), "Time budget (ms): %!f", &g_sim_settings.time_budget_ms);
+	UI_AddFmt(UI_KEY(), "Max iterations per frame: %!d", &g_sim_settings.max_iterations_per_frame);
 	
 	UI_AddBox(UI_KEY(), 0.f, 5.f, 0); // pad
 	UI_AddBox(UI_KEY(), 0.f, 5.f, 0); // pad
@@ -412,12 +1406,17 @@ static void UpdateAndRender() {
 	UI_Box* apical_control_header = UI_AddBoxWithText(UI_KEY(), UI_SizeFlex(1.f), UI_SizeFit(), UI_BoxFlag_DrawTransparentBackground, "Apical control");
 	apical_control_header->draw_args = UI_DrawBoxDefaultArgsInit();
 	apical_control_header->draw_args->transparent_bg_color = UI_BLACK;
-	UI_AddFmt(UI_KEY(), "Base dist factor: %!f", &g_plant_params.ac_base_dist_factor);
-	UI_AddFmt(UI_KEY(), "Stem length factor: %!f", &g_plant_params.ac_stem_length_factor);
-	UI_AddFmt(UI_KEY(), "Order factor: %!f", &g_plant_params.ac_order_factor);
-	UI_AddFmt(UI_KEY(), "Overall factor: %!f", &g_plant_params.ac_overall_factor);
+	UI_AddFmt(UI_KEY(), "Base dist factor: %!f", &g_sim_settings.params.ac_base_dist_factor);
+	UI_AddFmt(UI_KEY(), "Stem length factor: %!f", &g_sim_settings.params.ac_stem_length_factor);
+	UI_AddFmt(UI_KEY(), "Order factor: %!f", &g_sim_settings.params.ac_order_factor);
+	UI_AddFmt(UI_KEY(), "Overall factor: %!f", &g_sim_settings.params.ac_overall_factor);
 
 	UI_Box* curve_plug = UI_AddBox(UI_KEY(), UI_SizeFlex(1.f), 80.f, UI_BoxFlag_DrawBorder);
+	STR_View interpolation_text = STR_Form(UI_FrameArena(), "Interpolation: %s", CurveInterpolationNames[g_apical_control_curve.interpolation]);
+	if (UI_Clicked(UI_AddButton(UI_KEY(), UI_SizeFit(), UI_SizeFit(), 0, interpolation_text)->key)) {
+		g_apical_control_curve.interpolation = (CurveInterpolation)((g_apical_control_curve.interpolation + 1) % CurveInterpolation_COUNT);
+		CurveBake(&g_apical_control_curve);
+	}
 	UI_AddBox(UI_KEY(), 0.f, 5.f, 0); // pad
 	UI_AddBox(UI_KEY(), 0.f, 5.f, 0); // pad
 
@@ -444,21 +1443,48 @@ static void UpdateAndRender() {
 	UI_AddFmt(UI_KEY(), "Equal growth deceler: %!f", &g_plant_params.equal_growth_deceler);
 	UI_AddFmt(UI_KEY(), "Leaf growth speed: %!f", &g_plant_params.leaf_growth_speed);*/
 
-	static bool simulating = true;
-	
-	bool pressed_reset = false;
-	if (simulating) {
+	SimulationStats sim_stats = {};
+	if (g_assets_ready) {
+		OS_SYNC_MutexLock(&g_sim_thread.mutex);
+		sim_stats = g_sim_thread.stats;
+		OS_SYNC_MutexUnlock(&g_sim_thread.mutex);
+	} else {
+		UI_AddBoxWithText(UI_KEY(), UI_SizeFlex(1.f), UI_SizeFit(), 0, "Loading assets...");
+	}
+
+	STR_View sim_stats_text = STR_Form(UI_FrameArena(), "Age: %d (%d iterations, %f ms on the last frame)", sim_stats.age, sim_stats.iterations_last_frame, sim_stats.step_time_ms);
+	UI_AddBoxWithText(UI_KEY(), UI_SizeFlex(1.f), UI_SizeFit(), 0, sim_stats_text);
+
+	STR_View scratch_stats_text = STR_Form(UI_FrameArena(), "Scratch memory peak: %d KiB per thread (%d threads)", (int)(sim_stats.scratch_peak_used / 1024), sim_stats.scratch_threads_count);
+	UI_AddBoxWithText(UI_KEY(), UI_SizeFlex(1.f), UI_SizeFit(), 0, scratch_stats_text);
+
+	bool pressed_reset = g_preset_applied;
+	g_preset_applied = false;
+	if (g_sim_settings.simulating) {
 		if (UI_Clicked(UI_AddButton(UI_KEY(), UI_SizeFit(), UI_SizeFit(), 0, "PAUSE")->key)) {
-			simulating = false;
+			g_sim_settings.simulating = false;
 		}
 	} else {
 		if (UI_Clicked(UI_AddButton(UI_KEY(), UI_SizeFit(), UI_SizeFit(), 0, "SIMULATE")->key)) {
-			simulating = true;
+			g_sim_settings.simulating = true;
 		}
 	}
 	if (UI_Clicked(UI_AddButton(UI_KEY(), UI_SizeFit(), UI_SizeFit(), 0, "RESET")->key)) {
 		pressed_reset = true;
 	}
+	
+	UI_AddBox(UI_KEY(), 0.f, 5.f, 0); // pad
+	UI_Box* sweep_header = UI_AddBoxWithText(UI_KEY(), UI_SizeFlex(1.f), UI_SizeFit(), UI_BoxFlag_DrawTransparentBackground, "Overall factor sweep");
+	sweep_header->draw_args = UI_DrawBoxDefaultArgsInit();
+	sweep_header->draw_args->transparent_bg_color = UI_BLACK;
+	UI_AddFmt(UI_KEY(), "Variants: %!d", &g_sim_settings.sweep_variants_count);
+	UI_AddFmt(UI_KEY(), "Min: %!f", &g_sim_settings.sweep_overall_factor_min);
+	UI_AddFmt(UI_KEY(), "Max: %!f", &g_sim_settings.sweep_overall_factor_max);
+
+	bool pressed_sweep = false;
+	if (UI_Clicked(UI_AddButton(UI_KEY(), UI_SizeFit(), UI_SizeFit(), 0, "SWEEP FROM CURRENT AGE")->key)) {
+		pressed_sweep = true;
+	}
 
 	UI_PopBox(root);
 	UI_BoxComputeRects(root, {20.f, 20.f});
@@ -466,21 +1492,43 @@ static void UpdateAndRender() {
 	
 	// Only after drawing the box we can do plugs
 	UI_PlugValCurve(curve_plug, &g_apical_control_curve);
-	g_plant_params.apical_control_curve = &g_apical_control_curve;
 
-	// plant simulation
-	{
-		static bool first_frame = true;
-		if (first_frame || pressed_reset) {
-			DS_ArenaReset(&g_plant_arena);
-			PlantInit(&g_plant, &g_plant_arena);
-			RegeneratePlantMesh();
-			first_frame = false;
+	uint64_t handoff_start_tick = OS_TIMING_GetTick();
+
+	// Hand the settings over to the simulation thread and pick up the latest plant mesh
+	if (g_assets_ready) {
+		OS_SYNC_MutexLock(&g_sim_thread.mutex);
+		g_sim_thread.settings = g_sim_settings;
+		CurveCopy(&g_sim_thread.apical_control_curve, &g_apical_control_curve);
+		if (pressed_reset) g_sim_thread.reset_requested = true;
+		if (pressed_sweep) g_sim_thread.sweep_requested = true;
+		g_sim_thread.frame_index++;
+		OS_SYNC_ConditionVarSignal(&g_sim_thread.wake);
+
+		if (g_sim_thread.lockstep) {
+			while (g_sim_thread.completed_frame_index != g_sim_thread.frame_index) {
+				OS_SYNC_ConditionVarWait(&g_sim_thread.step_done, &g_sim_thread.mutex);
+			}
+			g_frame_stats.growth_ms = g_sim_thread.stats.growth_time_ms;
+			g_frame_stats.meshing_ms = g_sim_thread.stats.mesh_time_ms;
+			g_frame_stats.sim_age = g_sim_thread.stats.age;
 		}
 
-		if (simulating) {
-			bool modified = PlantDoGrowthIteration(&g_plant, &g_temp_arena, &g_plant_params);
-			if (modified) RegeneratePlantMesh();
+		int snapshot = g_sim_thread.published_snapshot;
+		g_sim_thread.published_snapshot = -1;
+		g_sim_thread.ui_snapshot = snapshot;
+		OS_SYNC_MutexUnlock(&g_sim_thread.mutex);
+
+		g_frame_stats.upload_ms = 0.f;
+		if (snapshot != -1) {
+			uint64_t upload_start_tick = OS_TIMING_GetTick();
+			UploadPlantMesh(&g_sim_thread.snapshots[snapshot]);
+			g_frame_stats.upload_ms = 1000.f * (float)OS_TIMING_GetDuration(upload_start_tick, OS_TIMING_GetTick());
+			if (g_replay_mode != ReplayMode_None) g_plant_mesh_hash = HashPlantMesh(&g_sim_thread.snapshots[snapshot]);
+
+			OS_SYNC_MutexLock(&g_sim_thread.mutex);
+			g_sim_thread.ui_snapshot = -1;
+			OS_SYNC_MutexUnlock(&g_sim_thread.mutex);
 		}
 	}
 	
@@ -492,8 +1540,12 @@ static void UpdateAndRender() {
 //	}
 
 
+	uint64_t handoff_end_tick = OS_TIMING_GetTick();
+
 	UI_Outputs ui_outputs;
 	UI_EndFrame(&ui_outputs);
+
+	uint64_t draw_start_tick = OS_TIMING_GetTick();
 	
 	FLOAT clearcolor[4] = { 0.5f, 0.5f, 0.5f, 1.f };
 	g_dx11_device_context->ClearRenderTargetView(g_dx11_framebuffer_view, clearcolor);
@@ -522,10 +1574,14 @@ static void UpdateAndRender() {
 	B3R_EndDrawing();
 
 	UI_DX11_Draw(&ui_outputs, g_dx11_framebuffer_view);
+
+	uint64_t draw_end_tick = OS_TIMING_GetTick();
+	g_frame_stats.ui_build_ms = 1000.f * (float)(OS_TIMING_GetDuration(frame_start_tick, handoff_start_tick) + OS_TIMING_GetDuration(handoff_end_tick, draw_start_tick));
+	g_frame_stats.draw_ms = 1000.f * (float)OS_TIMING_GetDuration(draw_start_tick, draw_end_tick);
 	
 	UI_OS_ApplyOutputs(&g_window, &ui_outputs);
 	
-	g_dx11_swapchain->Present(1, 0);
+	g_dx11_swapchain->Present(g_replay_mode == ReplayMode_Benchmark ? 0 : 1, 0); // don't wait for vsync when benchmarking
 }
 
 static void InitRenderTargets() {
@@ -570,7 +1626,13 @@ static void OnResizeWindow(uint32_t width, uint32_t height, void *user_ptr) {
 
 static void InitApp() {
 	DS_ArenaInit(&g_persist_arena, 4096, DS_HEAP);
-	DS_ArenaInit(&g_temp_arena, 4096, DS_HEAP);
+	DS_ArenaInitVirtual(&g_temp_arena, DS_GIB(4));
+	OS_TIMING_Init();
+
+	SYSTEM_INFO system_info;
+	GetSystemInfo(&system_info);
+	int workers_count = HMM_MIN(HMM_MAX((int)system_info.dwNumberOfProcessors - 1, 0), THREAD_POOL_MAX_WORKERS);
+	ThreadPool_Init(&g_thread_pool, workers_count);
 
 	g_window = OS_WINDOW_Create((uint32_t)g_window_size.x, (uint32_t)g_window_size.y, "Plant growth");
 	//OS_WINDOW_SetFullscreen(&g_window, g_window_fullscreen);
@@ -603,6 +1665,12 @@ static void InitApp() {
 	UI_DX11_Init(&ui_backend, g_dx11_device, g_dx11_device_context);
 	UI_Init(&g_persist_arena, &ui_backend);
 
+	MemTelemetry_RegisterArena("Persist arena", &g_persist_arena, MemGroup_Main);
+	MemTelemetry_RegisterArena("Temp arena", &g_temp_arena, MemGroup_Main);
+	MemTelemetry_RegisterArena("UI persistent arena", &UI_STATE.persistent_arena, MemGroup_Main);
+	MemTelemetry_RegisterArena("UI frame arena", &UI_STATE.frame_arena, MemGroup_Main);
+	MemTelemetry_RegisterArena("UI previous frame arena", &UI_STATE.prev_frame_arena, MemGroup_Main);
+
 	// NOTE: the font data must remain alive across the whole program lifetime!
 	STR_View roboto_mono_ttf = ReadEntireFile(&g_persist_arena, "../fire/fire_ui/resources/roboto_mono.ttf");
 	STR_View icons_ttf = ReadEntireFile(&g_persist_arena, "../fire/fire_ui/resources/fontello/font/fontello.ttf");
@@ -627,6 +1695,8 @@ static void DeinitApp() {
 	g_dx11_device->Release();
 	g_dx11_device_context->Release();
 
+	ThreadPool_Deinit(&g_thread_pool);
+
 	DS_ArenaDeinit(&g_persist_arena);
 	DS_ArenaDeinit(&g_temp_arena);
 }
@@ -659,7 +1729,49 @@ static void InitGrid(B3R_WireMesh* mesh, HMM_Vec3 origin, HMM_Vec3 x_step, HMM_V
 	B3R_WireMeshInit(mesh, (B3R_WireVertex*)wire_verts.data, wire_verts.count);
 }
 
+// Loads a DDS file, e.g. one written by the texture compressor tool (src/texture_compressor.cpp). The mips are uploaded
+// as they are stored, so block-compressed textures are never decoded on the CPU.
+static bool TextureInitFromDDSData(B3R_Texture* texture, STR_View file) {
+	DDSPP_Descriptor desc;
+	bool ok = file.size >= DDSPP_MAX_HEADER_SIZE && ddspp_decode_header((const unsigned char*)file.data, &desc) == DDSPP_Success;
+	ok = ok && desc.type == Texture2D && desc.arraySize == 1 && desc.numMips <= 16;
+
+	B3R_TextureMip mips[16];
+	if (ok) {
+		// Each mip is stored as whole blocks (or pixels) right after the previous one
+		uint32_t offset = desc.headerSize;
+		for (uint32_t i = 0; i < desc.numMips; i++) {
+			uint32_t mip_width = desc.width >> i > 0 ? desc.width >> i : 1;
+			uint32_t mip_height = desc.height >> i > 0 ? desc.height >> i : 1;
+			uint32_t rows = (mip_height + desc.blockHeight - 1) / desc.blockHeight;
+			mips[i].row_pitch = ((mip_width + desc.blockWidth - 1) / desc.blockWidth * desc.bitsPerPixelOrBlock + 7) / 8;
+			mips[i].data = file.data + offset;
+			offset += mips[i].row_pitch * rows;
+		}
+		ok = offset <= (uint32_t)file.size;
+	}
+
+	if (ok) {
+		B3R_TextureInitEx(texture, desc.width, desc.height, (DXGI_FORMAT)desc.format, mips, desc.numMips);
+	}
+	return ok;
+}
+
+static bool TextureInitFromDDS(B3R_Texture* texture, const char* filepath) {
+	DS_Scope scratch = DS_ScratchBegin(NULL, 0);
+	bool ok = TextureInitFromDDSData(texture, ReadEntireFile(scratch.arena, filepath));
+	DS_ScratchEnd(&scratch);
+	return ok;
+}
+
+// DDS files are uploaded directly, other images are decoded with stb_image
 static void TextureInitFromFile(B3R_Texture* texture, const char* filepath) {
+	if (STR_EndsWithC(STR_ToV(filepath), ".dds")) {
+		bool ok = TextureInitFromDDS(texture, filepath);
+		assert(ok);
+		return;
+	}
+
 	int size_x, size_y, num_channels;
 	uint8_t* data = stbi_load(filepath, &size_x, &size_y, &num_channels, 4);
 	assert(data);
@@ -667,28 +1779,128 @@ static void TextureInitFromFile(B3R_Texture* texture, const char* filepath) {
 	stbi_image_free(data);
 }
 
-int main() {
+// -- Asset loading --
+// Files are read and decoded on the asset loader's worker threads (utils/asset_loader.h), so a cold start isn't serialized
+// on parsing glTF files and inflating PNGs. The main thread polls the finished assets once per frame and does only the
+// parts that have to happen there, such as creating GPU textures. The simulation thread is started once the meshes that
+// it builds plants from have arrived.
+
+struct DecodedImage {
+	int width, height;
+	uint8_t* pixels; // RGBA8
+};
+
+// Runs on an asset loader thread. DDS files need no decoding, they're uploaded as they are in CompleteImageAsset.
+static bool DecodeImageAsset(AssetLoader_Asset* asset) {
+	if (STR_EndsWithC(STR_ToV(asset->path), ".dds")) return true;
+
+	DecodedImage* image = DS_New(DecodedImage, &asset->arena);
+	int num_channels;
+	uint8_t* pixels = stbi_load_from_memory((const stbi_uc*)asset->file_data, (int)asset->file_size, &image->width, &image->height, &num_channels, 4);
+	if (pixels == NULL) return false;
+
+	image->pixels = (uint8_t*)DS_ArenaPush(&asset->arena, image->width * image->height * 4);
+	memcpy(image->pixels, pixels, image->width * image->height * 4);
+	stbi_image_free(pixels);
+	asset->result = image;
+	return true;
+}
+
+// Runs on an asset loader thread
+static bool DecodeMeshAsset(AssetLoader_Asset* asset) {
+	ImportedMesh* mesh = DS_New(ImportedMesh, &asset->arena);
+	*mesh = ImportMeshCached(&asset->arena, asset->path, STR_View{asset->file_data, asset->file_size});
+	asset->result = mesh;
+	return true;
+}
+
+// The async version of TextureInitFromFile. `texture` is initialized once the image has been polled.
+static void RequestTexture(B3R_Texture* texture, const char* filepath) {
+	AssetLoader_Request(&g_asset_loader, filepath, DecodeImageAsset, texture);
+}
+
+static void RequestImportedMesh(ImportedMesh* mesh, const char* filepath) {
+	AssetLoader_Request(&g_asset_loader, filepath, DecodeMeshAsset, mesh);
+}
+
+static void CompleteImageAsset(AssetLoader_Asset* asset) {
+	B3R_Texture* texture = (B3R_Texture*)asset->user_data;
+	if (asset->result) {
+		DecodedImage* image = (DecodedImage*)asset->result;
+		B3R_TextureInit(texture, image->width, image->height, image->pixels);
+	} else {
+		bool ok = TextureInitFromDDSData(texture, STR_View{asset->file_data, asset->file_size});
+		assert(ok);
+	}
+	AssetLoader_Free(asset);
+}
+
+static void CompleteMeshAsset(AssetLoader_Asset* asset) {
+	*(ImportedMesh*)asset->user_data = *(ImportedMesh*)asset->result;
+	DS_ArrPush(&g_mesh_assets, asset);
+}
+
+// Called once per frame
+static void PollAssets() {
+	for (AssetLoader_Asset* asset = AssetLoader_Poll(&g_asset_loader); asset;) {
+		AssetLoader_Asset* next = asset->next;
+		AssetLoader_PrintTimings(stdout, asset);
+		assert(asset->ok); // just assert for now, every asset is required
+
+		if (asset->decode_fn == DecodeImageAsset) CompleteImageAsset(asset);
+		else CompleteMeshAsset(asset);
+		asset = next;
+	}
+
+	if (!g_assets_ready && AssetLoader_PendingCount(&g_asset_loader) == 0) {
+		g_assets_ready = true;
+		LeafMeshInit(&g_leaf_mesh, &g_persist_arena, &g_imported_mesh_leaf);
+		SimulationThreadStart(&g_sim_thread, g_replay_mode != ReplayMode_None);
+	}
+}
+
+int main(int argc, char** argv) {
+#ifdef ALLOC_PROFILER_ENABLED
+	AllocProfiler_Init(DS_KIB(256));
+#endif
+
+	// Start loading the assets first, so that they load while the window and the UI are being initialized
+	AssetLoader_Init(&g_asset_loader, 3);
+	RequestImportedMesh(&g_imported_mesh_leaf, "../resources/leaf_with_morph_targets.glb");
+	RequestImportedMesh(&g_imported_mesh_bud, "../resources/bud.glb");
+	RequestImportedMesh(&g_imported_mesh_unit_cube, "../resources/unit_cube.glb");
+
 	InitApp();
+	DS_ArrInit(&g_mesh_assets, &g_persist_arena);
+	if (!InitReplay(argc, argv)) return 1;
 	
 	g_camera.pos.Y = -0.6f;
 	g_camera.pos.Z = 0.3f;
 	
 	UI_CurveInit(&g_apical_control_curve, &g_persist_arena);
-	DS_ArrPush(&g_apical_control_curve.points, {0.f, 0.5f});
-	DS_ArrPush(&g_apical_control_curve.points, {0.5f, 1.f});
-	DS_ArrPush(&g_apical_control_curve.points, {1.f, 0.5f});
-
-	DS_ArenaInit(&g_plant_arena, 256, DS_HEAP);
+	PlantPresetSetDefaultCurve(&g_apical_control_curve);
+	InitPresets();
+
+	DS_ArenaInitVirtual(&g_plant_arena, DS_GIB(16));
+
+	// The simulation thread owns these, so it samples them
+	MemTelemetry_RegisterArena("Forest arena", &g_plant_arena, MemGroup_Simulation);
+	MemTelemetry_RegisterCustom("Plant arenas", &g_forest, SampleForestPlantsMemory, MemGroup_Simulation);
+	static const char* snapshot_names[][2] = {{"Mesh snapshot 0 vertices", "Mesh snapshot 0 indices"}, {"Mesh snapshot 1 vertices", "Mesh snapshot 1 indices"}};
+	for (int i = 0; i < DS_ArrayCount(g_sim_thread.snapshots); i++) {
+		MemTelemetry_RegisterArena(snapshot_names[i][0], &g_sim_thread.snapshots[i].arena, MemGroup_Simulation);
+		MemTelemetry_RegisterArena(snapshot_names[i][1], &g_sim_thread.snapshots[i].index_arena, MemGroup_Simulation);
+	}
 
 	InitGrid(&g_grid_mesh, {0, 0, 0}, {0.1f, 0, 0}, {0, 0.1f, 0}, 25, UI_MakeColorF(0.6f, 0.6f, 0.6f, 1.f));
 	
-	g_imported_mesh_leaf = ImportMesh(&g_persist_arena, "../resources/leaf_with_morph_targets.glb");
-	g_imported_mesh_bud = ImportMesh(&g_persist_arena, "../resources/bud.glb");
-	g_imported_mesh_unit_cube = ImportMesh(&g_persist_arena, "../resources/unit_cube.glb");
-	
 	while (!OS_WINDOW_ShouldClose(&g_window)) {
+		MemTelemetry_Sample(MemGroup_Main); // sample before the reset to see the temp arena at its fullest
 		DS_ArenaReset(&g_temp_arena);
 
+		PollAssets();
+		if (g_replay_mode == ReplayMode_None) PollPresets(); // changes to the preset files aren't part of a replay
+
 		// Poll events and populate the `g_inputs` structure
 		{
 			INPUT_OS_Events input_events;
@@ -698,12 +1910,38 @@ int main() {
 			}
 			INPUT_OS_EndEvents(&input_events);
 		}
+		OS_WINDOW_GetMousePosition(&g_window, &g_mouse_position.x, &g_mouse_position.y);
 
+		if (!BeginReplayFrame(&g_inputs, &g_mouse_position)) break;
 		UpdateAndRender();
+		EndReplayFrame();
 	}
 	
+	if (g_assets_ready) SimulationThreadStop(&g_sim_thread);
+	AssetLoader_Deinit(&g_asset_loader);
+	DeinitReplay();
+
+	FILE* telemetry_file = fopen("memory_telemetry.json", "wb");
+	if (telemetry_file) {
+		MemTelemetry_WriteJSON(telemetry_file);
+		fclose(telemetry_file);
+	}
+
+	DeinitPresets();
+	ForestDeinit(&g_forest);
 	B3R_WireMeshDeinit(&g_grid_mesh);
 	DS_ArenaDeinit(&g_plant_arena);
+	for (int i = 0; i < g_mesh_assets.count; i++) AssetLoader_Free(g_mesh_assets[i]);
 
 	DeinitApp();
+
+#ifdef ALLOC_PROFILER_ENABLED
+	FILE* alloc_profile_file = fopen("alloc_profile.txt", "wb");
+	if (alloc_profile_file) {
+		AllocProfiler_WriteLeakReport(alloc_profile_file, 20);
+		fprintf(alloc_profile_file, "\n");
+		AllocProfiler_WriteHotSitesReport(alloc_profile_file, 20);
+		fclose(alloc_profile_file);
+	}
+#endif
 }
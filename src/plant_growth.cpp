@@ -1,14 +1,31 @@
+#include "utils/alloc_profiler.h"
 #include "Fire/fire_ds.h"
+
+#define FIRE_OS_SYNC_IMPLEMENTATION
+#include "Fire/fire_os_sync.h"
+
 #include "third_party/HandmadeMath.h"
 #include "utils/space_math.h"
+#include "utils/thread_pool.h"
 
 #include "curves.h"
 #include "plant_growth.h"
 
 // -- Constants ---------------------------------------------------------------
 #define SHADOW_VOLUME_SIZE 64
+#define LIGHT_FIELD_CHUNK_SHIFT 4
+#define LIGHT_FIELD_CHUNK_SIZE (1 << LIGHT_FIELD_CHUNK_SHIFT)
+#define PLANT_CHUNKS_PER_AXIS (SHADOW_VOLUME_SIZE / LIGHT_FIELD_CHUNK_SIZE + 1) // +1, because the plant box doesn't need to be aligned to chunks
+#define FOREST_CELL_SIZE (2 * SHADOW_VOLUME_SIZE) // large enough that plants with overlapping chunks are always in neighboring cells
+#define PLANT_ARENA_RESERVE_SIZE DS_GIB(1) // each plant has its own virtual arena; this is only address space
 // ----------------------------------------------------------------------------
 
+struct LightFieldChunk {
+	LightField* owner; // chunks that aren't owned by the plant's light field are shared with the field it was forked from, and must be copied before writing
+	ShadowMapPoint coord;
+	uint8_t voxels[LIGHT_FIELD_CHUNK_SIZE * LIGHT_FIELD_CHUNK_SIZE * LIGHT_FIELD_CHUNK_SIZE];
+};
+
 // Decelerate the function `y = x` with the strength of `f`.
 // The result comes to a full stop at `x = 1 / f` when `f > 0`.
 // https://www.desmos.com/calculator/ncskawbzlg
@@ -43,19 +60,68 @@ static float RandomFloat(uint32_t seed, float min, float max) {
 	return min + (RandomU32(seed) / (float)0xFFFFFFFF) * (max - min);
 }
 
+static float LateralRandomBias(Plant* plant, Bud* lateral) {
+	return RandomFloat(plant->lateral_random_seed + lateral->id, 0.f, 1.f);
+}
+
+// The point must be inside the plant's box
+static int GetChunkIndex(Plant* plant, int x, int y, int z) {
+	int chunk_x = (x >> LIGHT_FIELD_CHUNK_SHIFT) - plant->chunks_min.x;
+	int chunk_y = (y >> LIGHT_FIELD_CHUNK_SHIFT) - plant->chunks_min.y;
+	int chunk_z = (z >> LIGHT_FIELD_CHUNK_SHIFT) - plant->chunks_min.z;
+	return (chunk_z*PLANT_CHUNKS_PER_AXIS + chunk_y)*PLANT_CHUNKS_PER_AXIS + chunk_x;
+}
+
+static int GetVoxelIndex(int x, int y, int z) {
+	int local_x = x & (LIGHT_FIELD_CHUNK_SIZE - 1);
+	int local_y = y & (LIGHT_FIELD_CHUNK_SIZE - 1);
+	int local_z = z & (LIGHT_FIELD_CHUNK_SIZE - 1);
+	return (local_z*LIGHT_FIELD_CHUNK_SIZE + local_y)*LIGHT_FIELD_CHUNK_SIZE + local_x;
+}
+
+static uint8_t GetShadowValue(Plant* plant, int x, int y, int z) {
+	LightFieldChunk* chunk = plant->chunks[GetChunkIndex(plant, x, y, z)];
+	return chunk->voxels[GetVoxelIndex(x, y, z)];
+}
+
+static uint8_t* GetShadowValueForWrite(Plant* plant, int x, int y, int z) {
+	int chunk_index = GetChunkIndex(plant, x, y, z);
+	LightFieldChunk* chunk = plant->chunks[chunk_index];
+	
+	if (chunk->owner != plant->light_field) { // copy-on-write
+		LightFieldChunk* copy = (LightFieldChunk*)DS_CloneSize(plant->arena, chunk, sizeof(LightFieldChunk));
+		copy->owner = plant->light_field;
+		
+		// The map already has an entry for every chunk (see LightFieldFork), so this only writes a value and is safe to do while
+		// other plants of a different chunk range are growing.
+		*(LightFieldChunk**)DS_MapFindPtr(&plant->light_field->chunks, chunk->coord) = copy;
+		plant->chunks[chunk_index] = copy;
+		chunk = copy;
+	}
+	return &chunk->voxels[GetVoxelIndex(x, y, z)];
+}
+
+static bool PlantVolumeContains(Plant* plant, ShadowMapPoint p) {
+	return p.x >= plant->volume_min.x && p.x < plant->volume_min.x + SHADOW_VOLUME_SIZE &&
+		p.y >= plant->volume_min.y && p.y < plant->volume_min.y + SHADOW_VOLUME_SIZE &&
+		p.z >= plant->volume_min.z && p.z < plant->volume_min.z + SHADOW_VOLUME_SIZE;
+}
+
 static void IncrementShadowValue(Plant* plant, int x, int y, int z, uint8_t amount) {
-	uint8_t* val = &plant->shadow_volume[z*SHADOW_VOLUME_SIZE*SHADOW_VOLUME_SIZE + y*SHADOW_VOLUME_SIZE + x];
+	uint8_t* val = GetShadowValueForWrite(plant, x, y, z);
 	uint8_t val_before = *val;
 	*val = val_before + amount;
 	if (*val < val_before) *val = 255; // overflow
 }
 
 static void IncrementShadowValueClampedSquare(Plant* plant, int min_x, int max_x, int min_y, int max_y, int z, uint8_t amount) {
-	min_x = HMM_MIN(HMM_MAX(min_x, 0), SHADOW_VOLUME_SIZE - 1);
-	max_x = HMM_MIN(HMM_MAX(max_x, 0), SHADOW_VOLUME_SIZE - 1);
-	min_y = HMM_MIN(HMM_MAX(min_y, 0), SHADOW_VOLUME_SIZE - 1);
-	max_y = HMM_MIN(HMM_MAX(max_y, 0), SHADOW_VOLUME_SIZE - 1);
-	z = HMM_MIN(HMM_MAX(z, 0), SHADOW_VOLUME_SIZE - 1);
+	ShadowMapPoint lo = plant->volume_min;
+	ShadowMapPoint hi = {lo.x + SHADOW_VOLUME_SIZE - 1, lo.y + SHADOW_VOLUME_SIZE - 1, lo.z + SHADOW_VOLUME_SIZE - 1};
+	min_x = HMM_MIN(HMM_MAX(min_x, lo.x), hi.x);
+	max_x = HMM_MIN(HMM_MAX(max_x, lo.x), hi.x);
+	min_y = HMM_MIN(HMM_MAX(min_y, lo.y), hi.y);
+	max_y = HMM_MIN(HMM_MAX(max_y, lo.y), hi.y);
+	z = HMM_MIN(HMM_MAX(z, lo.z), hi.z);
 
 	for (int y = min_y; y <= max_y; y++) {
 		for (int x = min_x; x <= max_x; x++) {
@@ -64,18 +130,19 @@ static void IncrementShadowValueClampedSquare(Plant* plant, int min_x, int max_x
 	}
 }
 
-static ShadowMapPoint PointToShadowMapSpace(Plant* plant, HMM_Vec3 point) {
-	int x = (int)((point.X + 0.5f) * SHADOW_VOLUME_SIZE);
-	int y = (int)((point.Y + 0.5f) * SHADOW_VOLUME_SIZE);
-	int z = (int)((point.Z) * SHADOW_VOLUME_SIZE);
+static ShadowMapPoint PointToShadowMapSpace(HMM_Vec3 point) {
+	int x = (int)floorf(point.X * SHADOW_VOLUME_SIZE);
+	int y = (int)floorf(point.Y * SHADOW_VOLUME_SIZE);
+	int z = (int)floorf(point.Z * SHADOW_VOLUME_SIZE);
 	return {x, y, z};
 }
 
 static bool FindOptimalGrowthDirection(Plant* plant, HMM_Vec3 point, HMM_Vec3* out_direction) {
-	ShadowMapPoint shadow_p = PointToShadowMapSpace(plant, point);
-	int min_x = HMM_MAX(shadow_p.x - 1, 0), max_x = HMM_MIN(shadow_p.x + 1, SHADOW_VOLUME_SIZE-1);
-	int min_y = HMM_MAX(shadow_p.y - 1, 0), max_y = HMM_MIN(shadow_p.y + 1, SHADOW_VOLUME_SIZE-1);
-	int min_z = HMM_MAX(shadow_p.z - 1, 0), max_z = HMM_MIN(shadow_p.z + 1, SHADOW_VOLUME_SIZE-1);
+	ShadowMapPoint shadow_p = PointToShadowMapSpace(point);
+	ShadowMapPoint lo = plant->volume_min;
+	int min_x = HMM_MAX(shadow_p.x - 1, lo.x), max_x = HMM_MIN(shadow_p.x + 1, lo.x + SHADOW_VOLUME_SIZE-1);
+	int min_y = HMM_MAX(shadow_p.y - 1, lo.y), max_y = HMM_MIN(shadow_p.y + 1, lo.y + SHADOW_VOLUME_SIZE-1);
+	int min_z = HMM_MAX(shadow_p.z - 1, lo.z), max_z = HMM_MIN(shadow_p.z + 1, lo.z + SHADOW_VOLUME_SIZE-1);
 	
 	HMM_Vec3 dir = {};
 	float dir_weight = 0.f;
@@ -86,7 +153,7 @@ static bool FindOptimalGrowthDirection(Plant* plant, HMM_Vec3 point, HMM_Vec3* o
 				int local_x = x - shadow_p.x, local_y = y - shadow_p.y, local_z = z - shadow_p.z;
 				if (local_x == 0 && local_y == 0 && local_z == 0) continue;
 				
-				uint8_t val = plant->shadow_volume[z*SHADOW_VOLUME_SIZE*SHADOW_VOLUME_SIZE + y*SHADOW_VOLUME_SIZE + x];
+				uint8_t val = GetShadowValue(plant, x, y, z);
 				float weight = 1.f - (float)val / 255.f;
 				HMM_Vec3 this_dir = {(float)local_x, (float)local_y, (float)local_z};
 				
@@ -109,7 +176,7 @@ static bool FindOptimalGrowthDirection(Plant* plant, HMM_Vec3 point, HMM_Vec3* o
 static void UpdateBudSamplePoint(Plant* plant, Bud* bud) {
 	HMM_Vec3 bud_end_point = bud->segments.count > 0 ? DS_ArrPeek(bud->segments).end_point : bud->base_point;
 	HMM_Quat bud_end_rotation = bud->segments.count > 0 ? DS_ArrPeek(bud->segments).end_rotation : bud->base_rotation;
-	bud->end_sample_point = PointToShadowMapSpace(plant, bud_end_point + HMM_RotateV3({0, 0, 1.5f/(float)SHADOW_VOLUME_SIZE}, bud_end_rotation));
+	bud->end_sample_point = PointToShadowMapSpace(bud_end_point + HMM_RotateV3({0, 0, 1.5f/(float)SHADOW_VOLUME_SIZE}, bud_end_rotation));
 }
 
 static void ApicalGrowth(Plant* plant, Bud* bud, float vigor) {
@@ -141,12 +208,9 @@ static void ApicalGrowth(Plant* plant, Bud* bud, float vigor) {
 
 		HMM_Vec3 new_end_point = bud_end_point + step_length * new_dir;
 
-		ShadowMapPoint shadow_p = PointToShadowMapSpace(plant, new_end_point);
+		ShadowMapPoint shadow_p = PointToShadowMapSpace(new_end_point);
 
-		if (shadow_p.x >= 0 && shadow_p.x < SHADOW_VOLUME_SIZE &&
-			shadow_p.y >= 0 && shadow_p.y < SHADOW_VOLUME_SIZE &&
-			shadow_p.z >= 0 && shadow_p.z < SHADOW_VOLUME_SIZE)
-		{
+		if (PlantVolumeContains(plant, shadow_p)) {
 			const float golden_ratio_rad_increment = 1.61803398875f * 3.1415926f * 2.f;
 
 			if (bud->segments.count == 0 || DS_ArrPeek(bud->segments).step_scale + step_scale > 1.f) {
@@ -169,10 +233,15 @@ static void ApicalGrowth(Plant* plant, Bud* bud, float vigor) {
 					new_bud->next_bud_angle_rad = bud->next_bud_angle_rad + golden_ratio_rad_increment;
 					new_bud->order = bud->order + 1;
 					DS_ArrInit(&new_bud->segments, plant->arena);
+					DS_ArrInit(&new_bud->lateral_dirs, plant->arena);
+					DS_ArrInit(&new_bud->lateral_random_biases, plant->arena);
 			
 					UpdateBudSamplePoint(plant, new_bud);
 			
 					last_segment->end_lateral = new_bud;
+					assert(bud->lateral_dirs.count == bud->segments.count - 1);
+					DS_ArrPush(&bud->lateral_dirs, HMM_RotateV3({0, 0, 1}, new_bud_rot));
+					DS_ArrPush(&bud->lateral_random_biases, LateralRandomBias(plant, new_bud));
 				}
 
 				StemSegment new_segment{};
@@ -339,20 +408,16 @@ static void BudGrow(Plant* plant, DS_Arena* temp, Bud* bud, float vigor, const P
 			}
 		}
 
-		for (int i = first_possible_active_bud; i < bud->segments.count - 1; i++) { // NOTE: the last segment may not ever have an active lateral bud!
-			StemSegment* segment = &bud->segments[i];
-			Bud* end_lateral = segment->end_lateral;
-			//if (segment.end_total_lightness + segment.end_lateral->total_lightness == 0.f) break;
-			HMM_Vec3 lateral_dir = HMM_RotateV3({0, 0, 1}, end_lateral->base_rotation); // @speed
-
-			float bud_random_strength_bias = RandomFloat(params->random_seed + end_lateral->id, 0.f, 1.f);
-
+		// NOTE: the last segment may not ever have an active lateral bud, so there's one lateral less than there are segments
+		const HMM_Vec3* lateral_dirs = bud->lateral_dirs.data;
+		const float* lateral_random_biases = bud->lateral_random_biases.data;
+		for (int i = first_possible_active_bud; i < bud->lateral_dirs.count; i++) {
 			// is this an active bud?
-			if (bud_random_strength_bias > threshold &&
-				HMM_DotV3(lateral_dir, prev_active_bud_direction) < 0.f)
+			if (lateral_random_biases[i] > threshold &&
+				HMM_DotV3(lateral_dirs[i], prev_active_bud_direction) < 0.f)
 			{
-				DS_ArrPush(&active_buds, end_lateral);
-				prev_active_bud_direction = lateral_dir;
+				DS_ArrPush(&active_buds, bud->segments[i].end_lateral);
+				prev_active_bud_direction = lateral_dirs[i];
 			}
 		}
 			
@@ -369,10 +434,15 @@ static void BudGrow(Plant* plant, DS_Arena* temp, Bud* bud, float vigor, const P
 	}
 }
 
-static float CalculateTotalLengthAndApplySegmentWidth(Plant* plant, Bud* bud) {
-	ShadowMapPoint shadow_p = bud->end_sample_point;
-	uint8_t val = plant->shadow_volume[shadow_p.z*SHADOW_VOLUME_SIZE*SHADOW_VOLUME_SIZE + shadow_p.y*SHADOW_VOLUME_SIZE + shadow_p.x];
+static void BudUpdateLateralRandomBiases(Plant* plant, Bud* bud) {
+	for (int i = 0; i < bud->lateral_random_biases.count; i++) {
+		Bud* lateral = bud->segments[i].end_lateral;
+		bud->lateral_random_biases[i] = LateralRandomBias(plant, lateral);
+		BudUpdateLateralRandomBiases(plant, lateral);
+	}
+}
 
+static float CalculateTotalLengthAndApplySegmentWidth(Plant* plant, Bud* bud) {
 	float total_length = 0.f;
 	float width = 0.f;
 
@@ -389,32 +459,324 @@ static float CalculateTotalLengthAndApplySegmentWidth(Plant* plant, Bud* bud) {
 	return total_length;
 }
 
-void PlantInit(Plant* plant, DS_Arena* arena) {
+void LightFieldInit(LightField* field, DS_Arena* arena) {
+	*field = {};
+	field->arena = arena;
+	DS_MapInit(&field->chunks, arena);
+}
+
+static LightFieldChunk* LightFieldGetOrAddChunk(LightField* field, ShadowMapPoint chunk_coord) {
+	LightFieldChunk** chunk;
+	if (DS_MapGetOrAddPtr(&field->chunks, chunk_coord, &chunk)) {
+		*chunk = (LightFieldChunk*)DS_ArenaPushZero(field->arena, sizeof(LightFieldChunk));
+		(*chunk)->owner = field;
+		(*chunk)->coord = chunk_coord;
+	}
+	return *chunk;
+}
+
+void LightFieldFork(LightField* field, const LightField* src, DS_Arena* arena) {
+	*field = {};
+	field->arena = arena;
+	field->has_shared_chunks = true;
+	DS_MapInitClone(&field->chunks, &src->chunks, arena);
+}
+
+// Another plant in the same forest may have copied a shared chunk since the last time this plant looked at it
+static void PlantRefreshSharedChunks(Plant* plant) {
+	for (int i = 0; i < PLANT_CHUNKS_PER_AXIS*PLANT_CHUNKS_PER_AXIS*PLANT_CHUNKS_PER_AXIS; i++) {
+		LightFieldChunk* chunk = plant->chunks[i];
+		if (chunk && chunk->owner != plant->light_field) {
+			plant->chunks[i] = *(LightFieldChunk**)DS_MapFindPtr(&plant->light_field->chunks, chunk->coord);
+		}
+	}
+}
+
+static void BudCloneInto(Bud* dst, const Bud* src, DS_Arena* arena) {
+	*dst = *src;
+	DS_ArrInit(&dst->segments, arena);
+	DS_ArrPushN(&dst->segments, src->segments.data, src->segments.count);
+	DS_ArrInit(&dst->lateral_dirs, arena);
+	DS_ArrPushN(&dst->lateral_dirs, src->lateral_dirs.data, src->lateral_dirs.count);
+	DS_ArrInit(&dst->lateral_random_biases, arena);
+	DS_ArrPushN(&dst->lateral_random_biases, src->lateral_random_biases.data, src->lateral_random_biases.count);
+	
+	for (int i = 0; i < dst->segments.count; i++) {
+		StemSegment* segment = &dst->segments[i];
+		if (segment->end_lateral) {
+			Bud* lateral = DS_New(Bud, arena);
+			BudCloneInto(lateral, segment->end_lateral, arena);
+			segment->end_lateral = lateral;
+		}
+	}
+}
+
+void PlantFork(Plant* plant, const Plant* src, DS_Arena* arena, LightField* light_field) {
+	*plant = *src;
+	plant->arena = arena;
+	plant->light_field = light_field;
+	
+	int chunks_size = PLANT_CHUNKS_PER_AXIS*PLANT_CHUNKS_PER_AXIS*PLANT_CHUNKS_PER_AXIS * sizeof(LightFieldChunk*);
+	plant->chunks = (LightFieldChunk**)DS_CloneSize(arena, src->chunks, chunks_size);
+	PlantRefreshSharedChunks(plant);
+
+	BudCloneInto(&plant->root, &src->root, arena);
+}
+
+void PlantInit(Plant* plant, DS_Arena* arena, LightField* light_field, HMM_Vec3 root_position) {
 	*plant = {};
 	plant->arena = arena;
+	plant->light_field = light_field;
+
+	ShadowMapPoint root_p = PointToShadowMapSpace(root_position);
+	plant->volume_min = {root_p.x - SHADOW_VOLUME_SIZE/2, root_p.y - SHADOW_VOLUME_SIZE/2, root_p.z};
+	
+	ShadowMapPoint volume_max = {plant->volume_min.x + SHADOW_VOLUME_SIZE - 1, plant->volume_min.y + SHADOW_VOLUME_SIZE - 1, plant->volume_min.z + SHADOW_VOLUME_SIZE - 1};
+	plant->chunks_min = {plant->volume_min.x >> LIGHT_FIELD_CHUNK_SHIFT, plant->volume_min.y >> LIGHT_FIELD_CHUNK_SHIFT, plant->volume_min.z >> LIGHT_FIELD_CHUNK_SHIFT};
+	ShadowMapPoint chunks_max = {volume_max.x >> LIGHT_FIELD_CHUNK_SHIFT, volume_max.y >> LIGHT_FIELD_CHUNK_SHIFT, volume_max.z >> LIGHT_FIELD_CHUNK_SHIFT};
+
+	plant->chunks = (LightFieldChunk**)DS_ArenaPushZero(arena, PLANT_CHUNKS_PER_AXIS*PLANT_CHUNKS_PER_AXIS*PLANT_CHUNKS_PER_AXIS * sizeof(LightFieldChunk*));
+	for (int z = plant->chunks_min.z; z <= chunks_max.z; z++) {
+		for (int y = plant->chunks_min.y; y <= chunks_max.y; y++) {
+			for (int x = plant->chunks_min.x; x <= chunks_max.x; x++) {
+				int i = ((z - plant->chunks_min.z)*PLANT_CHUNKS_PER_AXIS + (y - plant->chunks_min.y))*PLANT_CHUNKS_PER_AXIS + (x - plant->chunks_min.x);
+				plant->chunks[i] = LightFieldGetOrAddChunk(light_field, {x, y, z});
+			}
+		}
+	}
+
 	plant->root.id = plant->next_bud_id++;
-	plant->root.base_point = {0.5f/SHADOW_VOLUME_SIZE, 0.5f/SHADOW_VOLUME_SIZE, 0.5f/SHADOW_VOLUME_SIZE};
+	plant->root.base_point = {((float)root_p.x + 0.5f)/SHADOW_VOLUME_SIZE, ((float)root_p.y + 0.5f)/SHADOW_VOLUME_SIZE, ((float)root_p.z + 0.5f)/SHADOW_VOLUME_SIZE};
 	plant->root.base_rotation = {0, 0, 0, 1};
-	plant->shadow_volume = (uint8_t*)DS_ArenaPushZero(arena, SHADOW_VOLUME_SIZE * SHADOW_VOLUME_SIZE * SHADOW_VOLUME_SIZE * sizeof(uint8_t));
 	DS_ArrInit(&plant->root.segments, arena);
+	DS_ArrInit(&plant->root.lateral_dirs, arena);
+	DS_ArrInit(&plant->root.lateral_random_biases, arena);
 }
 
-bool PlantDoGrowthIteration(Plant* plant, DS_Arena* temp, const PlantParameters* params) {
+bool PlantDoGrowthIteration(Plant* plant, const PlantParameters* params) {
 	float age = 10.f + CalculateTotalLengthAndApplySegmentWidth(plant, &plant->root);
 	if (age > params->max_age) return false;
 
- 	BudGrow(plant, temp, &plant->root, params->vigor_scale * age, params);
+	// The seed may be changed in the middle of growing
+	uint32_t lateral_random_seed = params->random_seed + plant->random_seed;
+	if (plant->lateral_random_seed != lateral_random_seed) {
+		plant->lateral_random_seed = lateral_random_seed;
+		BudUpdateLateralRandomBiases(plant, &plant->root);
+	}
+
+ 	DS_Scope scratch = DS_ScratchBegin(NULL, 0);
+ 	BudGrow(plant, scratch.arena, &plant->root, params->vigor_scale * age, params);
+	DS_ScratchEnd(&scratch);
 	plant->age++;
 
 	return true;
 }
 
 float GetLightnessAtPoint(Plant* plant, HMM_Vec3 p) {
-	ShadowMapPoint shadow_p = PointToShadowMapSpace(plant, p);
-	assert(shadow_p.x >= 0 && shadow_p.y >= 0 && shadow_p.z >= 0);
-	assert(shadow_p.x < SHADOW_VOLUME_SIZE && shadow_p.y < SHADOW_VOLUME_SIZE && shadow_p.z < SHADOW_VOLUME_SIZE);
+	ShadowMapPoint shadow_p = PointToShadowMapSpace(p);
+	assert(PlantVolumeContains(plant, shadow_p));
 	
-	int voxel_index = shadow_p.z*SHADOW_VOLUME_SIZE*SHADOW_VOLUME_SIZE + shadow_p.y*SHADOW_VOLUME_SIZE + shadow_p.x;
-	float lightness = 1.f - 2.f*(float)plant->shadow_volume[voxel_index] / 255.f;
+	float lightness = 1.f - 2.f*(float)GetShadowValue(plant, shadow_p.x, shadow_p.y, shadow_p.z) / 255.f;
 	return HMM_MAX(lightness, 0.f);
 }
+
+void ForestInit(Forest* forest, DS_Arena* arena) {
+	*forest = {};
+	forest->arena = arena;
+	LightFieldInit(&forest->light_field, arena);
+	DS_ArrInit(&forest->plants, arena);
+	DS_ArrInit(&forest->waves, arena);
+	DS_MapInit(&forest->plants_by_cell, arena);
+}
+
+// Overlap is tested at chunk granularity, because plants that grow at the same time must never write to the same chunk.
+// Otherwise, both could copy the same shared chunk in a forked forest.
+static bool PlantChunksOverlap(const Plant* a, const Plant* b) {
+	const int n = PLANT_CHUNKS_PER_AXIS;
+	return a->chunks_min.x < b->chunks_min.x + n && b->chunks_min.x < a->chunks_min.x + n &&
+		a->chunks_min.y < b->chunks_min.y + n && b->chunks_min.y < a->chunks_min.y + n &&
+		a->chunks_min.z < b->chunks_min.z + n && b->chunks_min.z < a->chunks_min.z + n;
+}
+
+static void ForestRegisterPlant(Forest* forest, Plant* plant);
+
+void ForestDeinit(Forest* forest) {
+	for (int i = 0; i < forest->plants.count; i++) {
+		DS_ArenaDeinit(forest->plants[i]->arena);
+	}
+}
+
+Plant* ForestAddPlant(Forest* forest, HMM_Vec3 root_position) {
+	// Plants of the same wave grow at the same time, so each plant needs its own arena
+	DS_Arena* plant_arena = DS_New(DS_Arena, forest->arena);
+	DS_ArenaInitVirtual(plant_arena, PLANT_ARENA_RESERVE_SIZE);
+
+	Plant* plant = DS_New(Plant, forest->arena);
+	PlantInit(plant, plant_arena, &forest->light_field, root_position);
+	plant->random_seed = RandomU32(forest->plants.count);
+	ForestRegisterPlant(forest, plant);
+	return plant;
+}
+
+static void ForestRegisterPlant(Forest* forest, Plant* plant) {
+	DS_ArrPush(&forest->plants, plant);
+
+	// Any plant whose chunks overlap with this plant's chunks must be registered in one of the neighboring cells of this plant's cell.
+	ShadowMapPoint cell = {
+		(int)floorf((float)plant->volume_min.x / FOREST_CELL_SIZE),
+		(int)floorf((float)plant->volume_min.y / FOREST_CELL_SIZE),
+		(int)floorf((float)plant->volume_min.z / FOREST_CELL_SIZE)};
+
+	bool not_taken = false;
+	DS_DynArray(bool) wave_is_taken = {DS_HEAP};
+	DS_ArrResize(&wave_is_taken, not_taken, forest->waves.count + 1);
+
+	for (int z = cell.z - 1; z <= cell.z + 1; z++) {
+		for (int y = cell.y - 1; y <= cell.y + 1; y++) {
+			for (int x = cell.x - 1; x <= cell.x + 1; x++) {
+				ShadowMapPoint neighbor_cell = {x, y, z};
+				DS_DynArray(ForestCellEntry)* entries = DS_MapFindPtr(&forest->plants_by_cell, neighbor_cell);
+				if (entries == NULL) continue;
+				
+				for (int i = 0; i < entries->count; i++) {
+					ForestCellEntry entry = (*entries)[i];
+					if (PlantChunksOverlap(plant, entry.plant)) wave_is_taken[entry.wave] = true;
+				}
+			}
+		}
+	}
+	
+	int wave = 0;
+	while (wave_is_taken[wave]) wave++;
+	DS_ArrDeinit(&wave_is_taken);
+
+	if (wave == forest->waves.count) {
+		DS_DynArray(Plant*) new_wave = {forest->arena};
+		DS_ArrPush(&forest->waves, new_wave);
+	}
+	DS_ArrPush(&forest->waves[wave], plant);
+
+	DS_DynArray(ForestCellEntry)* cell_entries;
+	if (DS_MapGetOrAddPtr(&forest->plants_by_cell, cell, &cell_entries)) {
+		DS_ArrInit(cell_entries, forest->arena);
+	}
+	ForestCellEntry entry = {plant, wave};
+	DS_ArrPush(cell_entries, entry);
+}
+
+void ForestFork(Forest* forest, const Forest* src, DS_Arena* arena) {
+	*forest = {};
+	forest->arena = arena;
+	LightFieldFork(&forest->light_field, &src->light_field, arena);
+	DS_ArrInit(&forest->plants, arena);
+	DS_ArrInit(&forest->waves, arena);
+	DS_MapInit(&forest->plants_by_cell, arena);
+
+	for (int i = 0; i < src->plants.count; i++) {
+		DS_Arena* plant_arena = DS_New(DS_Arena, arena);
+		DS_ArenaInitVirtual(plant_arena, PLANT_ARENA_RESERVE_SIZE);
+
+		Plant* plant = DS_New(Plant, arena);
+		PlantFork(plant, src->plants[i], plant_arena, &forest->light_field);
+		ForestRegisterPlant(forest, plant); // The plants are registered in the same order, so they end up in the same waves as in `src`
+	}
+}
+
+struct ForestGrowWaveJob {
+	DS_DynArray(Plant*) plants;
+	const PlantParameters* params;
+	bool* modified;
+};
+
+static void ForestGrowWaveJobFn(void* user_data, int job_index, int worker_index) {
+	ForestGrowWaveJob* job = (ForestGrowWaveJob*)user_data;
+	
+	Plant* plant = job->plants[job_index];
+	if (plant->light_field->has_shared_chunks) PlantRefreshSharedChunks(plant);
+
+	job->modified[job_index] = PlantDoGrowthIteration(plant, job->params);
+}
+
+bool ForestDoGrowthIteration(Forest* forest, ThreadPool* pool, const PlantParameters* params) {
+	DS_Scope scratch = DS_ScratchBegin(NULL, 0);
+	bool* modified = (bool*)DS_ArenaPushZero(scratch.arena, forest->plants.count * sizeof(bool));
+	bool any_modified = false;
+
+	for (int i = 0; i < forest->waves.count; i++) {
+		ForestGrowWaveJob job = {forest->waves[i], params, modified};
+		ThreadPool_Run(pool, job.plants.count, ForestGrowWaveJobFn, &job);
+		
+		for (int j = 0; j < job.plants.count; j++) {
+			any_modified = any_modified || modified[j];
+		}
+	}
+
+	if (forest->light_field.has_shared_chunks) {
+		for (int i = 0; i < forest->plants.count; i++) PlantRefreshSharedChunks(forest->plants[i]);
+	}
+
+	DS_ScratchEnd(&scratch);
+	return any_modified;
+}
+
+void ForestSweepInit(ForestSweep* sweep, const Forest* base, const PlantParameters* variant_params, int variants_count) {
+	*sweep = {};
+	DS_ArrInit(&sweep->variants, DS_HEAP);
+	for (int i = 0; i < variants_count; i++) {
+		ForestSweepVariant* variant = (ForestSweepVariant*)DS_MemAlloc(DS_HEAP, sizeof(ForestSweepVariant));
+		*variant = {};
+		variant->params = variant_params[i];
+		DS_ArenaInit(&variant->arena, 4096, DS_HEAP);
+		ForestFork(&variant->forest, base, &variant->arena);
+		DS_ArrPush(&sweep->variants, variant);
+	}
+}
+
+void ForestSweepDeinit(ForestSweep* sweep) {
+	for (int i = 0; i < sweep->variants.count; i++) {
+		ForestSweepVariant* variant = sweep->variants[i];
+		ForestDeinit(&variant->forest);
+		DS_ArenaDeinit(&variant->arena);
+		DS_MemFree(DS_HEAP, variant);
+	}
+	DS_ArrDeinit(&sweep->variants);
+}
+
+struct ForestSweepJob {
+	ForestSweep* sweep;
+	bool* modified;
+};
+
+static void ForestSweepJobFn(void* user_data, int job_index, int worker_index) {
+	ForestSweepJob* job = (ForestSweepJob*)user_data;
+	ForestSweepVariant* variant = job->sweep->variants[job_index];
+	
+	// The variants are the unit of parallelism here, so each variant grows its plants on a single thread
+	job->modified[job_index] = ForestDoGrowthIteration(&variant->forest, NULL, &variant->params);
+}
+
+bool ForestSweepDoGrowthIteration(ForestSweep* sweep, ThreadPool* pool) {
+	DS_Scope scratch = DS_ScratchBegin(NULL, 0);
+	bool* modified = (bool*)DS_ArenaPushZero(scratch.arena, sweep->variants.count * sizeof(bool));
+
+	ForestSweepJob job = {sweep, modified};
+	ThreadPool_Run(pool, sweep->variants.count, ForestSweepJobFn, &job);
+
+	bool any_modified = false;
+	for (int i = 0; i < sweep->variants.count; i++) {
+		any_modified = any_modified || modified[i];
+	}
+
+	DS_ScratchEnd(&scratch);
+	return any_modified;
+}
+
+int64_t GrowthScratchPeakUsage(DS_OUT int* out_threads_count) {
+	int64_t peak_used = 0;
+	int threads_count = DS_ScratchThreadsCount();
+	for (int i = 0; i < threads_count; i++) {
+		peak_used = HMM_MAX(peak_used, DS_ScratchGetThreadStats(i).peak_used);
+	}
+	if (out_threads_count) *out_threads_count = threads_count;
+	return peak_used;
+}
@@ -1,10 +1,20 @@
 
 struct Bud;
+struct LightFieldChunk;
+struct ThreadPool;
 
 struct ShadowMapPoint {
 	int x, y, z;
 };
 
+// Sparse voxel grid of shadow values that any number of plants can grow into and cast shadows onto.
+// Chunks are allocated when a plant that covers them is added, so growing never modifies the chunk map.
+struct LightField {
+	DS_Arena* arena;
+	DS_Map(ShadowMapPoint, LightFieldChunk*) chunks; // key is the chunk coordinate
+	bool has_shared_chunks; // true if forked from another light field; see LightFieldFork
+};
+
 struct StemSegment {
 	HMM_Vec3 end_point;
 	HMM_Quat end_rotation;
@@ -30,6 +40,11 @@ struct Bud { // a bud can have grown into a branch, but we still call it a bud
 
 	DS_DynArray(StemSegment) segments;
 
+	// Constant per lateral bud, so they're computed once when the lateral is added. `lateral_dirs[i]` and `lateral_random_biases[i]`
+	// belong to `segments[i].end_lateral`. These are kept apart from StemSegment to keep the active bud scan in BudGrow tight.
+	DS_DynArray(HMM_Vec3) lateral_dirs;
+	DS_DynArray(float) lateral_random_biases; // see Plant::lateral_random_seed
+
 	bool is_dead;
 
 	float leaf_growth;
@@ -45,9 +60,33 @@ struct Plant {
 	DS_Arena* arena;
 	Bud root;
 	uint32_t next_bud_id;
+	uint32_t random_seed; // added to PlantParameters::random_seed, so that plants in a forest don't all look the same
 	int age;
-	float shadow_volume_half_extent;
-	uint8_t* shadow_volume;
+	uint32_t lateral_random_seed; // PlantParameters::random_seed + random_seed, at the time the lateral random biases were generated
+
+	// A plant may only grow inside its own box of SHADOW_VOLUME_SIZE^3 voxels of the light field,
+	// starting at `volume_min`. The chunks covering the box are cached in `chunks` to avoid going through the chunk map.
+	LightField* light_field;
+	ShadowMapPoint volume_min;
+	ShadowMapPoint chunks_min;
+	LightFieldChunk** chunks;
+};
+
+struct ForestCellEntry {
+	Plant* plant;
+	int wave;
+};
+
+// A forest is a group of plants that grow into a shared light field.
+// Plants are grouped into waves, where no two plants in the same wave have overlapping chunks. The plants of a wave are grown
+// in parallel, and the waves are grown one after another in the order they were created. This keeps the result
+// deterministic where the canopies meet, regardless of how many threads are used.
+struct Forest {
+	DS_Arena* arena;
+	LightField light_field;
+	DS_DynArray(Plant*) plants;
+	DS_DynArray(DS_DynArray(Plant*)) waves;
+	DS_Map(ShadowMapPoint, DS_DynArray(ForestCellEntry)) plants_by_cell; // plants are registered in the cell of `volume_min`
 };
 
 struct PlantParameters {
@@ -69,13 +108,54 @@ struct PlantParameters {
 	int final_apical_control;
 };
 
+struct ForestSweepVariant {
+	DS_Arena arena;
+	Forest forest;
+	PlantParameters params;
+};
+
+struct ForestSweep {
+	DS_DynArray(ForestSweepVariant*) variants;
+};
+
 // ----------------------------------------------------------------------------
 
-void PlantInit(Plant* plant, DS_Arena* arena);
+void LightFieldInit(LightField* field, DS_Arena* arena);
+
+// `root_position` is snapped to the light field voxel grid.
+void PlantInit(Plant* plant, DS_Arena* arena, LightField* light_field, HMM_Vec3 root_position);
 
 void PlantReset(Plant* plant);
 
-// Returns true if modifications were made
-bool PlantDoGrowthIteration(Plant* plant, DS_Arena* temp, const PlantParameters* params);
+// Returns true if modifications were made. Temporary memory is taken from the scratch arenas of the calling thread.
+bool PlantDoGrowthIteration(Plant* plant, const PlantParameters* params);
 
 float GetLightnessAtPoint(Plant* plant, HMM_Vec3 p);
+
+void ForestInit(Forest* forest, DS_Arena* arena);
+
+// Frees the memory of the plants. The memory allocated from the forest arena is left for the caller to free.
+void ForestDeinit(Forest* forest);
+
+// Forking copies the plants, but shares the light field chunks with `src` until a plant writes into them (copy-on-write).
+// `src` must not be modified or freed while the fork is alive.
+void LightFieldFork(LightField* field, const LightField* src, DS_Arena* arena);
+void PlantFork(Plant* plant, const Plant* src, DS_Arena* arena, LightField* light_field); // `light_field` must be forked from the light field of `src`
+void ForestFork(Forest* forest, const Forest* src, DS_Arena* arena);
+
+Plant* ForestAddPlant(Forest* forest, HMM_Vec3 root_position);
+
+// `pool` may be NULL. Returns true if modifications were made to any of the plants
+bool ForestDoGrowthIteration(Forest* forest, ThreadPool* pool, const PlantParameters* params);
+
+// Forks `base` into one variant per parameter set, so that the variants only need to grow from the current state of `base`
+// instead of starting over. Like with any fork, `base` must not be modified or freed while the sweep is alive.
+void ForestSweepInit(ForestSweep* sweep, const Forest* base, const PlantParameters* variant_params, int variants_count);
+void ForestSweepDeinit(ForestSweep* sweep);
+
+// The variants are grown in parallel. Returns true if modifications were made to any of the variants
+bool ForestSweepDoGrowthIteration(ForestSweep* sweep, ThreadPool* pool);
+
+// Each translation unit has its own scratch arenas (see DS_ScratchBegin), so this reports the scratch usage of the growth
+// code. Returns the highest peak usage in bytes among the threads that have grown plants.
+int64_t GrowthScratchPeakUsage(DS_OUT int* out_threads_count);
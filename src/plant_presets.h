@@ -0,0 +1,302 @@
+// Plant presets are PlantParameters plus the apical control curve, stored as Metadesk files (third_party/md.h) so that
+// they can be versioned and run in batches. A preset file looks like this:
+//
+//   random_seed: 1
+//   max_age: 1000
+//   ac_overall_factor: 0.01
+//   apical_control_curve: {
+//     interpolation: catmull_rom
+//     points: {(0, 0.5), (0.5, 1), (1, 0.5)}
+//   }
+//
+// Fields that a file leaves out keep their default values, so a preset only needs to list what it changes.
+//
+// Depends on `md.h` and `md.c` (compiled into the including file), `fire_ds.h`, `fire_string.h`, `utils/thread_pool.h`,
+// `curves.h` and `plant_growth.h`
+
+#define PLANT_PRESET_MAX_CURVE_POINTS 64 // CurveBake can't bake bezier curves with more control points than this
+
+enum PlantPresetFieldType {
+	PlantPresetFieldType_Float,
+	PlantPresetFieldType_U32,
+};
+
+struct PlantPresetField {
+	const char* name;
+	PlantPresetFieldType type;
+	int offset; // in PlantParameters
+};
+
+#define PLANT_PRESET_FIELD(TYPE, NAME) {#NAME, PlantPresetFieldType_##TYPE, (int)offsetof(PlantParameters, NAME)}
+
+static const PlantPresetField PlantPresetFields[] = {
+	PLANT_PRESET_FIELD(U32, random_seed),
+	PLANT_PRESET_FIELD(Float, max_age),
+	PLANT_PRESET_FIELD(Float, vigor_scale),
+	PLANT_PRESET_FIELD(Float, ac_base_dist_factor),
+	PLANT_PRESET_FIELD(Float, ac_stem_length_factor),
+	PLANT_PRESET_FIELD(Float, ac_order_factor),
+	PLANT_PRESET_FIELD(Float, ac_overall_factor),
+};
+
+// The names of CurveInterpolation values in preset files
+static const char* PlantPresetInterpolationNames[] = {"linear", "catmull_rom", "bezier"};
+static_assert(DS_ArrayCount(PlantPresetInterpolationNames) == CurveInterpolation_COUNT, "");
+
+struct PlantPreset {
+	PlantParameters params; // `apical_control_curve` is left NULL, since the preset may be moved
+	Curve apical_control_curve;
+};
+
+static const HMM_Vec2 PlantPresetDefaultCurvePoints[] = {{0.f, 0.5f}, {0.5f, 1.f}, {1.f, 0.5f}};
+
+static void PlantPresetSetDefaultCurve(Curve* curve) {
+	curve->interpolation = CurveInterpolation_Linear;
+	DS_ArrClear(&curve->points);
+	DS_ArrPushN(&curve->points, PlantPresetDefaultCurvePoints, DS_ArrayCount(PlantPresetDefaultCurvePoints));
+	CurveBake(curve);
+}
+
+static void PlantPresetInit(PlantPreset* preset, DS_Allocator* allocator) {
+	preset->params = {};
+	DS_ArrInit(&preset->apical_control_curve.points, allocator);
+	DS_ArrInit(&preset->apical_control_curve.baked_points, allocator);
+	PlantPresetSetDefaultCurve(&preset->apical_control_curve);
+}
+
+static void PlantPresetDeinit(PlantPreset* preset) {
+	DS_ArrDeinit(&preset->apical_control_curve.points);
+	DS_ArrDeinit(&preset->apical_control_curve.baked_points);
+}
+
+// Metadesk parses a leading minus sign as a symbol node of its own, so a number may take up two nodes. Advances `*node`
+// past the number. Returns false if `*node` isn't a number.
+static bool PlantPresetReadNumber(MD_Node** node, MD_String8* out_string, double* out_sign) {
+	MD_Node* n = *node;
+	*out_sign = 1.;
+	if (n->flags & MD_NodeFlag_Symbol && MD_S8Match(n->string, MD_S8Lit("-"), 0)) {
+		*out_sign = -1.;
+		n = n->next;
+	}
+	if (!(n->flags & MD_NodeFlag_Numeric)) return false;
+	*out_string = n->string;
+	*node = n->next;
+	return true;
+}
+
+static bool PlantPresetReadFloat(MD_Node** node, float* out) {
+	MD_String8 string;
+	double sign;
+	if (!PlantPresetReadNumber(node, &string, &sign)) return false;
+	*out = (float)(sign * MD_F64FromString(string));
+	return true;
+}
+
+static void PlantPresetError(int* errors_count, MD_Node* node, const char* message) {
+	MD_PrintMessage(stderr, MD_CodeLocFromNode(node), MD_MessageKind_Error, MD_S8CString((char*)message));
+	*errors_count += 1;
+}
+
+struct PlantPresetCurve {
+	CurveInterpolation interpolation;
+	HMM_Vec2 points[PLANT_PRESET_MAX_CURVE_POINTS];
+	int points_count;
+};
+
+static void PlantPresetParseCurve(MD_Node* curve_node, PlantPresetCurve* curve, int* errors_count) {
+	for (MD_EachNode(node, curve_node->first_child)) {
+		if (MD_S8Match(node->string, MD_S8Lit("interpolation"), 0)) {
+			int found = -1;
+			for (int i = 0; i < CurveInterpolation_COUNT; i++) {
+				if (MD_S8Match(node->first_child->string, MD_S8CString((char*)PlantPresetInterpolationNames[i]), 0)) found = i;
+			}
+			if (found == -1) PlantPresetError(errors_count, node, "Unknown interpolation, expected linear, catmull_rom or bezier");
+			else curve->interpolation = (CurveInterpolation)found;
+		}
+		else if (MD_S8Match(node->string, MD_S8Lit("points"), 0)) {
+			curve->points_count = 0;
+			for (MD_EachNode(point_node, node->first_child)) {
+				if (curve->points_count == PLANT_PRESET_MAX_CURVE_POINTS) {
+					PlantPresetError(errors_count, point_node, "Too many curve points");
+					break;
+				}
+				HMM_Vec2 p;
+				MD_Node* n = point_node->first_child;
+				bool ok = PlantPresetReadFloat(&n, &p.X) && PlantPresetReadFloat(&n, &p.Y) && MD_NodeIsNil(n);
+				if (!ok) {
+					PlantPresetError(errors_count, point_node, "Expected a point, e.g. (0.5, 1)");
+					continue;
+				}
+				if (!(p.X >= 0.f && p.X <= 1.f && p.Y >= 0.f && p.Y <= 1.f)) {
+					PlantPresetError(errors_count, point_node, "Curve points must be between (0, 0) and (1, 1)");
+				}
+				if (curve->points_count > 0 && p.X < curve->points[curve->points_count - 1].X) {
+					PlantPresetError(errors_count, point_node, "Curve points must be sorted along the X axis");
+				}
+				curve->points[curve->points_count++] = p;
+			}
+			if (curve->points_count == 0) PlantPresetError(errors_count, node, "A curve needs at least one point");
+		}
+		else {
+			PlantPresetError(errors_count, node, "Unknown curve field");
+		}
+	}
+}
+
+// Parses the text of a preset file into `preset`, which must be initialized. Errors are printed to stderr with the file
+// name and line. If there are any errors, `preset` is left unchanged and false is returned. Thread-safe.
+static bool PlantPresetParse(PlantPreset* preset, STR_View filename, STR_View text) {
+	MD_ArenaTemp md_scratch = MD_GetScratch(0, 0);
+	MD_ParseResult parse = MD_ParseWholeString(md_scratch.arena, MD_S8((MD_u8*)filename.data, filename.size), MD_S8((MD_u8*)text.data, text.size));
+
+	int errors_count = 0;
+	for (MD_Message* message = parse.errors.first; message; message = message->next) {
+		MD_PrintMessage(stderr, MD_CodeLocFromNode(message->node), message->kind, message->string);
+		if (message->kind >= MD_MessageKind_Error) errors_count++;
+	}
+
+	// Everything is parsed into a copy first, so that a file with errors (e.g. one that an editor is halfway through
+	// writing) doesn't leave the preset half-updated.
+	PlantParameters params = {};
+	PlantPresetCurve curve = {};
+	curve.interpolation = CurveInterpolation_Linear;
+	curve.points_count = DS_ArrayCount(PlantPresetDefaultCurvePoints);
+	memcpy(curve.points, PlantPresetDefaultCurvePoints, sizeof(PlantPresetDefaultCurvePoints));
+
+	for (MD_EachNode(node, parse.node->first_child)) {
+		if (MD_S8Match(node->string, MD_S8Lit("apical_control_curve"), 0)) {
+			PlantPresetParseCurve(node, &curve, &errors_count);
+			continue;
+		}
+
+		const PlantPresetField* field = NULL;
+		for (int i = 0; i < DS_ArrayCount(PlantPresetFields); i++) {
+			if (MD_S8Match(node->string, MD_S8CString((char*)PlantPresetFields[i].name), 0)) field = &PlantPresetFields[i];
+		}
+		if (field == NULL) {
+			PlantPresetError(&errors_count, node, "Unknown field");
+			continue;
+		}
+
+		MD_Node* value = node->first_child;
+		MD_String8 number;
+		double sign;
+		if (!PlantPresetReadNumber(&value, &number, &sign) || !MD_NodeIsNil(value)) {
+			PlantPresetError(&errors_count, node, "Expected a number");
+			continue;
+		}
+
+		void* dst = (char*)&params + field->offset;
+		if (field->type == PlantPresetFieldType_Float) {
+			*(float*)dst = (float)(sign * MD_F64FromString(number));
+		} else {
+			if (sign < 0.) PlantPresetError(&errors_count, node, "Expected an unsigned integer");
+			*(uint32_t*)dst = (uint32_t)MD_CStyleIntFromString(number);
+		}
+	}
+
+	if (errors_count == 0) {
+		preset->params = params;
+		preset->apical_control_curve.interpolation = curve.interpolation;
+		DS_ArrClear(&preset->apical_control_curve.points);
+		DS_ArrPushN(&preset->apical_control_curve.points, curve.points, curve.points_count);
+		CurveBake(&preset->apical_control_curve);
+	}
+
+	MD_ArenaEndTemp(md_scratch);
+	return errors_count == 0;
+}
+
+static void PlantPresetWrite(FILE* file, const PlantParameters* params, const Curve* apical_control_curve) {
+	for (int i = 0; i < DS_ArrayCount(PlantPresetFields); i++) {
+		const PlantPresetField* field = &PlantPresetFields[i];
+		const void* src = (const char*)params + field->offset;
+		if (field->type == PlantPresetFieldType_Float) fprintf(file, "%s: %.9g\n", field->name, *(const float*)src);
+		else fprintf(file, "%s: %u\n", field->name, *(const uint32_t*)src);
+	}
+
+	fprintf(file, "apical_control_curve: {\n");
+	fprintf(file, "\tinterpolation: %s\n", PlantPresetInterpolationNames[apical_control_curve->interpolation]);
+	fprintf(file, "\tpoints: {");
+	for (int i = 0; i < apical_control_curve->points.count; i++) {
+		HMM_Vec2 p = apical_control_curve->points.data[i];
+		fprintf(file, "%s(%.9g, %.9g)", i > 0 ? ", " : "", p.X, p.Y);
+	}
+	fprintf(file, "}\n}\n");
+}
+
+// Returns an empty string if the file can't be read
+static STR_View PlantPresetReadFile(DS_Arena* arena, const char* filepath) {
+	STR_View result = {};
+	FILE* f = fopen(filepath, "rb");
+	if (f == NULL) return result;
+
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	char* data = DS_ArenaPush(arena, (int)size);
+	if (fread(data, 1, size, f) == (size_t)size) {
+		result.data = data;
+		result.size = (int)size;
+	}
+	fclose(f);
+	return result;
+}
+
+// -- Batch loading --
+// Loads many presets at once, e.g. for running sweeps over them. The files are read and parsed in parallel on a thread
+// pool, and each thread allocates the curves of its presets from its own arena, so loading takes no locks.
+
+#define PLANT_PRESET_BATCH_JOB_SIZE 16 // presets per thread pool job
+
+struct PlantPresetBatch {
+	int count;
+	PlantPreset* presets;
+	bool* loaded; // false if the file couldn't be read or had errors
+	uint64_t* content_hashes; // DS_MurmurHash64A of each file, for telling apart saves that didn't change anything
+	const char** paths;
+	DS_Arena worker_arenas[THREAD_POOL_MAX_WORKERS + 1];
+	int worker_arenas_count;
+};
+
+static void PlantPresetBatchJob(void* user_data, int job_index, int worker_index) {
+	PlantPresetBatch* batch = (PlantPresetBatch*)user_data;
+	int first = job_index * PLANT_PRESET_BATCH_JOB_SIZE;
+	int end = HMM_MIN(first + PLANT_PRESET_BATCH_JOB_SIZE, batch->count);
+
+	for (int i = first; i < end; i++) {
+		PlantPreset* preset = &batch->presets[i];
+		PlantPresetInit(preset, &batch->worker_arenas[worker_index]);
+
+		DS_Scope scratch = DS_ScratchBegin(NULL, 0);
+		const char* path = batch->paths[i];
+		STR_View text = PlantPresetReadFile(scratch.arena, path);
+		batch->loaded[i] = text.data != NULL && PlantPresetParse(preset, STR_ToV(path), text);
+		batch->content_hashes[i] = DS_MurmurHash64A(text.data, text.size, 0);
+		DS_ScratchEnd(&scratch);
+	}
+}
+
+// `paths` must stay alive until this returns. `pool` may be NULL to load on the calling thread.
+static void PlantPresetBatchLoad(PlantPresetBatch* batch, const char** paths, int count, ThreadPool* pool) {
+	memset(batch, 0, sizeof(*batch));
+	batch->worker_arenas_count = ThreadPool_ThreadCount(pool);
+	for (int i = 0; i < batch->worker_arenas_count; i++) {
+		DS_ArenaInit(&batch->worker_arenas[i], 65536, DS_HEAP);
+	}
+
+	batch->count = count;
+	batch->presets = (PlantPreset*)DS_ArenaPush(&batch->worker_arenas[0], count * sizeof(PlantPreset));
+	batch->loaded = (bool*)DS_ArenaPushZero(&batch->worker_arenas[0], count * sizeof(bool));
+	batch->content_hashes = (uint64_t*)DS_ArenaPushZero(&batch->worker_arenas[0], count * sizeof(uint64_t));
+	batch->paths = paths;
+	ThreadPool_Run(pool, (count + PLANT_PRESET_BATCH_JOB_SIZE - 1) / PLANT_PRESET_BATCH_JOB_SIZE, PlantPresetBatchJob, batch);
+	batch->paths = NULL;
+}
+
+static void PlantPresetBatchDeinit(PlantPresetBatch* batch) {
+	for (int i = 0; i < batch->worker_arenas_count; i++) {
+		DS_ArenaDeinit(&batch->worker_arenas[i]);
+	}
+}
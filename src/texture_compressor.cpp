@@ -0,0 +1,88 @@
+// Offline texture compressor. Loads an image with stb_image, generates mips, compresses them into BC1, BC3 or BC7 and
+// writes the result into a DDS file that the app can upload without decoding anything.
+//
+// Usage: texture_compressor <input image> <output.dds> [bc1|bc3|bc7] [--no-mips]
+//   The format defaults to bc7. Use bc1 for textures that are opaque or have cutout alpha only.
+//
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "../Fire/fire_ds.h"
+
+#define FIRE_OS_TIMING_IMPLEMENTATION
+#include "../Fire/fire_os_timing.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "third_party/stb_image.h"
+
+#include "third_party/ddspp.h"
+#include "utils/texture_compressor.h"
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		printf("Usage: texture_compressor <input image> <output.dds> [bc1|bc3|bc7] [--no-mips]\n");
+		return 1;
+	}
+	const char* input_path = argv[1];
+	const char* output_path = argv[2];
+
+	TexCompress_Format format = TexCompress_Format_BC7;
+	bool generate_mips = true;
+	for (int i = 3; i < argc; i++) {
+		bool found = false;
+		for (int j = 0; j < (int)DS_ArrayCount(TexCompress_FormatNames); j++) {
+			if (strcmp(argv[i], TexCompress_FormatNames[j]) == 0) {
+				format = (TexCompress_Format)j;
+				found = true;
+			}
+		}
+		if (strcmp(argv[i], "--no-mips") == 0) {
+			generate_mips = false;
+			found = true;
+		}
+		if (!found) {
+			printf("Unknown option: %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	OS_TIMING_Init();
+
+	DS_Arena arena;
+	DS_ArenaInit(&arena, 4096, DS_HEAP);
+
+	uint64_t t0 = OS_TIMING_GetTick();
+
+	int width, height, num_channels;
+	uint8_t* rgba = stbi_load(input_path, &width, &height, &num_channels, 4);
+	if (rgba == NULL) {
+		printf("Failed to load %s: %s\n", input_path, stbi_failure_reason());
+		return 1;
+	}
+
+	uint64_t t1 = OS_TIMING_GetTick();
+
+	TexCompress_Image image = TexCompress_Compress(&arena, rgba, width, height, format, generate_mips);
+
+	uint64_t t2 = OS_TIMING_GetTick();
+
+	if (!TexCompress_WriteDDS(output_path, &image)) {
+		printf("Failed to write %s\n", output_path);
+		return 1;
+	}
+
+	printf("%s: %dx%d, %d mips, %s\n", input_path, width, height, image.mips_count, TexCompress_FormatNames[format]);
+	printf("  decode   %8.3f ms\n", OS_TIMING_GetDuration(t0, t1) * 1000.);
+	printf("  compress %8.3f ms\n", OS_TIMING_GetDuration(t1, t2) * 1000.);
+	printf("  %d bytes, was %d bytes as RGBA8 without mips\n", image.data_size, width * height * 4);
+	printf("Wrote %s\n", output_path);
+
+	stbi_image_free(rgba);
+	DS_ArenaDeinit(&arena);
+	return 0;
+}
@@ -0,0 +1,189 @@
+// Headless benchmark for fire_ui. Builds a large box tree out of UI_AddFmt rows every frame and reports how long
+// building the tree, computing the layout and generating the draw list takes. Formatting a label per row with STR_Form
+// into the frame arena is timed separately, since that's what most per-frame text in the app goes through.
+//
+// Usage: ui_benchmark [rows] [frames] [output.png]
+//   rows        number of UI_AddFmt rows to build per frame (default 5000)
+//   frames      number of frames to measure (default 200)
+//   output.png  if given, the last frame is rasterized on the CPU and written into this file
+//
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "../Fire/fire_ds.h"
+
+#define STR_USE_FIRE_DS_ARENA
+#include "../Fire/fire_string.h"
+
+#define FIRE_OS_TIMING_IMPLEMENTATION
+#include "../Fire/fire_os_timing.h"
+
+#define STB_RECT_PACK_IMPLEMENTATION
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "../Fire/fire_ui/stb_rect_pack.h"
+#include "../Fire/fire_ui/stb_truetype.h"
+
+#include "../Fire/fire_ui/fire_ui.h"
+#include "../Fire/fire_ui/fire_ui_extras.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "third_party/stb_image_write.h"
+
+#include "../Fire/fire_ui/fire_ui_backend_cpu.h"
+
+#define WINDOW_WIDTH 1280
+#define WINDOW_HEIGHT 720
+
+struct PhaseTiming {
+	double total_ms;
+	double min_ms;
+	double max_ms;
+};
+
+struct BenchmarkRow {
+	float value;
+	uint32_t count;
+	bool enabled;
+};
+
+static void PhaseTimingAdd(PhaseTiming* timing, uint64_t start, uint64_t end) {
+	double ms = OS_TIMING_GetDuration(start, end) * 1000.;
+	timing->total_ms += ms;
+	timing->min_ms = ms < timing->min_ms ? ms : timing->min_ms;
+	timing->max_ms = ms > timing->max_ms ? ms : timing->max_ms;
+}
+
+static void PhaseTimingPrint(const char* name, const PhaseTiming* timing, int frames) {
+	printf("  %-8s avg %8.3f ms   min %8.3f ms   max %8.3f ms\n", name, timing->total_ms / (double)frames, timing->min_ms, timing->max_ms);
+}
+
+static STR_View ReadEntireFile(DS_Arena* arena, const char* file) {
+	FILE* f = fopen(file, "rb");
+	if (f == NULL) return {};
+
+	fseek(f, 0, SEEK_END);
+	long fsize = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	char* data = DS_ArenaPush(arena, fsize);
+	fread(data, fsize, 1, f);
+
+	fclose(f);
+	STR_View result = {data, (int)fsize};
+	return result;
+}
+
+int main(int argc, char** argv) {
+	int rows_count = argc > 1 ? atoi(argv[1]) : 5000;
+	int frames_count = argc > 2 ? atoi(argv[2]) : 200;
+	const char* png_path = argc > 3 ? argv[3] : NULL;
+	if (rows_count <= 0 || frames_count <= 0) {
+		printf("Usage: ui_benchmark [rows] [frames] [output.png]\n");
+		return 1;
+	}
+
+	OS_TIMING_Init();
+
+	DS_Arena persist;
+	DS_ArenaInit(&persist, 4096, DS_HEAP);
+
+	STR_View roboto_mono_ttf = ReadEntireFile(&persist, "../fire/fire_ui/resources/roboto_mono.ttf");
+	if (roboto_mono_ttf.size == 0) roboto_mono_ttf = ReadEntireFile(&persist, "../Fire/fire_ui/resources/roboto_mono.ttf");
+	if (roboto_mono_ttf.size == 0) {
+		printf("Failed to load roboto_mono.ttf. Run the benchmark from the build directory.\n");
+		return 1;
+	}
+
+	UI_Backend ui_backend = {};
+	UI_CPU_Init(&ui_backend);
+	UI_Init(&persist, &ui_backend);
+
+	UI_FontIndex base_font = UI_FontInit(roboto_mono_ttf.data, -4.f);
+
+	BenchmarkRow* rows = (BenchmarkRow*)DS_ArenaPush(&persist, rows_count * sizeof(BenchmarkRow));
+	for (int i = 0; i < rows_count; i++) {
+		rows[i].value = (float)i * 0.25f;
+		rows[i].count = (uint32_t)i;
+		rows[i].enabled = (i & 1) != 0;
+	}
+
+	PhaseTiming format = {0., 1e9, 0.};
+	PhaseTiming build = {0., 1e9, 0.};
+	PhaseTiming layout = {0., 1e9, 0.};
+	PhaseTiming draw = {0., 1e9, 0.};
+	UI_Outputs ui_outputs = {};
+	int64_t formatted_bytes = 0;
+
+	for (int frame = 0; frame < frames_count; frame++) {
+		UI_Inputs ui_inputs = {};
+
+		uint64_t t0 = OS_TIMING_GetTick();
+
+		UI_BeginFrame(&ui_inputs, {WINDOW_WIDTH, WINDOW_HEIGHT}, {base_font, 18}, {base_font, 18});
+
+		UI_Box* root = UI_MakeRootBox(UI_KEY(), WINDOW_WIDTH, WINDOW_HEIGHT, UI_BoxFlag_DrawOpaqueBackground|UI_BoxFlag_DrawBorder);
+		root->inner_padding = {12.f, 12.f};
+		UI_PushBox(root);
+
+		for (int i = 0; i < rows_count; i++) {
+			UI_Key key = UI_HashInt(UI_KEY(), i);
+			UI_AddFmt(key, "Row %d: %!f  Count: %!u  Enabled: %!b", i, &rows[i].value, &rows[i].count, &rows[i].enabled);
+		}
+
+		UI_PopBox(root);
+
+		uint64_t t1 = OS_TIMING_GetTick();
+
+		UI_BoxComputeRects(root, {0.f, 0.f});
+
+		uint64_t t2 = OS_TIMING_GetTick();
+
+		UI_DrawBox(root);
+		UI_EndFrame(&ui_outputs);
+
+		uint64_t t3 = OS_TIMING_GetTick();
+
+		// The frame arena stays valid until the next UI_BeginFrame
+		for (int i = 0; i < rows_count; i++) {
+			STR_View label = STR_Form(UI_FrameArena(), "Row %d: %f  Count: %u  Enabled: %s", i, rows[i].value, rows[i].count, rows[i].enabled ? "yes" : "no");
+			formatted_bytes += label.size;
+		}
+
+		uint64_t t4 = OS_TIMING_GetTick();
+
+		PhaseTimingAdd(&build, t0, t1);
+		PhaseTimingAdd(&layout, t1, t2);
+		PhaseTimingAdd(&draw, t2, t3);
+		PhaseTimingAdd(&format, t3, t4);
+	}
+
+	printf("fire_ui benchmark: %d rows, %d frames\n", rows_count, frames_count);
+	PhaseTimingPrint("format", &format, frames_count);
+	PhaseTimingPrint("build", &build, frames_count);
+	PhaseTimingPrint("layout", &layout, frames_count);
+	PhaseTimingPrint("draw", &draw, frames_count);
+	printf("  last frame: %u vertices, %u indices, %d draw calls (%d before merging), %d atlas pages\n",
+		UI_STATE.draw_next_vertex, UI_STATE.draw_next_index, ui_outputs.draw_calls_count, ui_outputs.draw_calls_count_before_merge, UI_STATE.atlas_pages_count);
+	printf("  formatted %lld bytes per frame\n", (long long)(formatted_bytes / frames_count));
+	printf("  last frame uploads: %u vertex bytes, %u index bytes, %u atlas bytes\n",
+		ui_outputs.vertex_bytes_uploaded, ui_outputs.index_bytes_uploaded, ui_outputs.atlas_bytes_uploaded);
+
+	int result = 0;
+	if (png_path) {
+		if (UI_CPU_WritePNG(png_path, &ui_outputs, WINDOW_WIDTH, WINDOW_HEIGHT, UI_BLACK)) {
+			printf("Wrote %s\n", png_path);
+		}
+		else {
+			printf("Failed to write %s\n", png_path);
+			result = 1;
+		}
+	}
+
+	UI_Deinit();
+	UI_CPU_Deinit();
+	DS_ArenaDeinit(&persist);
+	return result;
+}
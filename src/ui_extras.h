@@ -1,10 +1,12 @@
 
 static void UI_CurveInit(Curve* curve, DS_Allocator* allocator) {
 	DS_ArrInit(&curve->points, allocator);
+	DS_ArrInit(&curve->baked_points, allocator);
 }
 
 static void UI_CurveDeinit(Curve* curve) {
 	DS_ArrDeinit(&curve->points);
+	DS_ArrDeinit(&curve->baked_points);
 }
 
 static void UI_PlugValCurve(UI_Box* box, Curve* curve) {
@@ -14,6 +16,7 @@ static void UI_PlugValCurve(UI_Box* box, Curve* curve) {
 
 	struct RetainedData {
 		DS_DynArray(bool) point_is_selected;
+		int selected_point_num; // 0 if none
 		bool drag_box_is_active;
 		UI_Vec2 drag_box_start;
 	};
@@ -25,9 +28,11 @@ static void UI_PlugValCurve(UI_Box* box, Curve* curve) {
 	DS_ArrResize(&data->point_is_selected, point_is_selected_default, curve->points.count);
 
 	UI_DrawRectLines(box->computed_rect, 2.f, UI_BLACK);
+	bool modified = false;
 
 	if (UI_InputWasPressed(UI_Input_MouseLeft)) {
 		memset(data->point_is_selected.data, 0, data->point_is_selected.count);
+		data->selected_point_num = 0;
 	}
 
 	if (UI_InputWasPressed(UI_Input_Delete) && curve->points.count > 2) {
@@ -35,6 +40,7 @@ static void UI_PlugValCurve(UI_Box* box, Curve* curve) {
 			if (data->point_is_selected[i]) {
 				DS_ArrRemove(&curve->points, i);
 				DS_ArrRemove(&data->point_is_selected, i);
+				modified = true;
 				i--;
 			}
 		}
@@ -48,6 +54,7 @@ static void UI_PlugValCurve(UI_Box* box, Curve* curve) {
 				HMM_Vec2 new_curve_p = {curve_p->X, 0.f};
 				DS_ArrInsert(&curve->points, i, new_curve_p);
 				data->selected_point_num = i + 1;
+				modified = true;
 				break;
 			}
 		}
@@ -70,10 +77,11 @@ static void UI_PlugValCurve(UI_Box* box, Curve* curve) {
 		}
 	}
 
-	UI_Vec2 prev_p = {0, 0};
+	int hovered_point_num = 0;
 	float prev_curve_p_x = 0.f;
 	for (int i = 0; i < curve->points.count; i++) {
 		HMM_Vec2* curve_p = &curve->points[i];
+		HMM_Vec2 old_curve_p = *curve_p;
 
 		UI_Vec2 p = {
 			curve_p->X*(box->computed_rect.max.x - box->computed_rect.min.x) + box->computed_rect.min.x, // lerp
@@ -110,15 +118,42 @@ static void UI_PlugValCurve(UI_Box* box, Curve* curve) {
 		}
 		p.x = curve_p->X*(box->computed_rect.max.x - box->computed_rect.min.x) + box->computed_rect.min.x; // lerp
 
+		if (curve_p->X != old_curve_p.X || curve_p->Y != old_curve_p.Y) {
+			modified = true;
+		}
+
+		if (is_hovered) hovered_point_num = i + 1;
+		prev_curve_p_x = curve_p->X;
+	}
+
+	if (modified || curve->baked_points.count == 0) {
+		CurveBake(curve);
+	}
+
+	UI_Vec2 prev_p = {0, 0};
+	for (int i = 0; i < curve->baked_points.count; i++) {
+		HMM_Vec2 baked_p = curve->baked_points[i];
+		UI_Vec2 p = {
+			baked_p.X*(box->computed_rect.max.x - box->computed_rect.min.x) + box->computed_rect.min.x, // lerp
+			(1.f - baked_p.Y)*(box->computed_rect.max.y - box->computed_rect.min.y) + box->computed_rect.min.y, // lerp
+		};
 		if (i > 0) {
 			UI_DrawLine(prev_p, p, 2.f, UI_LIME);
 		}
+		prev_p = p;
+	}
 
-		float r = is_hovered || is_selected ? 4.f : 3.f;
+	// Draw the control points on top of the curve
+	for (int i = 0; i < curve->points.count; i++) {
+		HMM_Vec2 curve_p = curve->points[i];
+		UI_Vec2 p = {
+			curve_p.X*(box->computed_rect.max.x - box->computed_rect.min.x) + box->computed_rect.min.x, // lerp
+			(1.f - curve_p.Y)*(box->computed_rect.max.y - box->computed_rect.min.y) + box->computed_rect.min.y, // lerp
+		};
+		bool is_selected = data->selected_point_num == i + 1;
+		float r = hovered_point_num == i + 1 || is_selected ? 4.f : 3.f;
 		UI_DrawRect({UI_SubV2(p, UI_VEC2{r, r}), UI_AddV2(p, UI_VEC2{r, r})}, is_selected ? UI_WHITE : UI_LIME);
 		//UI_DrawCircle(p, r, 8, is_selected ? UI_WHITE : (is_hovered ? UI_LIGHTGRAY : UI_GRAY));
-		prev_p = p;
-		prev_curve_p_x = curve_p->X;
 	}
 }
 
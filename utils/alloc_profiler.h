@@ -0,0 +1,461 @@
+// Sampling allocation profiler. Observes every DS_AllocatorFn call through DS_ALLOCATOR_HOOK, samples the allocations by
+// the number of bytes allocated, and reports the heap allocations that are still alive (leaks) and the call stacks that
+// allocate the most (hot sites).
+//
+// Depends on the C runtime only. The reports use DbgHelp on Windows and backtrace_symbols elsewhere.
+//
+// Usage:
+//   // In every translation unit, before fire_ds.h, and with ALLOC_PROFILER_ENABLED defined for the whole build:
+//   #define ALLOC_PROFILER_IMPLEMENTATION // in exactly one translation unit
+//   #include "utils/alloc_profiler.h"
+//   #include "fire_ds.h"
+//   ...
+//   AllocProfiler_Init(DS_KIB(512)); // before anything that should be profiled
+//   ...
+//   AllocProfiler_WriteLeakReport(file, 20);     // e.g. at exit, after everything has been freed
+//   AllocProfiler_WriteHotSitesReport(file, 20);
+//
+// Without ALLOC_PROFILER_ENABLED this file defines nothing and DS_AllocatorFn isn't hooked.
+//
+// Each thread counts down the bytes until its next sample, so an allocation that isn't sampled costs a subtraction and a
+// compare. The distances between samples are drawn from an exponential distribution with the mean `sample_interval`, which
+// makes every byte equally likely to be sampled, and a sample of `size` bytes stands for size / (1 - e^(-size/interval))
+// bytes of allocations. Sampled call stacks are stored once in a table and referred to by a 32-bit stack id, and are only
+// turned into names when writing a report.
+//
+// Frees have to find out whether the allocation was sampled. A shared table of counters indexed by the address hash is
+// checked first without locking, so only the frees of sampled allocations and the few that collide with them take the lock.
+// Only heap allocations are tracked for leaks, since arena allocations are never freed one by one. Arena allocations
+// count towards the hot sites only when they go through DS_AllocatorFn, e.g. DS_MemAlloc on an arena and the growth of
+// DS_DynArrays and DS_Maps. Direct DS_ArenaPush calls aren't seen, though the blocks that arenas take from the heap are.
+//
+
+#ifdef ALLOC_PROFILER_ENABLED
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef _MSC_VER
+#define ALLOC_PROFILER_THREAD_LOCAL __declspec(thread)
+#else
+#define ALLOC_PROFILER_THREAD_LOCAL __thread
+#endif
+
+#define ALLOC_PROFILER_FILTER_BITS 16
+#define ALLOC_PROFILER_MAX_FRAMES 24
+#define ALLOC_PROFILER_MAX_STACKS 8192 // stacks past this are counted under stack id 0
+
+struct AllocProfiler_Stats {
+	int64_t samples;
+	int64_t live_samples;     // sampled heap allocations that haven't been freed
+	int64_t stacks_count;
+	int64_t stacks_overflowed; // samples that didn't fit into the stack table
+};
+
+// Call before the threads that should be profiled start. Allocations made before this aren't tracked.
+void AllocProfiler_Init(int64_t sample_interval);
+
+// Sorted by the estimated number of bytes. `max_sites` limits the number of call stacks written.
+void AllocProfiler_WriteLeakReport(FILE* file, int max_sites);
+void AllocProfiler_WriteHotSitesReport(FILE* file, int max_sites);
+
+AllocProfiler_Stats AllocProfiler_GetStats(void);
+
+// -- Internal --------------------------------------------------------------
+
+extern ALLOC_PROFILER_THREAD_LOCAL int64_t AllocProfiler_bytes_until_sample;
+extern volatile uint16_t AllocProfiler_free_filter[1 << ALLOC_PROFILER_FILTER_BITS];
+
+void AllocProfiler_OnSample(bool heap, void* ptr, int size);
+void AllocProfiler_OnFilteredFree(const void* ptr);
+
+static inline uint32_t AllocProfiler_FilterIndex(const void* ptr) {
+	return (uint32_t)(((uint64_t)(uintptr_t)ptr * 0x9E3779B97F4A7C15ull) >> (64 - ALLOC_PROFILER_FILTER_BITS));
+}
+
+// Relaxed, the filter only needs to be exact for allocations that have been handed over to the freeing thread
+static inline uint16_t AllocProfiler_FilterLoad(volatile uint16_t* counter) {
+#ifdef _MSC_VER
+	return *counter;
+#else
+	return __atomic_load_n(counter, __ATOMIC_RELAXED);
+#endif
+}
+
+static inline void AllocProfiler_Hook(bool heap, const void* old_ptr, void* new_ptr, int new_size) {
+	if (old_ptr && heap && AllocProfiler_FilterLoad(&AllocProfiler_free_filter[AllocProfiler_FilterIndex(old_ptr)]) != 0) {
+		AllocProfiler_OnFilteredFree(old_ptr);
+	}
+	if (new_size > 0) {
+		AllocProfiler_bytes_until_sample -= new_size;
+		if (AllocProfiler_bytes_until_sample <= 0) AllocProfiler_OnSample(heap, new_ptr, new_size);
+	}
+}
+
+// Arenas are the only allocators that aren't the heap. Custom allocators aren't supported.
+#define DS_ALLOCATOR_HOOK(ALLOCATOR, OLD_PTR, OLD_SIZE, NEW_PTR, NEW_SIZE) \
+	AllocProfiler_Hook(((DS_AllocatorBase_Default*)(ALLOCATOR))->type == DS_AllocatorType_Heap, OLD_PTR, NEW_PTR, NEW_SIZE)
+
+#ifdef ALLOC_PROFILER_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <dbghelp.h>
+#pragma comment (lib, "dbghelp")
+#else
+#include <execinfo.h>
+#endif
+
+struct AllocProfiler_Stack {
+	uint64_t hash; // 0 if the slot is empty
+	int frames_count;
+	void* frames[ALLOC_PROFILER_MAX_FRAMES];
+
+	int64_t samples;
+	double bytes;  // estimated bytes allocated
+	double count;  // estimated number of allocations
+};
+
+struct AllocProfiler_Live {
+	void* ptr; // NULL if the slot is empty
+	uint32_t stack_id;
+	int size;
+	double weight; // estimated bytes that this sample stands for
+};
+
+struct AllocProfiler_ThreadState {
+	uint64_t rng; // 0 until the thread has taken its first sample
+};
+
+ALLOC_PROFILER_THREAD_LOCAL int64_t AllocProfiler_bytes_until_sample;
+volatile uint16_t AllocProfiler_free_filter[1 << ALLOC_PROFILER_FILTER_BITS];
+
+static ALLOC_PROFILER_THREAD_LOCAL AllocProfiler_ThreadState AllocProfiler_thread;
+static volatile long AllocProfiler_lock;
+static bool AllocProfiler_enabled;
+static int64_t AllocProfiler_sample_interval;
+
+// Protected by `AllocProfiler_lock`. Stack id 0 collects the samples that didn't fit into the table.
+static AllocProfiler_Stack* AllocProfiler_stacks;
+static AllocProfiler_Live* AllocProfiler_live;
+static int AllocProfiler_live_capacity; // power of two
+static AllocProfiler_Stats AllocProfiler_stats;
+
+static void AllocProfiler_Lock() {
+#ifdef _MSC_VER
+	while (_InterlockedExchange(&AllocProfiler_lock, 1) != 0) YieldProcessor();
+#else
+	while (__atomic_exchange_n(&AllocProfiler_lock, 1, __ATOMIC_ACQUIRE) != 0) {}
+#endif
+}
+
+static void AllocProfiler_Unlock() {
+#ifdef _MSC_VER
+	_InterlockedExchange(&AllocProfiler_lock, 0);
+#else
+	__atomic_store_n(&AllocProfiler_lock, 0, __ATOMIC_RELEASE);
+#endif
+}
+
+static void AllocProfiler_FilterStore(volatile uint16_t* counter, uint16_t value) {
+#ifdef _MSC_VER
+	*counter = value;
+#else
+	__atomic_store_n(counter, value, __ATOMIC_RELAXED);
+#endif
+}
+
+// Skips the frame of AllocProfiler_OnSample
+static int AllocProfiler_CaptureStack(void** frames, int max_frames) {
+#ifdef _WIN32
+	return (int)RtlCaptureStackBackTrace(1, (DWORD)max_frames, frames, NULL);
+#else
+	void* all_frames[ALLOC_PROFILER_MAX_FRAMES + 1];
+	int count = backtrace(all_frames, max_frames + 1) - 1;
+	if (count <= 0) return 0;
+	memcpy(frames, all_frames + 1, count * sizeof(void*));
+	return count;
+#endif
+}
+
+// xorshift64*, returns a number in (0, 1]
+static double AllocProfiler_Random(uint64_t* state) {
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	uint64_t x = *state * 0x2545F4914F6CDD1Dull;
+	return ((double)(x >> 11) + 1.) * (1. / 9007199254740992.);
+}
+
+static int64_t AllocProfiler_NextSampleDistance(uint64_t* rng) {
+	double distance = -log(AllocProfiler_Random(rng)) * (double)AllocProfiler_sample_interval;
+	return (int64_t)distance + 1;
+}
+
+static uint32_t AllocProfiler_FindOrAddStack(void** frames, int frames_count) {
+	uint64_t hash = 14695981039346656037ull;
+	for (int i = 0; i < frames_count; i++) {
+		hash = (hash ^ (uint64_t)(uintptr_t)frames[i]) * 1099511628211ull;
+	}
+	hash |= 1; // keep 0 for empty slots
+
+	uint32_t mask = ALLOC_PROFILER_MAX_STACKS - 1;
+	for (uint32_t i = (uint32_t)(hash >> 32) & mask, probes = 0; probes < ALLOC_PROFILER_MAX_STACKS / 2; i = (i + 1) & mask, probes++) {
+		if (i == 0) continue;
+		AllocProfiler_Stack* stack = &AllocProfiler_stacks[i];
+		if (stack->hash == hash && stack->frames_count == frames_count && memcmp(stack->frames, frames, frames_count * sizeof(void*)) == 0) {
+			return i;
+		}
+		if (stack->hash == 0) {
+			stack->hash = hash;
+			stack->frames_count = frames_count;
+			memcpy(stack->frames, frames, frames_count * sizeof(void*));
+			AllocProfiler_stats.stacks_count++;
+			return i;
+		}
+	}
+	AllocProfiler_stats.stacks_overflowed++;
+	return 0;
+}
+
+// The live table is open-addressed with linear probing, and removals shift the following entries back, so it needs no tombstones
+static uint32_t AllocProfiler_LiveSlot(const void* ptr) {
+	return (uint32_t)(((uint64_t)(uintptr_t)ptr * 0x9E3779B97F4A7C15ull) >> 32) & (uint32_t)(AllocProfiler_live_capacity - 1);
+}
+
+static void AllocProfiler_LiveInsert(AllocProfiler_Live entry);
+
+static void AllocProfiler_LiveGrow() {
+	AllocProfiler_Live* old_live = AllocProfiler_live;
+	int old_capacity = AllocProfiler_live_capacity;
+	AllocProfiler_live_capacity = old_capacity ? old_capacity * 2 : 4096;
+	AllocProfiler_live = (AllocProfiler_Live*)calloc(AllocProfiler_live_capacity, sizeof(AllocProfiler_Live));
+	for (int i = 0; i < old_capacity; i++) {
+		if (old_live[i].ptr) AllocProfiler_LiveInsert(old_live[i]);
+	}
+	free(old_live);
+}
+
+static void AllocProfiler_LiveInsert(AllocProfiler_Live entry) {
+	uint32_t mask = (uint32_t)AllocProfiler_live_capacity - 1;
+	uint32_t i = AllocProfiler_LiveSlot(entry.ptr);
+	while (AllocProfiler_live[i].ptr != NULL) i = (i + 1) & mask;
+	AllocProfiler_live[i] = entry;
+}
+
+static bool AllocProfiler_LiveRemove(const void* ptr) {
+	if (AllocProfiler_live_capacity == 0) return false;
+
+	uint32_t mask = (uint32_t)AllocProfiler_live_capacity - 1;
+	uint32_t i = AllocProfiler_LiveSlot(ptr);
+	for (; AllocProfiler_live[i].ptr != ptr; i = (i + 1) & mask) {
+		if (AllocProfiler_live[i].ptr == NULL) return false;
+	}
+
+	for (uint32_t j = (i + 1) & mask; AllocProfiler_live[j].ptr != NULL; j = (j + 1) & mask) {
+		// Move the entry at `j` into the hole at `i` if its home slot isn't between them
+		uint32_t home = AllocProfiler_LiveSlot(AllocProfiler_live[j].ptr);
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			AllocProfiler_live[i] = AllocProfiler_live[j];
+			i = j;
+		}
+	}
+	AllocProfiler_live[i].ptr = NULL;
+	return true;
+}
+
+void AllocProfiler_Init(int64_t sample_interval) {
+	AllocProfiler_Lock();
+	if (AllocProfiler_stacks == NULL) {
+		AllocProfiler_stacks = (AllocProfiler_Stack*)calloc(ALLOC_PROFILER_MAX_STACKS, sizeof(AllocProfiler_Stack));
+	}
+	AllocProfiler_sample_interval = sample_interval > 0 ? sample_interval : 1;
+	AllocProfiler_enabled = true;
+	AllocProfiler_Unlock();
+}
+
+void AllocProfiler_OnSample(bool heap, void* ptr, int size) {
+	AllocProfiler_ThreadState* thread = &AllocProfiler_thread;
+	if (!AllocProfiler_enabled) {
+		AllocProfiler_bytes_until_sample = 1 << 20; // check again later
+		return;
+	}
+	if (thread->rng == 0) {
+		// The first countdown of a thread starts from a random point instead of sampling its first allocation
+		thread->rng = ((uint64_t)(uintptr_t)thread * 0x9E3779B97F4A7C15ull) | 1;
+		AllocProfiler_bytes_until_sample = AllocProfiler_NextSampleDistance(&thread->rng);
+		return;
+	}
+
+	// An allocation that's larger than the distance to the next sample may cover several sample points
+	do {
+		AllocProfiler_bytes_until_sample += AllocProfiler_NextSampleDistance(&thread->rng);
+	} while (AllocProfiler_bytes_until_sample <= 0);
+
+	void* frames[ALLOC_PROFILER_MAX_FRAMES];
+	int frames_count = AllocProfiler_CaptureStack(frames, ALLOC_PROFILER_MAX_FRAMES);
+
+	double probability = 1. - exp(-(double)size / (double)AllocProfiler_sample_interval);
+	double weight = (double)size / probability;
+
+	AllocProfiler_Lock();
+	uint32_t stack_id = AllocProfiler_FindOrAddStack(frames, frames_count);
+	AllocProfiler_Stack* stack = &AllocProfiler_stacks[stack_id];
+	stack->samples++;
+	stack->bytes += weight;
+	stack->count += weight / (double)size;
+	AllocProfiler_stats.samples++;
+
+	if (heap) {
+		if ((AllocProfiler_stats.live_samples + 1) * 4 > (int64_t)AllocProfiler_live_capacity * 3) AllocProfiler_LiveGrow();
+		AllocProfiler_Live entry = {ptr, stack_id, size, weight};
+		AllocProfiler_LiveInsert(entry);
+		AllocProfiler_stats.live_samples++;
+
+		// The filter is only written under the lock. Readers may see a stale value, but never for an allocation that they
+		// got from a completed sample.
+		volatile uint16_t* filter = &AllocProfiler_free_filter[AllocProfiler_FilterIndex(ptr)];
+		uint16_t count = AllocProfiler_FilterLoad(filter);
+		if (count != UINT16_MAX) AllocProfiler_FilterStore(filter, count + 1); // a saturated counter stays on
+	}
+	AllocProfiler_Unlock();
+}
+
+void AllocProfiler_OnFilteredFree(const void* ptr) {
+	AllocProfiler_Lock();
+	if (AllocProfiler_LiveRemove(ptr)) {
+		AllocProfiler_stats.live_samples--;
+		volatile uint16_t* filter = &AllocProfiler_free_filter[AllocProfiler_FilterIndex(ptr)];
+		uint16_t count = AllocProfiler_FilterLoad(filter);
+		if (count != UINT16_MAX) AllocProfiler_FilterStore(filter, count - 1);
+	}
+	AllocProfiler_Unlock();
+}
+
+AllocProfiler_Stats AllocProfiler_GetStats(void) {
+	AllocProfiler_Lock();
+	AllocProfiler_Stats stats = AllocProfiler_stats;
+	AllocProfiler_Unlock();
+	return stats;
+}
+
+// -- Reports ---------------------------------------------------------------
+
+struct AllocProfiler_Site {
+	uint32_t stack_id;
+	int64_t samples;
+	double bytes;
+	double count;
+};
+
+static int AllocProfiler_CompareSites(const void* a, const void* b) {
+	double a_bytes = ((const AllocProfiler_Site*)a)->bytes, b_bytes = ((const AllocProfiler_Site*)b)->bytes;
+	return a_bytes < b_bytes ? 1 : a_bytes > b_bytes ? -1 : 0;
+}
+
+static void AllocProfiler_WriteStack(FILE* file, const AllocProfiler_Stack* stack) {
+#ifdef _WIN32
+	HANDLE process = GetCurrentProcess();
+	static bool symbols_initialized = false;
+	if (!symbols_initialized) {
+		SymSetOptions(SYMOPT_UNDNAME | SYMOPT_DEFERRED_LOADS | SYMOPT_LOAD_LINES);
+		SymInitialize(process, NULL, TRUE);
+		symbols_initialized = true;
+	}
+
+	for (int i = 0; i < stack->frames_count; i++) {
+		char symbol_buffer[sizeof(SYMBOL_INFO) + 256];
+		SYMBOL_INFO* symbol = (SYMBOL_INFO*)symbol_buffer;
+		memset(symbol, 0, sizeof(SYMBOL_INFO));
+		symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+		symbol->MaxNameLen = 255;
+
+		DWORD64 address = (DWORD64)(uintptr_t)stack->frames[i];
+		const char* name = SymFromAddr(process, address, NULL, symbol) ? symbol->Name : "?";
+
+		IMAGEHLP_LINE64 line = {sizeof(IMAGEHLP_LINE64)};
+		DWORD displacement;
+		if (SymGetLineFromAddr64(process, address, &displacement, &line)) {
+			fprintf(file, "      %s  %s:%u\n", name, line.FileName, (unsigned)line.LineNumber);
+		} else {
+			fprintf(file, "      %s  %p\n", name, stack->frames[i]);
+		}
+	}
+#else
+	char** names = backtrace_symbols(stack->frames, stack->frames_count);
+	for (int i = 0; i < stack->frames_count; i++) {
+		fprintf(file, "      %s\n", names ? names[i] : "?");
+	}
+	free(names);
+#endif
+}
+
+static void AllocProfiler_WriteSites(FILE* file, AllocProfiler_Site* sites, int sites_count, int max_sites) {
+	qsort(sites, sites_count, sizeof(AllocProfiler_Site), AllocProfiler_CompareSites);
+	for (int i = 0; i < sites_count && i < max_sites; i++) {
+		AllocProfiler_Site* site = &sites[i];
+		fprintf(file, "  ~%.1f KiB in ~%.0f allocations (%lld samples)\n", site->bytes / 1024., site->count, (long long)site->samples);
+		if (site->stack_id == 0) fprintf(file, "      (stack table full)\n");
+		else AllocProfiler_WriteStack(file, &AllocProfiler_stacks[site->stack_id]);
+	}
+	if (sites_count > max_sites) fprintf(file, "  ... and %d more sites\n", sites_count - max_sites);
+}
+
+void AllocProfiler_WriteLeakReport(FILE* file, int max_sites) {
+	AllocProfiler_Lock();
+
+	// Group the live samples by their stack
+	AllocProfiler_Site* sites = (AllocProfiler_Site*)calloc(ALLOC_PROFILER_MAX_STACKS, sizeof(AllocProfiler_Site));
+	double total_bytes = 0.;
+	for (int i = 0; i < AllocProfiler_live_capacity; i++) {
+		AllocProfiler_Live* live = &AllocProfiler_live[i];
+		if (live->ptr == NULL) continue;
+		AllocProfiler_Site* site = &sites[live->stack_id];
+		site->stack_id = live->stack_id;
+		site->samples++;
+		site->bytes += live->weight;
+		site->count += live->weight / (double)live->size;
+		total_bytes += live->weight;
+	}
+
+	int sites_count = 0;
+	for (int i = 0; i < ALLOC_PROFILER_MAX_STACKS; i++) {
+		if (sites[i].samples > 0) sites[sites_count++] = sites[i];
+	}
+
+	fprintf(file, "Leaks: %lld sampled heap allocations alive, ~%.1f KiB in %d sites\n",
+		(long long)AllocProfiler_stats.live_samples, total_bytes / 1024., sites_count);
+	AllocProfiler_WriteSites(file, sites, sites_count, max_sites);
+
+	free(sites);
+	AllocProfiler_Unlock();
+}
+
+void AllocProfiler_WriteHotSitesReport(FILE* file, int max_sites) {
+	AllocProfiler_Lock();
+
+	AllocProfiler_Site* sites = (AllocProfiler_Site*)calloc(ALLOC_PROFILER_MAX_STACKS, sizeof(AllocProfiler_Site));
+	int sites_count = 0;
+	double total_bytes = 0.;
+	for (int i = 0; i < ALLOC_PROFILER_MAX_STACKS; i++) {
+		AllocProfiler_Stack* stack = &AllocProfiler_stacks[i];
+		if (stack->samples == 0) continue;
+		AllocProfiler_Site site = {(uint32_t)i, stack->samples, stack->bytes, stack->count};
+		sites[sites_count++] = site;
+		total_bytes += stack->bytes;
+	}
+
+	fprintf(file, "Hot allocation sites: ~%.1f MiB allocated in %lld samples, %d sites (sample interval %lld bytes)\n",
+		total_bytes / (1024. * 1024.), (long long)AllocProfiler_stats.samples, sites_count, (long long)AllocProfiler_sample_interval);
+	AllocProfiler_WriteSites(file, sites, sites_count, max_sites);
+
+	free(sites);
+	AllocProfiler_Unlock();
+}
+
+#endif // ALLOC_PROFILER_IMPLEMENTATION
+#endif // ALLOC_PROFILER_ENABLED
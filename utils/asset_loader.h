@@ -0,0 +1,273 @@
+// Loads and decodes assets on background threads, so that startup isn't serialized on reading files and decoding them.
+//
+// Depends on `fire_ds.h`, `fire_os_sync.h` and `fire_os_timing.h`
+//
+// Usage:
+//   AssetLoader loader;
+//   AssetLoader_Init(&loader, 3);
+//   AssetLoader_Request(&loader, "leaf.png", DecodeImage, &my_texture); // DecodeImage runs on a worker thread
+//   ...
+//   // Once per frame:
+//   for (AssetLoader_Asset* asset = AssetLoader_Poll(&loader); asset;) {
+//       AssetLoader_Asset* next = asset->next;
+//       ... // e.g. upload the decoded pixels to the GPU
+//       AssetLoader_Free(asset);
+//       asset = next;
+//   }
+//   ...
+//   AssetLoader_Deinit(&loader);
+//
+// Requests reach the workers through a queue protected by a mutex, since idle workers sleep on a condition variable.
+// Finished assets are handed back through a lock-free list: the workers push onto it with a compare-exchange, and
+// AssetLoader_Poll takes the whole list over with a single atomic exchange, so polling never waits for a worker.
+//
+// Each asset has an arena of its own that holds the file contents and anything the decode function allocates. Keep the
+// asset around for as long as that memory is in use.
+//
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define ASSET_LOADER_MAX_WORKERS 8
+#define ASSET_LOADER_ARENA_RESERVE_SIZE DS_GIB(1) // per asset
+
+struct AssetLoader;
+struct AssetLoader_Asset;
+
+// Runs on a worker thread after the file has been read. Returns false if decoding failed.
+typedef bool (*AssetLoader_DecodeFn)(AssetLoader_Asset* asset);
+
+// Timestamps from OS_TIMING_GetTick
+struct AssetLoader_Timings {
+	uint64_t requested;
+	uint64_t started;  // a worker picked the request up
+	uint64_t read;     // the file was read
+	uint64_t decoded;
+	uint64_t polled;   // AssetLoader_Poll returned the asset
+};
+
+struct AssetLoader_Asset {
+	AssetLoader_Asset* next; // in the request queue, and in the list returned by AssetLoader_Poll
+	char* path;
+	AssetLoader_DecodeFn decode_fn;
+	void* user_data;
+	DS_Arena arena;
+
+	// Set by the worker
+	char* file_data; // NULL if the file couldn't be read
+	int64_t file_size;
+	void* result; // whatever `decode_fn` produces
+	bool ok;
+	int worker_index;
+	AssetLoader_Timings timings;
+};
+
+struct AssetLoader_Worker {
+	AssetLoader* loader;
+	int index;
+	OS_SYNC_Thread thread;
+};
+
+struct AssetLoader {
+	OS_SYNC_Mutex mutex;
+	OS_SYNC_ConditionVar work_available;
+	AssetLoader_Worker workers[ASSET_LOADER_MAX_WORKERS];
+	int workers_count;
+
+	// Protected by `mutex`
+	bool quit;
+	AssetLoader_Asset* queue_first;
+	AssetLoader_Asset* queue_last;
+
+	AssetLoader_Asset* volatile completed; // lock-free list of finished assets, most recent first
+
+	// Only touched by the thread that makes the requests and polls
+	int requests_count;
+	int polled_count;
+};
+
+static void* AssetLoader_AtomicLoadPtr(void* volatile* target) {
+#ifdef _MSC_VER
+	return *target; // volatile reads have acquire semantics on MSVC
+#else
+	return __atomic_load_n(target, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static void* AssetLoader_AtomicExchangePtr(void* volatile* target, void* value) {
+#ifdef _MSC_VER
+	return _InterlockedExchangePointer(target, value);
+#else
+	return __atomic_exchange_n(target, value, __ATOMIC_ACQ_REL);
+#endif
+}
+
+static bool AssetLoader_AtomicCompareExchangePtr(void* volatile* target, void* expected, void* desired) {
+#ifdef _MSC_VER
+	return _InterlockedCompareExchangePointer(target, desired, expected) == expected;
+#else
+	return __atomic_compare_exchange_n(target, &expected, desired, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+#endif
+}
+
+static void AssetLoader_ReadFile(AssetLoader_Asset* asset) {
+	FILE* f = fopen(asset->path, "rb");
+	if (f == NULL) return;
+
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	char* data = DS_ArenaPush(&asset->arena, (int)size + 1);
+	if (fread(data, 1, size, f) == (size_t)size) {
+		data[size] = 0; // null-terminate for text formats
+		asset->file_data = data;
+		asset->file_size = size;
+	}
+	fclose(f);
+}
+
+static void AssetLoader_Process(AssetLoader* loader, AssetLoader_Asset* asset, int worker_index) {
+	asset->worker_index = worker_index;
+	asset->timings.started = OS_TIMING_GetTick();
+
+	AssetLoader_ReadFile(asset);
+	asset->timings.read = OS_TIMING_GetTick();
+
+	asset->ok = asset->file_data != NULL && (asset->decode_fn == NULL || asset->decode_fn(asset));
+	asset->timings.decoded = OS_TIMING_GetTick();
+
+	// Push onto the completed list. The consumer only ever takes the whole list, so there's no ABA problem.
+	for (;;) {
+		AssetLoader_Asset* head = (AssetLoader_Asset*)AssetLoader_AtomicLoadPtr((void* volatile*)&loader->completed);
+		asset->next = head;
+		if (AssetLoader_AtomicCompareExchangePtr((void* volatile*)&loader->completed, head, asset)) break;
+	}
+}
+
+static void AssetLoader_WorkerThreadFn(void* user_data) {
+	AssetLoader_Worker* worker = (AssetLoader_Worker*)user_data;
+	AssetLoader* loader = worker->loader;
+
+	OS_SYNC_MutexLock(&loader->mutex);
+	for (;;) {
+		while (!loader->quit && loader->queue_first == NULL) {
+			OS_SYNC_ConditionVarWait(&loader->work_available, &loader->mutex);
+		}
+		if (loader->quit) break;
+
+		AssetLoader_Asset* asset = loader->queue_first;
+		loader->queue_first = asset->next;
+		if (loader->queue_first == NULL) loader->queue_last = NULL;
+		OS_SYNC_MutexUnlock(&loader->mutex);
+
+		AssetLoader_Process(loader, asset, worker->index);
+
+		OS_SYNC_MutexLock(&loader->mutex);
+	}
+	OS_SYNC_MutexUnlock(&loader->mutex);
+
+	DS_ScratchThreadDeinit();
+}
+
+// NOTE: The `loader` pointer may not be moved or copied while in use.
+static void AssetLoader_Init(AssetLoader* loader, int workers_count) {
+	assert(workers_count >= 1 && workers_count <= ASSET_LOADER_MAX_WORKERS);
+	memset(loader, 0, sizeof(*loader));
+	OS_SYNC_MutexInit(&loader->mutex);
+	OS_SYNC_ConditionVarInit(&loader->work_available);
+
+	loader->workers_count = workers_count;
+	for (int i = 0; i < workers_count; i++) {
+		AssetLoader_Worker* worker = &loader->workers[i];
+		worker->loader = loader;
+		worker->index = i;
+		OS_SYNC_ThreadStart(&worker->thread, AssetLoader_WorkerThreadFn, worker, "Asset loader");
+	}
+}
+
+static void AssetLoader_Free(AssetLoader_Asset* asset) {
+	DS_ArenaDeinit(&asset->arena);
+	DS_MemFree(DS_HEAP, asset);
+}
+
+// Requests that haven't been picked up are dropped, and assets that haven't been polled are freed.
+static void AssetLoader_Deinit(AssetLoader* loader) {
+	OS_SYNC_MutexLock(&loader->mutex);
+	loader->quit = true;
+	OS_SYNC_ConditionVarBroadcast(&loader->work_available);
+	OS_SYNC_MutexUnlock(&loader->mutex);
+
+	for (int i = 0; i < loader->workers_count; i++) {
+		OS_SYNC_ThreadJoin(&loader->workers[i].thread);
+	}
+
+	for (AssetLoader_Asset* asset = loader->queue_first; asset;) {
+		AssetLoader_Asset* next = asset->next;
+		AssetLoader_Free(asset);
+		asset = next;
+	}
+	for (AssetLoader_Asset* asset = loader->completed; asset;) {
+		AssetLoader_Asset* next = asset->next;
+		AssetLoader_Free(asset);
+		asset = next;
+	}
+
+	OS_SYNC_ConditionVarDestroy(&loader->work_available);
+	OS_SYNC_MutexDestroy(&loader->mutex);
+}
+
+// `decode_fn` may be NULL to only read the file. `path` is copied.
+static AssetLoader_Asset* AssetLoader_Request(AssetLoader* loader, const char* path, AssetLoader_DecodeFn decode_fn, void* user_data) {
+	AssetLoader_Asset* asset = (AssetLoader_Asset*)DS_MemAlloc(DS_HEAP, sizeof(AssetLoader_Asset));
+	memset(asset, 0, sizeof(*asset));
+	DS_ArenaInitVirtual(&asset->arena, ASSET_LOADER_ARENA_RESERVE_SIZE);
+
+	int path_size = (int)strlen(path) + 1;
+	asset->path = DS_ArenaPush(&asset->arena, path_size);
+	memcpy(asset->path, path, path_size);
+	asset->decode_fn = decode_fn;
+	asset->user_data = user_data;
+	asset->timings.requested = OS_TIMING_GetTick();
+
+	OS_SYNC_MutexLock(&loader->mutex);
+	if (loader->queue_last) loader->queue_last->next = asset;
+	else loader->queue_first = asset;
+	loader->queue_last = asset;
+	OS_SYNC_ConditionVarSignal(&loader->work_available);
+	OS_SYNC_MutexUnlock(&loader->mutex);
+
+	loader->requests_count++;
+	return asset;
+}
+
+// Returns the assets that finished since the last poll, in the order they finished, linked through `next`. Never blocks.
+static AssetLoader_Asset* AssetLoader_Poll(AssetLoader* loader) {
+	AssetLoader_Asset* list = (AssetLoader_Asset*)AssetLoader_AtomicExchangePtr((void* volatile*)&loader->completed, NULL);
+
+	uint64_t now = OS_TIMING_GetTick();
+	AssetLoader_Asset* result = NULL;
+	for (AssetLoader_Asset* asset = list; asset;) {
+		AssetLoader_Asset* next = asset->next;
+		asset->next = result;
+		asset->timings.polled = now;
+		result = asset;
+		asset = next;
+		loader->polled_count++;
+	}
+	return result;
+}
+
+// Number of requested assets that AssetLoader_Poll hasn't returned yet
+static int AssetLoader_PendingCount(AssetLoader* loader) {
+	return loader->requests_count - loader->polled_count;
+}
+
+static void AssetLoader_PrintTimings(FILE* file, const AssetLoader_Asset* asset) {
+	const AssetLoader_Timings* t = &asset->timings;
+	fprintf(file, "%s: %s, %lld KiB, queued %.2f ms, read %.2f ms, decode %.2f ms, ready after %.2f ms (worker %d)\n",
+		asset->path, asset->ok ? "ok" : "FAILED", (long long)(asset->file_size / 1024),
+		OS_TIMING_GetDuration(t->requested, t->started) * 1000., OS_TIMING_GetDuration(t->started, t->read) * 1000.,
+		OS_TIMING_GetDuration(t->read, t->decoded) * 1000., OS_TIMING_GetDuration(t->requested, t->polled) * 1000., asset->worker_index);
+}
@@ -40,6 +40,11 @@ typedef struct B3R_Texture {
 	ID3D11ShaderResourceView* texture_view;
 } B3R_Texture;
 
+typedef struct B3R_TextureMip {
+	const void* data;
+	uint32_t row_pitch; // bytes per row of pixels, or per row of blocks for block-compressed formats
+} B3R_TextureMip;
+
 //typedef struct B3R_Material {
 //	B3R_Texture* tex_color; // may be NULL
 //} B3R_Material;
@@ -66,6 +71,10 @@ static void B3R_WireMeshDeinit(B3R_WireMesh* mesh);
 
 // RGBA8 layout is expected
 static void B3R_TextureInit(B3R_Texture* texture, int width, int height, void* data);
+
+// Any format that D3D11 can sample, including block-compressed formats. `mips` is the full mip chain, starting from
+// the largest mip, and is uploaded as it is.
+static void B3R_TextureInitEx(B3R_Texture* texture, int width, int height, DXGI_FORMAT format, const B3R_TextureMip* mips, int mips_count);
 static void B3R_TextureDeinit(B3R_Texture* texture);
 
 // -- Drawing context --------------------------------------------------------------------------------
@@ -474,21 +483,29 @@ static void B3R_WireMeshDeinit(B3R_WireMesh* mesh) {
 }
 
 static void B3R_TextureInit(B3R_Texture* texture, int width, int height, void* data) {
+	B3R_TextureMip mip = {data, (uint32_t)width * sizeof(uint32_t)};
+	B3R_TextureInitEx(texture, width, height, DXGI_FORMAT_R8G8B8A8_UNORM, &mip, 1); //DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+}
+
+static void B3R_TextureInitEx(B3R_Texture* texture, int width, int height, DXGI_FORMAT format, const B3R_TextureMip* mips, int mips_count) {
 	D3D11_TEXTURE2D_DESC desc = {};
 	desc.Width              = width;  // in xube.h
 	desc.Height             = height; // in xube.h
-	desc.MipLevels          = 1;
+	desc.MipLevels          = mips_count;
 	desc.ArraySize          = 1;
-	desc.Format             = DXGI_FORMAT_R8G8B8A8_UNORM; //DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+	desc.Format             = format;
 	desc.SampleDesc.Count   = 1;
 	desc.Usage              = D3D11_USAGE_IMMUTABLE; // will never be updated
 	desc.BindFlags          = D3D11_BIND_SHADER_RESOURCE;
 
-	D3D11_SUBRESOURCE_DATA texture_data = {};
-	texture_data.pSysMem     = data;
-	texture_data.SysMemPitch = width * sizeof(uint32_t);
+	D3D11_SUBRESOURCE_DATA texture_data[16] = {};
+	assert(mips_count <= 16);
+	for (int i = 0; i < mips_count; i++) {
+		texture_data[i].pSysMem     = mips[i].data;
+		texture_data[i].SysMemPitch = mips[i].row_pitch;
+	}
 
-	B3R_STATE.device->CreateTexture2D(&desc, &texture_data, &texture->texture);
+	B3R_STATE.device->CreateTexture2D(&desc, texture_data, &texture->texture);
 	B3R_STATE.device->CreateShaderResourceView(texture->texture, NULL, &texture->texture_view);
 }
 
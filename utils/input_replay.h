@@ -1,83 +1,579 @@
-// depends on key_input.h, fire_ds.h and stdio.h
+// Records the input of every frame into a file and plays it back.
+//
+// Depends on `key_input.h`, `fire_ds.h`, `fire_os_sync.h`, and the zlib functions of `stb_image.h` and
+// `stb_image_write.h` (their implementations must be compiled in)
+//
+// Usage:
+//   Replay replay;
+//   ReplayInit(&replay, "session.replay", play); // starts a new recording if there's nothing to play
+//   ...
+//   // Every frame, after the events have been polled into `inputs`:
+//   ReplayProcessFrame(&replay, &frame_arena, &inputs, &mouse_pos); // records them, or replaces them when playing
+//   ...
+//   ReplaySeek(&replay, 5000); // when playing, continue from any frame
+//   ...
+//   ReplayDeinit(&replay);
+//
+// File format:
+//   ReplayFileHeader
+//   Blocks, each a ReplayBlockHeader followed by `compressed_size` bytes of zlib data
+//   The block index, `blocks_count` ReplayIndexEntries
+//   ReplayFooter
+//
+// A block holds REPLAY_FRAMES_PER_BLOCK frames. Frames are encoded as changes to the previous frame: a flags byte, then
+// the events, the keys that went up or down, and the mouse movement, mostly as varints. A frame without input is a single
+// zero byte. The state that the deltas build on is reset at the start of every block, so each block can be decoded on
+// its own, and seeking only has to decode from the start of one block.
+//
+// While recording, full blocks are handed to a background thread that compresses and writes them, so a frame never waits
+// on the disk. The index and the footer are written by ReplayDeinit. If the program crashes before that, the index is
+// rebuilt from the block headers when the file is played, and only the frames that hadn't been written yet are lost.
+//
 
-#include <stdio.h>
+#define REPLAY_FILE_MAGIC   0x4C505252 // "RRPL"
+#define REPLAY_BLOCK_MAGIC  0x4B4C4252 // "RBLK"
+#define REPLAY_FOOTER_MAGIC 0x58445252 // "RRDX"
+#define REPLAY_VERSION 2
+#define REPLAY_FRAMES_PER_BLOCK 256
+#define REPLAY_ZLIB_QUALITY 8
+
+typedef struct { float x, y; } ReplayMousePos;
+
+typedef struct ReplayFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t frames_per_block;
+	uint32_t reserved;
+} ReplayFileHeader;
+
+typedef struct ReplayBlockHeader {
+	uint32_t magic;
+	uint32_t first_frame;
+	uint32_t frames_count;
+	uint32_t raw_size;
+	uint32_t compressed_size;
+} ReplayBlockHeader;
+
+typedef struct ReplayIndexEntry {
+	uint32_t first_frame;
+	uint32_t frames_count;
+	uint64_t offset; // of the ReplayBlockHeader
+} ReplayIndexEntry;
+
+typedef struct ReplayFooter {
+	uint64_t index_offset;
+	uint32_t blocks_count;
+	uint32_t frames_count;
+	uint32_t magic;
+	uint32_t reserved;
+} ReplayFooter;
+
+// Flags of an encoded frame
+enum {
+	ReplayFrameFlag_Events        = 1 << 0,
+	ReplayFrameFlag_KeyChanges    = 1 << 1,
+	ReplayFrameFlag_MouseWheel    = 1 << 2,
+	ReplayFrameFlag_RawMouse      = 1 << 3,
+	ReplayFrameFlag_MouseMoved    = 1 << 4, // followed by the change in whole pixels
+	ReplayFrameFlag_MousePosFloat = 1 << 5, // followed by the exact position, for positions that aren't whole pixels
+};
+
+// The state that frames are delta-encoded against
+typedef struct ReplayDeltaState {
+	bool key_is_down[INPUT_Key_COUNT];
+	ReplayMousePos mouse_pos;
+} ReplayDeltaState;
+
+// A block that's waiting for the writer thread
+typedef struct ReplayPendingBlock {
+	struct ReplayPendingBlock* next;
+	uint32_t first_frame;
+	uint32_t frames_count;
+	uint32_t raw_size;
+	uint8_t data[1]; // `raw_size` bytes
+} ReplayPendingBlock;
+
+typedef struct ReplayWriter {
+	OS_SYNC_Thread thread;
+	OS_SYNC_Mutex mutex;
+	OS_SYNC_ConditionVar wake;
+
+	// Protected by `mutex`
+	bool quit;
+	ReplayPendingBlock* first;
+	ReplayPendingBlock* last;
+
+	// Owned by the writer thread
+	FILE* file;
+	uint64_t offset;
+	DS_DynArray(ReplayIndexEntry) index;
+} ReplayWriter;
 
 typedef struct Replay {
 	bool playing;
-	int frame_index;
-	bool is_finished;
+	int frame_index; // number of frames processed, i.e. the index of the next frame
+	bool is_finished; // playback has reached the end
 	FILE* file;
-} Replay;
 
-typedef struct { float x, y; } ReplayMousePos;
+	ReplayDeltaState state;
+	DS_DynArray(uint8_t) block; // raw frame data of the current block
+
+	// Recording
+	ReplayWriter* writer;
+	int block_first_frame;
+	int block_frames_count;
 
-static void ReplayInit(Replay* replay, const char* filepath, bool record);
+	// Playback
+	int frames_count;
+	DS_DynArray(ReplayIndexEntry) index;
+	DS_DynArray(uint8_t) compressed;
+	int current_block; // -1 if no block is loaded
+	int block_read_offset;
+} Replay;
+
+static void ReplayInit(Replay* replay, const char* filepath, bool play);
 static void ReplayDeinit(Replay* replay);
-static void ReplayProcessFrame(Replay* replay, DS_Arena* frame_arena, Input_Frame* inputs, ReplayMousePos* mouse_pos);
+static void ReplayProcessFrame(Replay* replay, DS_Arena* frame_arena, INPUT_Frame* inputs, ReplayMousePos* mouse_pos);
+static bool ReplaySeek(Replay* replay, int frame_index); // returns false if the frame is past the end
 
-static void ReplayInit(Replay* replay, const char* filepath, bool play) {
-	replay->file = fopen(filepath, play ? "rb" : "wb");
-	if (replay->file == NULL) {
-		play = false;
-		replay->file = fopen(filepath, "wb"); // Begin a new recording if a recording doesn't exist
+// -- Encoding --------------------------------------------------------------
+
+static void ReplayWriteU8(DS_DynArray(uint8_t)* out, uint8_t value) {
+	DS_ArrPush(out, value);
+}
+
+static void ReplayWriteVarint(DS_DynArray(uint8_t)* out, uint32_t value) {
+	while (value >= 0x80) {
+		DS_ArrPush(out, (uint8_t)(value | 0x80));
+		value >>= 7;
 	}
-	assert(replay->file);
+	DS_ArrPush(out, (uint8_t)value);
+}
 
-	replay->playing = play;
-	replay->is_finished = false;
+static void ReplayWriteF32(DS_DynArray(uint8_t)* out, float value) {
+	DS_ArrPushN(out, (uint8_t*)&value, 4);
 }
 
-static void ReplayDeinit(Replay* replay) {
-	fclose(replay->file);
-	replay->file = NULL;
+static uint32_t ReplayZigZag(int32_t value) { return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31); }
+static int32_t ReplayUnZigZag(uint32_t value) { return (int32_t)(value >> 1) ^ -(int32_t)(value & 1); }
+
+// Mouse positions are stored as whole-pixel deltas when possible
+static bool ReplayIsWholePixel(float value) {
+	return value > -16777216.f && value < 16777216.f && (float)(int32_t)value == value;
 }
 
-static void ReplaySerializeData(Replay* replay, void* data, int size) {
-	if (replay->playing) {
-		replay->is_finished = fread(data, size, 1, replay->file) != 1;
+static void ReplayEncodeFrame(DS_DynArray(uint8_t)* out, ReplayDeltaState* state, const INPUT_Frame* inputs, ReplayMousePos mouse_pos) {
+	int key_changes_count = 0;
+	for (int i = 0; i < INPUT_Key_COUNT; i++) {
+		if (inputs->key_is_down[i] != state->key_is_down[i]) key_changes_count++;
+	}
+
+	uint8_t flags = 0;
+	if (inputs->events_count > 0) flags |= ReplayFrameFlag_Events;
+	if (key_changes_count > 0) flags |= ReplayFrameFlag_KeyChanges;
+	if (inputs->mouse_wheel_input[0] != 0.f || inputs->mouse_wheel_input[1] != 0.f) flags |= ReplayFrameFlag_MouseWheel;
+	if (inputs->raw_mouse_input[0] != 0.f || inputs->raw_mouse_input[1] != 0.f) flags |= ReplayFrameFlag_RawMouse;
+	if (mouse_pos.x != state->mouse_pos.x || mouse_pos.y != state->mouse_pos.y) {
+		bool whole = ReplayIsWholePixel(mouse_pos.x) && ReplayIsWholePixel(mouse_pos.y) &&
+			ReplayIsWholePixel(state->mouse_pos.x) && ReplayIsWholePixel(state->mouse_pos.y);
+		flags |= whole ? ReplayFrameFlag_MouseMoved : ReplayFrameFlag_MousePosFloat;
+	}
+	ReplayWriteU8(out, flags);
+
+	if (flags & ReplayFrameFlag_Events) {
+		ReplayWriteVarint(out, (uint32_t)inputs->events_count);
+		for (int i = 0; i < inputs->events_count; i++) {
+			const INPUT_Event* event = &inputs->events[i];
+			ReplayWriteU8(out, event->kind);
+			ReplayWriteU8(out, event->mouse_click_index);
+			ReplayWriteVarint(out, event->kind == INPUT_EventKind_TextCharacter ? event->text_character : (uint32_t)event->key);
+		}
+	}
+	if (flags & ReplayFrameFlag_KeyChanges) {
+		// The keys that changed, as deltas between increasing key indices
+		ReplayWriteVarint(out, (uint32_t)key_changes_count);
+		int prev_key = 0;
+		for (int i = 0; i < INPUT_Key_COUNT; i++) {
+			if (inputs->key_is_down[i] != state->key_is_down[i]) {
+				ReplayWriteVarint(out, (uint32_t)(i - prev_key));
+				prev_key = i;
+				state->key_is_down[i] = inputs->key_is_down[i];
+			}
+		}
+	}
+	if (flags & ReplayFrameFlag_MouseWheel) {
+		ReplayWriteF32(out, inputs->mouse_wheel_input[0]);
+		ReplayWriteF32(out, inputs->mouse_wheel_input[1]);
+	}
+	if (flags & ReplayFrameFlag_RawMouse) {
+		ReplayWriteF32(out, inputs->raw_mouse_input[0]);
+		ReplayWriteF32(out, inputs->raw_mouse_input[1]);
+	}
+	if (flags & ReplayFrameFlag_MouseMoved) {
+		ReplayWriteVarint(out, ReplayZigZag((int32_t)mouse_pos.x - (int32_t)state->mouse_pos.x));
+		ReplayWriteVarint(out, ReplayZigZag((int32_t)mouse_pos.y - (int32_t)state->mouse_pos.y));
+	}
+	if (flags & ReplayFrameFlag_MousePosFloat) {
+		ReplayWriteF32(out, mouse_pos.x);
+		ReplayWriteF32(out, mouse_pos.y);
+	}
+	state->mouse_pos = mouse_pos;
+}
+
+// -- Decoding --------------------------------------------------------------
+
+typedef struct ReplayReader {
+	const uint8_t* data;
+	int size;
+	int offset;
+	bool error; // read past the end
+} ReplayReader;
+
+static uint8_t ReplayReadU8(ReplayReader* r) {
+	if (r->offset >= r->size) { r->error = true; return 0; }
+	return r->data[r->offset++];
+}
+
+static uint32_t ReplayReadVarint(ReplayReader* r) {
+	uint32_t value = 0;
+	for (int shift = 0; shift < 35; shift += 7) {
+		uint8_t byte = ReplayReadU8(r);
+		value |= (uint32_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) break;
+	}
+	return value;
+}
+
+static float ReplayReadF32(ReplayReader* r) {
+	float value = 0.f;
+	if (r->offset + 4 > r->size) { r->error = true; return value; }
+	memcpy(&value, r->data + r->offset, 4);
+	r->offset += 4;
+	return value;
+}
+
+// If `inputs` is NULL, the frame is only decoded into `state`, e.g. when seeking
+static void ReplayDecodeFrame(ReplayReader* r, ReplayDeltaState* state, DS_Arena* frame_arena, INPUT_Frame* inputs, ReplayMousePos* mouse_pos) {
+	uint8_t flags = ReplayReadU8(r);
+
+	int events_count = 0;
+	INPUT_Event* events = NULL;
+	if (flags & ReplayFrameFlag_Events) {
+		events_count = (int)ReplayReadVarint(r);
+		if (events_count > r->size - r->offset) { r->error = true; return; } // every event takes at least 3 bytes
+		if (inputs) events = (INPUT_Event*)DS_ArenaPush(frame_arena, events_count * sizeof(INPUT_Event));
+		for (int i = 0; i < events_count; i++) {
+			INPUT_Event event = {};
+			event.kind = ReplayReadU8(r);
+			event.mouse_click_index = ReplayReadU8(r);
+			uint32_t value = ReplayReadVarint(r);
+			if (event.kind == INPUT_EventKind_TextCharacter) event.text_character = value;
+			else event.key = (INPUT_Key)(value < INPUT_Key_COUNT ? value : 0);
+			if (events) events[i] = event;
+		}
+	}
+	if (flags & ReplayFrameFlag_KeyChanges) {
+		int changes_count = (int)ReplayReadVarint(r);
+		uint32_t key = 0;
+		for (int i = 0; i < changes_count && !r->error; i++) {
+			key += ReplayReadVarint(r);
+			if (key >= INPUT_Key_COUNT) { r->error = true; break; }
+			state->key_is_down[key] = !state->key_is_down[key];
+		}
+	}
+
+	float wheel[2] = {0.f, 0.f};
+	float raw_mouse[2] = {0.f, 0.f};
+	if (flags & ReplayFrameFlag_MouseWheel) {
+		wheel[0] = ReplayReadF32(r);
+		wheel[1] = ReplayReadF32(r);
+	}
+	if (flags & ReplayFrameFlag_RawMouse) {
+		raw_mouse[0] = ReplayReadF32(r);
+		raw_mouse[1] = ReplayReadF32(r);
+	}
+	if (flags & ReplayFrameFlag_MouseMoved) {
+		state->mouse_pos.x = (float)((int32_t)state->mouse_pos.x + ReplayUnZigZag(ReplayReadVarint(r)));
+		state->mouse_pos.y = (float)((int32_t)state->mouse_pos.y + ReplayUnZigZag(ReplayReadVarint(r)));
+	}
+	if (flags & ReplayFrameFlag_MousePosFloat) {
+		state->mouse_pos.x = ReplayReadF32(r);
+		state->mouse_pos.y = ReplayReadF32(r);
+	}
+
+	if (inputs) {
+		inputs->events = events;
+		inputs->events_count = events_count;
+		memcpy(inputs->key_is_down, state->key_is_down, sizeof(inputs->key_is_down));
+		inputs->mouse_wheel_input[0] = wheel[0];
+		inputs->mouse_wheel_input[1] = wheel[1];
+		inputs->raw_mouse_input[0] = raw_mouse[0];
+		inputs->raw_mouse_input[1] = raw_mouse[1];
+		*mouse_pos = state->mouse_pos;
+	}
+}
+
+// -- Writer thread ---------------------------------------------------------
+
+static void ReplayWriterWriteBlock(ReplayWriter* writer, ReplayPendingBlock* block) {
+	int compressed_size = 0;
+	unsigned char* compressed = stbi_zlib_compress(block->data, (int)block->raw_size, &compressed_size, REPLAY_ZLIB_QUALITY);
+
+	ReplayBlockHeader header = {};
+	header.magic = REPLAY_BLOCK_MAGIC;
+	header.first_frame = block->first_frame;
+	header.frames_count = block->frames_count;
+	header.raw_size = block->raw_size;
+	header.compressed_size = (uint32_t)compressed_size;
+	fwrite(&header, sizeof(header), 1, writer->file);
+	fwrite(compressed, 1, compressed_size, writer->file);
+	STBIW_FREE(compressed);
+
+	ReplayIndexEntry entry = {block->first_frame, block->frames_count, writer->offset};
+	DS_ArrPush(&writer->index, entry);
+	writer->offset += sizeof(header) + compressed_size;
+
+	// Flush every block, so that a crash loses at most the blocks that haven't reached the writer yet
+	fflush(writer->file);
+}
+
+static void ReplayWriterThreadFn(void* user_data) {
+	ReplayWriter* writer = (ReplayWriter*)user_data;
+
+	OS_SYNC_MutexLock(&writer->mutex);
+	for (;;) {
+		while (!writer->quit && writer->first == NULL) {
+			OS_SYNC_ConditionVarWait(&writer->wake, &writer->mutex);
+		}
+		ReplayPendingBlock* block = writer->first;
+		if (block == NULL) break; // quit, and all blocks have been written
+
+		writer->first = block->next;
+		if (writer->first == NULL) writer->last = NULL;
+		OS_SYNC_MutexUnlock(&writer->mutex);
+
+		ReplayWriterWriteBlock(writer, block);
+		DS_MemFree(DS_HEAP, block);
+
+		OS_SYNC_MutexLock(&writer->mutex);
+	}
+	OS_SYNC_MutexUnlock(&writer->mutex);
+}
+
+// Hands the current block over to the writer thread
+static void ReplaySubmitBlock(Replay* replay) {
+	if (replay->block_frames_count == 0) return;
+
+	ReplayPendingBlock* block = (ReplayPendingBlock*)DS_MemAlloc(DS_HEAP, sizeof(ReplayPendingBlock) + replay->block.count);
+	block->next = NULL;
+	block->first_frame = (uint32_t)replay->block_first_frame;
+	block->frames_count = (uint32_t)replay->block_frames_count;
+	block->raw_size = (uint32_t)replay->block.count;
+	memcpy(block->data, replay->block.data, replay->block.count);
+
+	ReplayWriter* writer = replay->writer;
+	OS_SYNC_MutexLock(&writer->mutex);
+	if (writer->last) writer->last->next = block;
+	else writer->first = block;
+	writer->last = block;
+	OS_SYNC_ConditionVarSignal(&writer->wake);
+	OS_SYNC_MutexUnlock(&writer->mutex);
+
+	replay->block_first_frame += replay->block_frames_count;
+	replay->block_frames_count = 0;
+	DS_ArrClear(&replay->block);
+	memset(&replay->state, 0, sizeof(replay->state));
+}
+
+// -- Playback --------------------------------------------------------------
+
+// Reads the block index from the footer. If the recording was never finished, rebuilds it from the block headers.
+static bool ReplayReadIndex(Replay* replay) {
+	FILE* f = replay->file;
+	ReplayFileHeader header;
+	if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != REPLAY_FILE_MAGIC || header.version != REPLAY_VERSION) {
+		return false;
+	}
+
+	ReplayFooter footer = {};
+	bool has_footer = fseek(f, -(long)sizeof(footer), SEEK_END) == 0 && fread(&footer, sizeof(footer), 1, f) == 1 &&
+		footer.magic == REPLAY_FOOTER_MAGIC;
+	if (has_footer) {
+		DS_ArrResizeUndef(&replay->index, (int)footer.blocks_count);
+		has_footer = fseek(f, (long)footer.index_offset, SEEK_SET) == 0 &&
+			fread(replay->index.data, sizeof(ReplayIndexEntry), footer.blocks_count, f) == footer.blocks_count;
+	}
+
+	if (!has_footer) {
+		DS_ArrClear(&replay->index);
+		uint64_t offset = sizeof(header);
+		fseek(f, (long)offset, SEEK_SET);
+		for (ReplayBlockHeader block; fread(&block, sizeof(block), 1, f) == 1 && block.magic == REPLAY_BLOCK_MAGIC;) {
+			if (fseek(f, (long)block.compressed_size, SEEK_CUR) != 0) break;
+			ReplayIndexEntry entry = {block.first_frame, block.frames_count, offset};
+			DS_ArrPush(&replay->index, entry);
+			offset += sizeof(block) + block.compressed_size;
+		}
+		// The last block may have been cut short by a crash
+		fseek(f, 0, SEEK_END);
+		if (replay->index.count > 0 && (uint64_t)ftell(f) < offset) replay->index.count--;
+	}
+
+	replay->frames_count = 0;
+	if (replay->index.count > 0) {
+		ReplayIndexEntry last = replay->index.data[replay->index.count - 1];
+		replay->frames_count = (int)(last.first_frame + last.frames_count);
+	}
+	return true;
+}
+
+static bool ReplayLoadBlock(Replay* replay, int block_index) {
+	ReplayIndexEntry entry = replay->index.data[block_index];
+	ReplayBlockHeader header;
+	bool ok = fseek(replay->file, (long)entry.offset, SEEK_SET) == 0 && fread(&header, sizeof(header), 1, replay->file) == 1 &&
+		header.magic == REPLAY_BLOCK_MAGIC;
+	if (ok) {
+		DS_ArrResizeUndef(&replay->compressed, (int)header.compressed_size);
+		DS_ArrResizeUndef(&replay->block, (int)header.raw_size);
+		ok = fread(replay->compressed.data, 1, header.compressed_size, replay->file) == header.compressed_size;
+		ok = ok && stbi_zlib_decode_buffer((char*)replay->block.data, (int)header.raw_size,
+			(const char*)replay->compressed.data, (int)header.compressed_size) == (int)header.raw_size;
+	}
+
+	replay->current_block = ok ? block_index : -1;
+	replay->block_read_offset = 0;
+	memset(&replay->state, 0, sizeof(replay->state));
+	return ok;
+}
+
+static bool ReplaySeek(Replay* replay, int frame_index) {
+	assert(replay->playing);
+	if (frame_index < 0 || frame_index >= replay->frames_count) {
+		replay->is_finished = true;
+		return false;
+	}
+
+	// Binary search for the block that contains the frame
+	int lo = 0, hi = replay->index.count - 1;
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (replay->index.data[mid].first_frame <= (uint32_t)frame_index) lo = mid;
+		else hi = mid - 1;
+	}
+
+	if (!ReplayLoadBlock(replay, lo)) {
+		replay->is_finished = true;
+		return false;
+	}
+
+	// Decode the frames before the target frame to get the key and mouse state
+	ReplayReader r = {replay->block.data, replay->block.count, 0, false};
+	for (uint32_t i = replay->index.data[lo].first_frame; i < (uint32_t)frame_index; i++) {
+		ReplayDecodeFrame(&r, &replay->state, NULL, NULL, NULL);
+	}
+	replay->block_read_offset = r.offset;
+	replay->frame_index = frame_index;
+	replay->is_finished = r.error;
+	return !r.error;
+}
+
+// -- API -------------------------------------------------------------------
+
+static void ReplayInit(Replay* replay, const char* filepath, bool play) {
+	memset(replay, 0, sizeof(*replay));
+	DS_ArrInit(&replay->block, DS_HEAP);
+	DS_ArrInit(&replay->index, DS_HEAP);
+	DS_ArrInit(&replay->compressed, DS_HEAP);
+	replay->current_block = -1;
+
+	if (play) {
+		replay->file = fopen(filepath, "rb");
+		if (replay->file == NULL) play = false; // Begin a new recording if a recording doesn't exist
+		else if (!ReplayReadIndex(replay)) replay->frames_count = 0; // Don't record over a file that isn't a replay
+	}
+	replay->playing = play;
+
+	if (play) {
+		ReplaySeek(replay, 0);
 	} else {
-		fwrite(data, size, 1, replay->file);
+		replay->file = fopen(filepath, "wb");
+		assert(replay->file);
+
+		ReplayFileHeader header = {REPLAY_FILE_MAGIC, REPLAY_VERSION, REPLAY_FRAMES_PER_BLOCK, 0};
+		fwrite(&header, sizeof(header), 1, replay->file);
+
+		ReplayWriter* writer = (ReplayWriter*)DS_MemAlloc(DS_HEAP, sizeof(ReplayWriter));
+		memset(writer, 0, sizeof(*writer));
+		writer->file = replay->file;
+		writer->offset = sizeof(header);
+		DS_ArrInit(&writer->index, DS_HEAP);
+		OS_SYNC_MutexInit(&writer->mutex);
+		OS_SYNC_ConditionVarInit(&writer->wake);
+		OS_SYNC_ThreadStart(&writer->thread, ReplayWriterThreadFn, writer, "Replay writer");
+		replay->writer = writer;
 	}
 }
 
-#define ReplaySerializeX(REPLAY, X) ReplaySerializeData(REPLAY, (X), sizeof(*(X)))
+static void ReplayDeinit(Replay* replay) {
+	if (!replay->playing) {
+		ReplaySubmitBlock(replay);
+
+		ReplayWriter* writer = replay->writer;
+		OS_SYNC_MutexLock(&writer->mutex);
+		writer->quit = true;
+		OS_SYNC_ConditionVarSignal(&writer->wake);
+		OS_SYNC_MutexUnlock(&writer->mutex);
+		OS_SYNC_ThreadJoin(&writer->thread); // the writer finishes the queued blocks first
+
+		ReplayFooter footer = {};
+		footer.index_offset = writer->offset;
+		footer.blocks_count = (uint32_t)writer->index.count;
+		footer.frames_count = (uint32_t)replay->block_first_frame;
+		footer.magic = REPLAY_FOOTER_MAGIC;
+		fwrite(writer->index.data, sizeof(ReplayIndexEntry), writer->index.count, replay->file);
+		fwrite(&footer, sizeof(footer), 1, replay->file);
+
+		DS_ArrDeinit(&writer->index);
+		OS_SYNC_ConditionVarDestroy(&writer->wake);
+		OS_SYNC_MutexDestroy(&writer->mutex);
+		DS_MemFree(DS_HEAP, writer);
+	}
 
-static void ReplayProcessFrame(Replay* replay, DS_Arena* frame_arena, Input_Frame* inputs, ReplayMousePos* mouse_pos) {
-	replay->frame_index++; // starts at frame 1
+	if (replay->file) fclose(replay->file);
+	DS_ArrDeinit(&replay->block);
+	DS_ArrDeinit(&replay->index);
+	DS_ArrDeinit(&replay->compressed);
+	memset(replay, 0, sizeof(*replay));
+}
 
-	int32_t magic_number = 52039023;
-	ReplaySerializeX(replay, &magic_number);
-	assert(magic_number == 52039023);
-	if (replay->is_finished) return;
-	
-	ReplaySerializeX(replay, &inputs->events_count);
-	if (replay->playing) inputs->events = (Input_Event*)DS_ArenaPush(frame_arena, inputs->events_count * sizeof(Input_Event));
-	ReplaySerializeData(replay, inputs->events, inputs->events_count * sizeof(Input_Event));
-	
+static void ReplayProcessFrame(Replay* replay, DS_Arena* frame_arena, INPUT_Frame* inputs, ReplayMousePos* mouse_pos) {
 	if (replay->playing) {
-		int32_t down_keys_count;
-		ReplaySerializeX(replay, &down_keys_count);
-		Input_Key* down_keys = (Input_Key*)DS_ArenaPush(frame_arena, down_keys_count * sizeof(Input_Key));
-		ReplaySerializeData(replay, down_keys, down_keys_count * sizeof(Input_Key));
-		
-		memset(inputs->key_is_down, 0, sizeof(inputs->key_is_down));
-		for (int i = 0; i < down_keys_count; i++) {
-			inputs->key_is_down[down_keys[i]] = true;
+		if (replay->is_finished) return;
+		if (replay->frame_index >= replay->frames_count) {
+			replay->is_finished = true;
+			return;
 		}
-	} else {
-		DS_DynArray(Input_Key) down_keys = {frame_arena};
-		for (int i = 0; i < Input_Key_COUNT; i++) {
-			if (inputs->key_is_down[i]) {
-				DS_ArrPush(&down_keys, (Input_Key)i);
+
+		// Move on to the next block when the current one runs out
+		ReplayIndexEntry entry = replay->index.data[replay->current_block];
+		if ((uint32_t)replay->frame_index >= entry.first_frame + entry.frames_count) {
+			if (!ReplayLoadBlock(replay, replay->current_block + 1)) {
+				replay->is_finished = true;
+				return;
 			}
 		}
-		ReplaySerializeX(replay, &down_keys.length);
-		ReplaySerializeData(replay, down_keys.data, down_keys.length * sizeof(Input_Key));
-	}
-	
-	ReplaySerializeX(replay, &inputs->mouse_wheel_input);
-	ReplaySerializeX(replay, &inputs->raw_mouse_input);
-	ReplaySerializeX(replay, mouse_pos);
 
-	fflush(replay->file); // ...in case the program crashes and fclose is never called
+		ReplayReader r = {replay->block.data, replay->block.count, replay->block_read_offset, false};
+		ReplayDecodeFrame(&r, &replay->state, frame_arena, inputs, mouse_pos);
+		replay->block_read_offset = r.offset;
+		if (r.error) {
+			replay->is_finished = true;
+			return;
+		}
+	} else {
+		ReplayEncodeFrame(&replay->block, &replay->state, inputs, *mouse_pos);
+		replay->block_frames_count++;
+		if (replay->block_frames_count == REPLAY_FRAMES_PER_BLOCK) ReplaySubmitBlock(replay);
+	}
+	replay->frame_index++;
 }
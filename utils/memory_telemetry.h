@@ -0,0 +1,182 @@
+// Registry of named arenas and containers for keeping track of memory usage.
+//
+// Depends on `fire_ds.h`
+//
+// Usage:
+//   MemTelemetry_RegisterArena("Temp arena", &g_temp_arena, 0);
+//   MemTelemetry_RegisterArray("Fonts", &fonts, 0);
+//   ...
+//   MemTelemetry_Sample(0); // e.g. once per frame, and before resetting an arena
+//   ...
+//   MemTelemetry_WriteJSON(file);
+//
+// The objects are only read when sampling, and reading an object that another thread is modifying isn't safe. So every
+// object is registered into a group, and each thread samples only the groups of the objects it owns. Register everything
+// before the threads start; the registry itself isn't synchronized.
+//
+// A container that allocates from a registered arena is counted by both entries, so the totals count it twice.
+//
+
+#define MEM_TELEMETRY_MAX_ENTRIES 64
+
+enum MemTelemetry_Kind {
+	MemTelemetry_Kind_Arena,
+	MemTelemetry_Kind_Array,
+	MemTelemetry_Kind_Map,
+	MemTelemetry_Kind_Custom,
+};
+
+static const char* MemTelemetry_KindNames[] = {"arena", "array", "map", "custom"};
+
+struct MemTelemetry_Usage {
+	int64_t used;     // bytes holding live data
+	int64_t reserved; // bytes taken from the allocator or committed from the OS
+	int64_t wasted;   // bytes that can't be used until a reset, e.g. abandoned array buffers and unused block ends
+};
+
+typedef void (*MemTelemetry_SampleFn)(void* object, MemTelemetry_Usage* out_usage);
+
+struct MemTelemetry_Entry {
+	const char* name;
+	MemTelemetry_Kind kind;
+	int group;
+	void* object;
+	int elem_size; // for arrays and maps
+	MemTelemetry_SampleFn sample_fn; // for custom entries
+
+	// Updated by MemTelemetry_Sample
+	MemTelemetry_Usage current;
+	int64_t peak_used; // highest `current.used` of all samples
+	int64_t peak_reserved;
+	int samples_count;
+};
+
+struct MemTelemetry {
+	MemTelemetry_Entry entries[MEM_TELEMETRY_MAX_ENTRIES];
+	int entries_count;
+};
+
+static MemTelemetry g_mem_telemetry;
+
+static MemTelemetry_Entry* MemTelemetry_AddEntry(const char* name, MemTelemetry_Kind kind, int group, void* object) {
+	assert(g_mem_telemetry.entries_count < MEM_TELEMETRY_MAX_ENTRIES);
+	MemTelemetry_Entry* entry = &g_mem_telemetry.entries[g_mem_telemetry.entries_count++];
+	memset(entry, 0, sizeof(*entry));
+	entry->name = name;
+	entry->kind = kind;
+	entry->group = group;
+	entry->object = object;
+	return entry;
+}
+
+// `name` must stay alive for as long as the entry is registered.
+static void MemTelemetry_RegisterArena(const char* name, DS_Arena* arena, int group) {
+	MemTelemetry_AddEntry(name, MemTelemetry_Kind_Arena, group, arena);
+}
+
+#define MemTelemetry_RegisterArray(NAME, ARR, GROUP) MemTelemetry_RegisterArrayRaw(NAME, (DS_DynArrayRaw*)(ARR), DS_ArrElemSize(*(ARR)), GROUP)
+#define MemTelemetry_RegisterMap(NAME, MAP, GROUP)   MemTelemetry_RegisterMapRaw(NAME, (DS_MapRaw*)(MAP), DS_MapElemSize(MAP), GROUP)
+
+static void MemTelemetry_RegisterArrayRaw(const char* name, DS_DynArrayRaw* array, int elem_size, int group) {
+	MemTelemetry_AddEntry(name, MemTelemetry_Kind_Array, group, array)->elem_size = elem_size;
+}
+
+static void MemTelemetry_RegisterMapRaw(const char* name, DS_MapRaw* map, int elem_size, int group) {
+	MemTelemetry_AddEntry(name, MemTelemetry_Kind_Map, group, map)->elem_size = elem_size;
+}
+
+// For things that aren't a single arena or container, e.g. all the arenas of a forest's plants.
+static void MemTelemetry_RegisterCustom(const char* name, void* object, MemTelemetry_SampleFn sample_fn, int group) {
+	MemTelemetry_AddEntry(name, MemTelemetry_Kind_Custom, group, object)->sample_fn = sample_fn;
+}
+
+static void MemTelemetry_Unregister(void* object) {
+	for (int i = 0; i < g_mem_telemetry.entries_count; i++) {
+		if (g_mem_telemetry.entries[i].object == object) {
+			g_mem_telemetry.entries[i] = g_mem_telemetry.entries[--g_mem_telemetry.entries_count];
+			i--;
+		}
+	}
+}
+
+static MemTelemetry_Usage MemTelemetry_ArenaUsage(DS_Arena* arena) {
+	MemTelemetry_Usage usage = {};
+	usage.used = DS_ArenaGetUsed(arena) - arena->wasted_bytes;
+	if (usage.used < 0) usage.used = 0; // the arena was rewound with DS_ArenaSetMark
+	usage.reserved = arena->total_mem_reserved;
+	usage.wasted = arena->wasted_bytes;
+	return usage;
+}
+
+static void MemTelemetry_SampleEntry(MemTelemetry_Entry* entry) {
+	MemTelemetry_Usage usage = {};
+	switch (entry->kind) {
+	case MemTelemetry_Kind_Arena: {
+		usage = MemTelemetry_ArenaUsage((DS_Arena*)entry->object);
+	} break;
+	case MemTelemetry_Kind_Array: {
+		// Buffers that the array abandoned when growing are counted by its arena. Here, only the unused capacity is wasted.
+		DS_DynArrayRaw* array = (DS_DynArrayRaw*)entry->object;
+		usage.used = (int64_t)array->count * entry->elem_size;
+		usage.reserved = (int64_t)array->capacity * entry->elem_size;
+		usage.wasted = usage.reserved - usage.used;
+	} break;
+	case MemTelemetry_Kind_Map: {
+		DS_MapRaw* map = (DS_MapRaw*)entry->object;
+		int64_t slot_size = entry->elem_size + 1; // one control byte per slot
+		usage.used = (int64_t)map->count * entry->elem_size;
+		usage.reserved = (int64_t)(map->capacity + map->old_capacity) * slot_size;
+		usage.wasted = (int64_t)map->deleted_count * slot_size;
+	} break;
+	case MemTelemetry_Kind_Custom: {
+		entry->sample_fn(entry->object, &usage);
+	} break;
+	}
+
+	entry->current = usage;
+	if (usage.used > entry->peak_used) entry->peak_used = usage.used;
+	if (usage.reserved > entry->peak_reserved) entry->peak_reserved = usage.reserved;
+	entry->samples_count++;
+}
+
+// Samples the entries of `group`
+static void MemTelemetry_Sample(int group) {
+	for (int i = 0; i < g_mem_telemetry.entries_count; i++) {
+		MemTelemetry_Entry* entry = &g_mem_telemetry.entries[i];
+		if (entry->group == group) MemTelemetry_SampleEntry(entry);
+	}
+}
+
+// Returns NULL if there is no entry with this name
+static const MemTelemetry_Entry* MemTelemetry_Find(const char* name) {
+	for (int i = 0; i < g_mem_telemetry.entries_count; i++) {
+		if (strcmp(g_mem_telemetry.entries[i].name, name) == 0) return &g_mem_telemetry.entries[i];
+	}
+	return NULL;
+}
+
+// Writes the latest samples of all entries, and the totals over them, as a JSON object
+static void MemTelemetry_WriteJSON(FILE* file) {
+	MemTelemetry_Usage total = {};
+	int64_t total_peak_used = 0, total_peak_reserved = 0;
+
+	fprintf(file, "{\n\t\"entries\": [\n");
+	for (int i = 0; i < g_mem_telemetry.entries_count; i++) {
+		const MemTelemetry_Entry* entry = &g_mem_telemetry.entries[i];
+		fprintf(file, "\t\t{\"name\": \"%s\", \"kind\": \"%s\", \"used\": %lld, \"reserved\": %lld, \"wasted\": %lld, \"peak_used\": %lld, \"peak_reserved\": %lld, \"samples\": %d}%s\n",
+			entry->name, MemTelemetry_KindNames[entry->kind], (long long)entry->current.used, (long long)entry->current.reserved,
+			(long long)entry->current.wasted, (long long)entry->peak_used, (long long)entry->peak_reserved, entry->samples_count,
+			i == g_mem_telemetry.entries_count - 1 ? "" : ",");
+
+		total.used += entry->current.used;
+		total.reserved += entry->current.reserved;
+		total.wasted += entry->current.wasted;
+		total_peak_used += entry->peak_used;
+		total_peak_reserved += entry->peak_reserved;
+	}
+	fprintf(file, "\t],\n");
+
+	// The sum of the peaks is an upper bound of the true peak, since the entries don't peak at the same time
+	fprintf(file, "\t\"total\": {\"used\": %lld, \"reserved\": %lld, \"wasted\": %lld, \"peak_used\": %lld, \"peak_reserved\": %lld}\n}\n",
+		(long long)total.used, (long long)total.reserved, (long long)total.wasted, (long long)total_peak_used, (long long)total_peak_reserved);
+}
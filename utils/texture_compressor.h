@@ -0,0 +1,428 @@
+// CPU texture compressor: BC1, BC3 and BC7 block encoding, mip generation and writing the result into a DDS file.
+// This is meant to run offline (see `src/texture_compressor.cpp`), so that the app can upload the blocks directly.
+//
+// Depends on `fire_ds.h` and `third_party/ddspp.h`
+//
+// Usage:
+//   TexCompress_Image image = TexCompress_Compress(&arena, rgba8_pixels, width, height, TexCompress_Format_BC7, true);
+//   TexCompress_WriteDDS("leaf.dds", &image);
+//
+// The encoders go for fast and decent rather than optimal. Block endpoints are fitted along the principal axis of the
+// block's colors, and BC7 only uses mode 6 (a single subset with RGBA endpoints and 4-bit indices).
+//
+
+#define TEX_COMPRESS_MAX_MIPS 16
+
+enum TexCompress_Format {
+	TexCompress_Format_BC1, // RGB with 1-bit alpha, 8 bytes per block
+	TexCompress_Format_BC3, // RGBA, 16 bytes per block
+	TexCompress_Format_BC7, // RGBA, 16 bytes per block
+};
+
+static const char* TexCompress_FormatNames[] = {"bc1", "bc3", "bc7"};
+
+struct TexCompress_Mip {
+	int width;
+	int height;
+	int offset; // from the start of the image data
+	int size;
+	int row_pitch; // bytes per row of blocks
+};
+
+struct TexCompress_Image {
+	TexCompress_Format format;
+	int width;
+	int height;
+	int mips_count;
+	TexCompress_Mip mips[TEX_COMPRESS_MAX_MIPS];
+	uint8_t* data;
+	int data_size;
+};
+
+static int TexCompress_BlockSize(TexCompress_Format format) {
+	return format == TexCompress_Format_BC1 ? 8 : 16;
+}
+
+static DDSPP_DXGIFormat TexCompress_DXGIFormat(TexCompress_Format format) {
+	return format == TexCompress_Format_BC1 ? BC1_UNORM : format == TexCompress_Format_BC3 ? BC3_UNORM : BC7_UNORM;
+}
+
+// Fills in the layout of `mips_count` mips, or of the full mip chain if `mips_count` is 0. Returns the total size.
+static int TexCompress_MipLayout(TexCompress_Format format, int width, int height, int mips_count, DS_OUT TexCompress_Image* image) {
+	if (mips_count == 0) {
+		for (int size = width > height ? width : height; size > 0; size >>= 1) mips_count++;
+	}
+	if (mips_count > TEX_COMPRESS_MAX_MIPS) mips_count = TEX_COMPRESS_MAX_MIPS;
+
+	image->format = format;
+	image->width = width;
+	image->height = height;
+	image->mips_count = mips_count;
+
+	int offset = 0;
+	for (int i = 0; i < mips_count; i++) {
+		TexCompress_Mip* mip = &image->mips[i];
+		mip->width = width >> i > 0 ? width >> i : 1;
+		mip->height = height >> i > 0 ? height >> i : 1;
+		mip->row_pitch = (mip->width + 3) / 4 * TexCompress_BlockSize(format);
+		mip->size = mip->row_pitch * ((mip->height + 3) / 4);
+		mip->offset = offset;
+		offset += mip->size;
+	}
+	image->data_size = offset;
+	return offset;
+}
+
+// Halves an RGBA8 image with a box filter. Colors are weighted by alpha, so that transparent texels don't bleed
+// their color into the edges of cutouts in the smaller mips.
+static void TexCompress_Downsample(const uint8_t* src, int src_width, int src_height, uint8_t* dst, int dst_width, int dst_height) {
+	for (int y = 0; y < dst_height; y++) {
+		for (int x = 0; x < dst_width; x++) {
+			int x0 = x * 2 < src_width ? x * 2 : src_width - 1, x1 = x * 2 + 1 < src_width ? x * 2 + 1 : src_width - 1;
+			int y0 = y * 2 < src_height ? y * 2 : src_height - 1, y1 = y * 2 + 1 < src_height ? y * 2 + 1 : src_height - 1;
+			const uint8_t* texels[4] = {
+				&src[(y0 * src_width + x0) * 4], &src[(y0 * src_width + x1) * 4],
+				&src[(y1 * src_width + x0) * 4], &src[(y1 * src_width + x1) * 4],
+			};
+
+			uint32_t alpha_sum = 0, color_sum[3] = {}, weighted_sum[3] = {};
+			for (int i = 0; i < 4; i++) {
+				alpha_sum += texels[i][3];
+				for (int c = 0; c < 3; c++) {
+					color_sum[c] += texels[i][c];
+					weighted_sum[c] += texels[i][c] * texels[i][3];
+				}
+			}
+
+			uint8_t* out = &dst[(y * dst_width + x) * 4];
+			for (int c = 0; c < 3; c++) {
+				out[c] = (uint8_t)(alpha_sum > 0 ? (weighted_sum[c] + alpha_sum / 2) / alpha_sum : (color_sum[c] + 2) / 4);
+			}
+			out[3] = (uint8_t)((alpha_sum + 2) / 4);
+		}
+	}
+}
+
+// -- Block encoders -------------------------------------------------------------------------------------------------------
+
+// Mean and principal axis of the first `channels` channels of a block, by power iteration on the covariance matrix.
+static void TexCompress_PrincipalAxis(const float pixels[16][4], int channels, float out_mean[4], float out_axis[4]) {
+	float mean[4] = {}, min[4], max[4];
+	for (int c = 0; c < 4; c++) { min[c] = 255.f; max[c] = 0.f; }
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < channels; c++) {
+			mean[c] += pixels[i][c] * (1.f / 16.f);
+			min[c] = pixels[i][c] < min[c] ? pixels[i][c] : min[c];
+			max[c] = pixels[i][c] > max[c] ? pixels[i][c] : max[c];
+		}
+	}
+
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; i++) {
+		for (int a = 0; a < channels; a++) {
+			for (int b = 0; b < channels; b++) {
+				covariance[a][b] += (pixels[i][a] - mean[a]) * (pixels[i][b] - mean[b]);
+			}
+		}
+	}
+
+	// Start from the bounding box diagonal, which is usually close already
+	float axis[4] = {};
+	for (int c = 0; c < channels; c++) axis[c] = max[c] - min[c];
+
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float next[4] = {};
+		float length_sq = 0.f;
+		for (int a = 0; a < channels; a++) {
+			for (int b = 0; b < channels; b++) next[a] += covariance[a][b] * axis[b];
+			length_sq += next[a] * next[a];
+		}
+		if (length_sq < 1e-12f) break; // all pixels are the same, or the axis is orthogonal to the spread
+		float inv_length = 1.f / sqrtf(length_sq);
+		for (int c = 0; c < channels; c++) axis[c] = next[c] * inv_length;
+	}
+
+	for (int c = 0; c < 4; c++) {
+		out_mean[c] = mean[c];
+		out_axis[c] = c < channels ? axis[c] : 0.f;
+	}
+}
+
+// Endpoints along the principal axis that cover the projections of all pixels, clamped into [0, 255]
+static void TexCompress_FitEndpoints(const float pixels[16][4], const bool* mask, int channels, float out_e0[4], float out_e1[4]) {
+	float mean[4], axis[4];
+	TexCompress_PrincipalAxis(pixels, channels, mean, axis);
+
+	float t_min = 1e9f, t_max = -1e9f;
+	for (int i = 0; i < 16; i++) {
+		if (mask && !mask[i]) continue;
+		float t = 0.f;
+		for (int c = 0; c < channels; c++) t += (pixels[i][c] - mean[c]) * axis[c];
+		t_min = t < t_min ? t : t_min;
+		t_max = t > t_max ? t : t_max;
+	}
+	if (t_min > t_max) t_min = t_max = 0.f; // no pixels in the mask
+
+	for (int c = 0; c < 4; c++) {
+		float e0 = mean[c] + axis[c] * t_min;
+		float e1 = mean[c] + axis[c] * t_max;
+		out_e0[c] = e0 < 0.f ? 0.f : e0 > 255.f ? 255.f : e0;
+		out_e1[c] = e1 < 0.f ? 0.f : e1 > 255.f ? 255.f : e1;
+	}
+}
+
+static float TexCompress_DistanceSq(const float a[4], const float b[4], int channels) {
+	float result = 0.f;
+	for (int c = 0; c < channels; c++) result += (a[c] - b[c]) * (a[c] - b[c]);
+	return result;
+}
+
+static uint16_t TexCompress_To565(const float color[4]) {
+	uint32_t r = (uint32_t)(color[0] * (31.f / 255.f) + 0.5f);
+	uint32_t g = (uint32_t)(color[1] * (63.f / 255.f) + 0.5f);
+	uint32_t b = (uint32_t)(color[2] * (31.f / 255.f) + 0.5f);
+	return (uint16_t)(r << 11 | g << 5 | b);
+}
+
+static void TexCompress_From565(uint16_t color, float out[4]) {
+	uint32_t r = color >> 11, g = (color >> 5) & 63, b = color & 31;
+	out[0] = (float)(r << 3 | r >> 2);
+	out[1] = (float)(g << 2 | g >> 4);
+	out[2] = (float)(b << 3 | b >> 2);
+	out[3] = 255.f;
+}
+
+// If `allow_transparent` is set and the block has texels with alpha below 128, the 3-color mode is used and those texels
+// become transparent. Otherwise, alpha is ignored.
+static void TexCompress_EncodeBC1(const float pixels[16][4], bool allow_transparent, uint8_t out[8]) {
+	bool opaque[16];
+	bool has_transparent = false;
+	for (int i = 0; i < 16; i++) {
+		opaque[i] = !allow_transparent || pixels[i][3] >= 128.f;
+		has_transparent = has_transparent || !opaque[i];
+	}
+
+	float e0[4], e1[4];
+	TexCompress_FitEndpoints(pixels, opaque, 3, e0, e1);
+	uint16_t c0 = TexCompress_To565(e0), c1 = TexCompress_To565(e1);
+
+	// The order of the endpoints selects the mode: c0 > c1 is the 4-color mode, c0 <= c1 is the 3-color mode
+	if (has_transparent ? c0 > c1 : c0 < c1) {
+		uint16_t tmp = c0; c0 = c1; c1 = tmp;
+	}
+
+	float palette[4][4];
+	TexCompress_From565(c0, palette[0]);
+	TexCompress_From565(c1, palette[1]);
+	int palette_count;
+	if (c0 > c1) {
+		for (int c = 0; c < 3; c++) {
+			palette[2][c] = (2.f * palette[0][c] + palette[1][c]) * (1.f / 3.f);
+			palette[3][c] = (palette[0][c] + 2.f * palette[1][c]) * (1.f / 3.f);
+		}
+		palette_count = 4;
+	} else {
+		for (int c = 0; c < 3; c++) palette[2][c] = (palette[0][c] + palette[1][c]) * 0.5f;
+		palette_count = 3; // index 3 is transparent black
+	}
+
+	uint32_t indices = 0;
+	for (int i = 0; i < 16; i++) {
+		uint32_t index = 3;
+		if (opaque[i]) {
+			float best = 1e30f;
+			for (int j = 0; j < palette_count; j++) {
+				float d = TexCompress_DistanceSq(pixels[i], palette[j], 3);
+				if (d < best) { best = d; index = j; }
+			}
+		}
+		indices |= index << (i * 2);
+	}
+
+	out[0] = (uint8_t)c0; out[1] = (uint8_t)(c0 >> 8);
+	out[2] = (uint8_t)c1; out[3] = (uint8_t)(c1 >> 8);
+	memcpy(out + 4, &indices, 4);
+}
+
+// The alpha half of a BC3 block, which is the same as a BC4 block
+static void TexCompress_EncodeAlpha(const float pixels[16][4], uint8_t out[8]) {
+	float min = 255.f, max = 0.f;
+	for (int i = 0; i < 16; i++) {
+		min = pixels[i][3] < min ? pixels[i][3] : min;
+		max = pixels[i][3] > max ? pixels[i][3] : max;
+	}
+	uint8_t a0 = (uint8_t)(max + 0.5f), a1 = (uint8_t)(min + 0.5f);
+
+	// a0 > a1 selects the mode with 6 interpolated values. If a0 == a1, every index can be 0.
+	float palette[8];
+	palette[0] = (float)a0;
+	palette[1] = (float)a1;
+	for (int j = 1; j < 7; j++) palette[j + 1] = ((float)(7 - j) * (float)a0 + (float)j * (float)a1) * (1.f / 7.f);
+
+	uint64_t indices = 0;
+	for (int i = 0; i < 16; i++) {
+		uint64_t index = 0;
+		if (a0 > a1) {
+			float best = 1e30f;
+			for (int j = 0; j < 8; j++) {
+				float d = (pixels[i][3] - palette[j]) * (pixels[i][3] - palette[j]);
+				if (d < best) { best = d; index = j; }
+			}
+		}
+		indices |= index << (i * 3);
+	}
+
+	out[0] = a0;
+	out[1] = a1;
+	for (int i = 0; i < 6; i++) out[2 + i] = (uint8_t)(indices >> (i * 8));
+}
+
+static void TexCompress_EncodeBC3(const float pixels[16][4], uint8_t out[16]) {
+	TexCompress_EncodeAlpha(pixels, out);
+	TexCompress_EncodeBC1(pixels, false, out + 8);
+}
+
+// Writes `bits_count` bits of `value` into a 128-bit block at `*bit_offset`
+static void TexCompress_PutBits(uint8_t block[16], int* bit_offset, uint32_t value, int bits_count) {
+	for (int i = 0; i < bits_count; i++, (*bit_offset)++) {
+		if (value & (1u << i)) block[*bit_offset >> 3] |= (uint8_t)(1u << (*bit_offset & 7));
+	}
+}
+
+// Quantizes an endpoint into 7 bits per channel and a shared p-bit, picking the p-bit that gives the smaller error
+static void TexCompress_QuantizeBC7Endpoint(const float endpoint[4], uint32_t out_channels[4], uint32_t* out_p_bit, float out_value[4]) {
+	float best_error = 1e30f;
+	for (uint32_t p = 0; p < 2; p++) {
+		uint32_t channels[4];
+		float value[4];
+		float error = 0.f;
+		for (int c = 0; c < 4; c++) {
+			int q = (int)((endpoint[c] - (float)p) * 0.5f + 0.5f);
+			q = q < 0 ? 0 : q > 127 ? 127 : q;
+			channels[c] = (uint32_t)q;
+			value[c] = (float)((channels[c] << 1) | p);
+			error += (value[c] - endpoint[c]) * (value[c] - endpoint[c]);
+		}
+		if (error < best_error) {
+			best_error = error;
+			*out_p_bit = p;
+			memcpy(out_channels, channels, sizeof(channels));
+			memcpy(out_value, value, sizeof(value));
+		}
+	}
+}
+
+// BC7 mode 6: one subset, RGBA endpoints with 7 bits per channel plus a p-bit, and 4-bit indices
+static void TexCompress_EncodeBC7(const float pixels[16][4], uint8_t out[16]) {
+	static const int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+	float e[2][4];
+	TexCompress_FitEndpoints(pixels, NULL, 4, e[0], e[1]);
+
+	uint32_t channels[2][4], p_bits[2];
+	float values[2][4];
+	TexCompress_QuantizeBC7Endpoint(e[0], channels[0], &p_bits[0], values[0]);
+	TexCompress_QuantizeBC7Endpoint(e[1], channels[1], &p_bits[1], values[1]);
+
+	float palette[16][4];
+	for (int j = 0; j < 16; j++) {
+		for (int c = 0; c < 4; c++) {
+			palette[j][c] = (float)((((64 - weights[j]) * (int)values[0][c] + weights[j] * (int)values[1][c] + 32) >> 6));
+		}
+	}
+
+	uint32_t indices[16];
+	for (int i = 0; i < 16; i++) {
+		float best = 1e30f;
+		for (int j = 0; j < 16; j++) {
+			float d = TexCompress_DistanceSq(pixels[i], palette[j], 4);
+			if (d < best) { best = d; indices[i] = j; }
+		}
+	}
+
+	// The highest bit of the first index is implied to be 0, so swap the endpoints if it isn't
+	if (indices[0] & 8) {
+		for (int c = 0; c < 4; c++) {
+			uint32_t tmp = channels[0][c]; channels[0][c] = channels[1][c]; channels[1][c] = tmp;
+		}
+		uint32_t tmp = p_bits[0]; p_bits[0] = p_bits[1]; p_bits[1] = tmp;
+		for (int i = 0; i < 16; i++) indices[i] = 15 - indices[i];
+	}
+
+	memset(out, 0, 16);
+	int bit_offset = 0;
+	TexCompress_PutBits(out, &bit_offset, 1 << 6, 7); // mode 6
+	for (int c = 0; c < 4; c++) {
+		TexCompress_PutBits(out, &bit_offset, channels[0][c], 7);
+		TexCompress_PutBits(out, &bit_offset, channels[1][c], 7);
+	}
+	TexCompress_PutBits(out, &bit_offset, p_bits[0], 1);
+	TexCompress_PutBits(out, &bit_offset, p_bits[1], 1);
+	TexCompress_PutBits(out, &bit_offset, indices[0], 3);
+	for (int i = 1; i < 16; i++) TexCompress_PutBits(out, &bit_offset, indices[i], 4);
+	DS_ASSERT(bit_offset == 128);
+}
+
+// -- Images ---------------------------------------------------------------------------------------------------------------
+
+static void TexCompress_CompressMip(const uint8_t* rgba, int width, int height, TexCompress_Format format, uint8_t* out) {
+	int block_size = TexCompress_BlockSize(format);
+	for (int by = 0; by < height; by += 4) {
+		for (int bx = 0; bx < width; bx += 4) {
+			// Blocks that stick out of the image repeat its last row and column
+			float pixels[16][4];
+			for (int i = 0; i < 16; i++) {
+				int x = bx + (i & 3) < width ? bx + (i & 3) : width - 1;
+				int y = by + (i >> 2) < height ? by + (i >> 2) : height - 1;
+				const uint8_t* texel = &rgba[(y * width + x) * 4];
+				for (int c = 0; c < 4; c++) pixels[i][c] = (float)texel[c];
+			}
+
+			switch (format) {
+			case TexCompress_Format_BC1: TexCompress_EncodeBC1(pixels, true, out); break;
+			case TexCompress_Format_BC3: TexCompress_EncodeBC3(pixels, out); break;
+			case TexCompress_Format_BC7: TexCompress_EncodeBC7(pixels, out); break;
+			}
+			out += block_size;
+		}
+	}
+}
+
+// `rgba` is an RGBA8 image of `width * height` texels. The result is allocated from `arena`.
+static TexCompress_Image TexCompress_Compress(DS_Arena* arena, const uint8_t* rgba, int width, int height, TexCompress_Format format, bool generate_mips) {
+	TexCompress_Image image = {};
+	TexCompress_MipLayout(format, width, height, generate_mips ? 0 : 1, &image);
+	image.data = (uint8_t*)DS_ArenaPush(arena, image.data_size);
+
+	DS_Scope scratch = DS_ScratchBegin(&arena, 1);
+	const uint8_t* mip_rgba = rgba;
+	for (int i = 0; i < image.mips_count; i++) {
+		const TexCompress_Mip* mip = &image.mips[i];
+		if (i > 0) {
+			const TexCompress_Mip* prev = &image.mips[i - 1];
+			uint8_t* next_rgba = (uint8_t*)DS_ArenaPush(scratch.arena, mip->width * mip->height * 4);
+			TexCompress_Downsample(mip_rgba, prev->width, prev->height, next_rgba, mip->width, mip->height);
+			mip_rgba = next_rgba;
+		}
+		TexCompress_CompressMip(mip_rgba, mip->width, mip->height, format, image.data + mip->offset);
+	}
+	DS_ScratchEnd(&scratch);
+	return image;
+}
+
+// Writes the image with a DX10 header, so that the exact DXGI format is stored. Returns true on success.
+static bool TexCompress_WriteDDS(const char* filepath, const TexCompress_Image* image) {
+	DDSPP_Header header = {};
+	DDSPP_HeaderDXT10 dxt10_header = {};
+	ddspp_encode_header(TexCompress_DXGIFormat(image->format), image->width, image->height, 1, Texture2D, image->mips_count, 1, &header, &dxt10_header);
+
+	FILE* f = fopen(filepath, "wb");
+	if (f == NULL) return false;
+
+	bool ok = fwrite(&DDS_MAGIC, sizeof(DDS_MAGIC), 1, f) == 1;
+	ok = ok && fwrite(&header, sizeof(header), 1, f) == 1;
+	ok = ok && fwrite(&dxt10_header, sizeof(dxt10_header), 1, f) == 1;
+	ok = ok && fwrite(image->data, image->data_size, 1, f) == 1;
+	fclose(f);
+	return ok;
+}
@@ -0,0 +1,146 @@
+// Minimal pool of worker threads for running a batch of independent jobs in parallel.
+//
+// Depends on `fire_os_sync.h`
+//
+// Usage:
+//   ThreadPool pool;
+//   ThreadPool_Init(&pool, 7);
+//   ThreadPool_Run(&pool, jobs_count, MyJobFn, &my_data); // returns once all jobs are done
+//   ThreadPool_Deinit(&pool);
+//
+// The calling thread participates in running the jobs, so `worker_index` ranges from 0 (the calling thread) to
+// `ThreadPool_ThreadCount(pool) - 1`. This makes it easy to keep per-thread data, i.e. temporary arenas, in a plain array.
+// Passing a NULL pool to ThreadPool_Run runs all the jobs on the calling thread.
+//
+
+#define THREAD_POOL_MAX_WORKERS 31
+
+struct ThreadPool;
+
+typedef void (*ThreadPool_JobFn)(void* user_data, int job_index, int worker_index);
+
+struct ThreadPool_Worker {
+	ThreadPool* pool;
+	int index;
+	OS_SYNC_Thread thread;
+};
+
+struct ThreadPool {
+	OS_SYNC_Mutex mutex;
+	OS_SYNC_Mutex run_mutex; // only one batch may run at a time
+	OS_SYNC_ConditionVar work_available;
+	OS_SYNC_ConditionVar work_finished;
+
+	ThreadPool_Worker workers[THREAD_POOL_MAX_WORKERS];
+	int workers_count;
+	bool quit;
+
+	// The current batch. Protected by `mutex`
+	ThreadPool_JobFn batch_fn;
+	void* batch_user_data;
+	int batch_jobs_count;
+	int batch_next_job;
+	int batch_jobs_done;
+};
+
+static int ThreadPool_ThreadCount(ThreadPool* pool) {
+	return pool ? pool->workers_count + 1 : 1;
+}
+
+static void ThreadPool_WorkerThreadFn(void* user_data) {
+	ThreadPool_Worker* worker = (ThreadPool_Worker*)user_data;
+	ThreadPool* pool = worker->pool;
+
+	OS_SYNC_MutexLock(&pool->mutex);
+	for (;;) {
+		while (!pool->quit && pool->batch_next_job >= pool->batch_jobs_count) {
+			OS_SYNC_ConditionVarWait(&pool->work_available, &pool->mutex);
+		}
+		if (pool->quit) break;
+
+		int job_index = pool->batch_next_job++;
+		OS_SYNC_MutexUnlock(&pool->mutex);
+
+		pool->batch_fn(pool->batch_user_data, job_index, worker->index);
+
+		OS_SYNC_MutexLock(&pool->mutex);
+		pool->batch_jobs_done++;
+		if (pool->batch_jobs_done == pool->batch_jobs_count) {
+			OS_SYNC_ConditionVarBroadcast(&pool->work_finished);
+		}
+	}
+	OS_SYNC_MutexUnlock(&pool->mutex);
+}
+
+// NOTE: The `pool` pointer may not be moved or copied while in use.
+static void ThreadPool_Init(ThreadPool* pool, int workers_count) {
+	assert(workers_count >= 0 && workers_count <= THREAD_POOL_MAX_WORKERS);
+	memset(pool, 0, sizeof(*pool));
+	OS_SYNC_MutexInit(&pool->mutex);
+	OS_SYNC_MutexInit(&pool->run_mutex);
+	OS_SYNC_ConditionVarInit(&pool->work_available);
+	OS_SYNC_ConditionVarInit(&pool->work_finished);
+
+	pool->workers_count = workers_count;
+	for (int i = 0; i < workers_count; i++) {
+		ThreadPool_Worker* worker = &pool->workers[i];
+		worker->pool = pool;
+		worker->index = i + 1;
+		OS_SYNC_ThreadStart(&worker->thread, ThreadPool_WorkerThreadFn, worker, "ThreadPool worker");
+	}
+}
+
+static void ThreadPool_Deinit(ThreadPool* pool) {
+	OS_SYNC_MutexLock(&pool->mutex);
+	pool->quit = true;
+	OS_SYNC_ConditionVarBroadcast(&pool->work_available);
+	OS_SYNC_MutexUnlock(&pool->mutex);
+
+	for (int i = 0; i < pool->workers_count; i++) {
+		OS_SYNC_ThreadJoin(&pool->workers[i].thread);
+	}
+
+	OS_SYNC_ConditionVarDestroy(&pool->work_available);
+	OS_SYNC_ConditionVarDestroy(&pool->work_finished);
+	OS_SYNC_MutexDestroy(&pool->run_mutex);
+	OS_SYNC_MutexDestroy(&pool->mutex);
+}
+
+// Calls `fn` once for every job index in [0, jobs_count) and returns when all of them have finished.
+// * Must not be called from inside a job that's running on the same pool.
+static void ThreadPool_Run(ThreadPool* pool, int jobs_count, ThreadPool_JobFn fn, void* user_data) {
+	if (pool == NULL || pool->workers_count == 0 || jobs_count <= 1) {
+		for (int i = 0; i < jobs_count; i++) fn(user_data, i, 0);
+		return;
+	}
+
+	OS_SYNC_MutexLock(&pool->run_mutex);
+	OS_SYNC_MutexLock(&pool->mutex);
+	pool->batch_fn = fn;
+	pool->batch_user_data = user_data;
+	pool->batch_jobs_count = jobs_count;
+	pool->batch_next_job = 0;
+	pool->batch_jobs_done = 0;
+	OS_SYNC_ConditionVarBroadcast(&pool->work_available);
+
+	// Help out with the jobs on this thread
+	while (pool->batch_next_job < pool->batch_jobs_count) {
+		int job_index = pool->batch_next_job++;
+		OS_SYNC_MutexUnlock(&pool->mutex);
+
+		fn(user_data, job_index, 0);
+
+		OS_SYNC_MutexLock(&pool->mutex);
+		pool->batch_jobs_done++;
+	}
+
+	while (pool->batch_jobs_done < pool->batch_jobs_count) {
+		OS_SYNC_ConditionVarWait(&pool->work_finished, &pool->mutex);
+	}
+
+	pool->batch_jobs_count = 0;
+	pool->batch_next_job = 0;
+	pool->batch_jobs_done = 0;
+	OS_SYNC_MutexUnlock(&pool->mutex);
+	OS_SYNC_MutexUnlock(&pool->run_mutex);
+}